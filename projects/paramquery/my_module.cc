@@ -4,6 +4,7 @@
 #include "sylar/application.h"
 #include "sylar/env.h"
 
+#include "sylar/http/servlets/cache_servlet.h"
 #include "paramquery_servlet.h"
 
 namespace paramquery 
@@ -53,7 +54,9 @@ bool MyModule::onServerReady()
         sylar::http::ParamQueryServlet::ptr slt(new sylar::http::ParamQueryServlet(
                     sylar::EnvMgr::GetInstance()->getCwd()
         ));
-        slt_dispatch->addGlobServlet("/paramquery", slt);
+        // 相同参数的查询结果相同，套一层缓存，减少访问redis
+        slt_dispatch->addGlobServlet("/paramquery"
+                , std::make_shared<sylar::http::CachingServlet>(slt));
         SYLAR_LOG_INFO(g_logger) << "addServlet";
     }
 
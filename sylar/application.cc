@@ -32,6 +32,11 @@ static sylar::ConfigVar<std::string>::ptr g_server_pid_file =
             ,std::string("sylar.pid")
             , "server pid file");
 
+static sylar::ConfigVar<bool>::ptr g_server_watch_conf =
+    sylar::Config::Lookup("server.watch_conf"
+            ,true
+            , "reload changed conf files at runtime");
+
 //static sylar::ConfigVar<std::string>::ptr g_service_discovery_zk =
 //    sylar::Config::Lookup("service_discovery.zk"
 //            ,std::string("")
@@ -154,6 +159,10 @@ int Application::main(int argc, char** argv)
     }
 
     m_mainIOManager.reset(new sylar::IOManager(1, true, "main"));
+    if(g_server_watch_conf->getValue())
+    {
+        sylar::Config::WatchConfDir(conf_path, m_mainIOManager.get());
+    }
     m_mainIOManager->schedule(std::bind(&Application::run_fiber, this));
     m_mainIOManager->addTimer(2000, [](){
             //SYLAR_LOG_INFO(g_logger) << "hello";
@@ -1,20 +1,337 @@
 #include "bytearray.h"
-#include <fstream>
 #include <sstream>
 #include <string.h>
 #include <iomanip>
 #include <math.h>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#if defined(__BMI2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
 #include "log.h"
 #include "endian.h"
+#include "config.h"
+#include "mutex.h"
+#include "macro.h"
 
 namespace sylar
 {
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+static sylar::ConfigVar<uint64_t>::ptr g_bytearray_pool_thread_bytes =
+    sylar::Config::Lookup("bytearray.pool.thread_bytes", (uint64_t)(1024 * 1024),
+            "bytearray node pool per-thread cache bytes of each size");
+
+static sylar::ConfigVar<uint64_t>::ptr g_bytearray_pool_depot_bytes =
+    sylar::Config::Lookup("bytearray.pool.depot_bytes", (uint64_t)(64 * 1024 * 1024),
+            "bytearray node pool global depot max bytes");
+
+static sylar::ConfigVar<uint64_t>::ptr g_bytearray_mmap_segment_bytes =
+    sylar::Config::Lookup("bytearray.mmap.segment_bytes", (uint64_t)(16 * 1024 * 1024),
+            "bytearray writable mmap file grow step");
+
+/**
+ * @brief   文件的一段映射，最后一个引用它的内存块释放时munmap
+ */
+struct ByteArray::MappedSegment
+{
+    MappedSegment(void* a, size_t l, uint64_t o, bool w)
+        : addr((char*)a), len(l), offset(o), writable(w)
+    {
+    }
+
+    ~MappedSegment()
+    {
+        munmap(addr, len);
+    }
+
+    char* addr;
+    size_t len;
+    /// 在文件里的偏移
+    uint64_t offset;
+    bool writable;
+    /// 所属MappedFile的id，只有这个文件的所有者能直接写这个映射段
+    uint64_t fileId = 0;
+};
+
+/**
+ * @brief   映射的文件
+ */
+struct ByteArray::MappedFile
+{
+    ~MappedFile()
+    {
+        if(fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+
+    /// 每次mapFile分配一个，不会重复(地址可能被复用，所以不用指针比较)
+    uint64_t id = 0;
+    std::string name;
+    /// 只读映射映射完就关掉了，为-1
+    int fd = -1;
+    bool writable = false;
+    /// 每次扩展的大小
+    size_t segmentBytes = 0;
+    /// 当前用来分配内存块的映射段
+    std::shared_ptr<MappedSegment> segment;
+    /// 当前映射段已经分配出去的字节数
+    size_t segmentUsed = 0;
+    /// 文件当前的长度(已经扩展过的)
+    uint64_t fileSize = 0;
+};
+
+namespace
+{
+
+static std::atomic<uint64_t> s_pool_allocs = {0};
+static std::atomic<uint64_t> s_pool_hits = {0};
+/// 线程缓存和仓库里的总字节数
+static std::atomic<uint64_t> s_pool_retained = {0};
+
+/**
+ * @brief   同一大小内存块的空闲链表，用Node::next串起来
+ */
+struct NodeFreeList
+{
+    size_t size = 0;
+    ByteArray::Node* head = nullptr;
+    size_t count = 0;
+    /// 线程缓存最多放多少块
+    size_t limit = 0;
+
+    void push(ByteArray::Node* node)
+    {
+        node->next = head;
+        head = node;
+        ++count;
+    }
+
+    ByteArray::Node* pop()
+    {
+        ByteArray::Node* node = head;
+        head = node->next;
+        node->next = nullptr;
+        --count;
+        return node;
+    }
+};
+
+/**
+ * @brief   全局仓库，线程缓存空了从这里批量拿，满了批量还到这里
+ */
+class NodeDepot
+{
+public:
+    typedef Spinlock MutexType;
+
+    /**
+     * @brief   进程退出时线程缓存还要往这里还，所以不析构
+     */
+    static NodeDepot* GetInstance()
+    {
+        static NodeDepot* s_depot = new NodeDepot;
+        return s_depot;
+    }
+
+    /**
+     * @brief   从仓库拿最多count块放进list，返回拿到的块数
+     */
+    size_t take(NodeFreeList& list, size_t count)
+    {
+        MutexType::Lock lock(m_mutex);
+        NodeFreeList& depot = getList(list.size);
+        size_t n = 0;
+        while(n < count && depot.head)
+        {
+            list.push(depot.pop());
+            ++n;
+        }
+        m_bytes -= n * list.size;
+        return n;
+    }
+
+    /**
+     * @brief   从list还count块到仓库，超过仓库上限的直接释放
+     */
+    void give(NodeFreeList& list, size_t count)
+    {
+        uint64_t max_bytes = g_bytearray_pool_depot_bytes->getValue();
+        std::vector<ByteArray::Node*> frees;
+        {
+            MutexType::Lock lock(m_mutex);
+            NodeFreeList& depot = getList(list.size);
+            while(count > 0 && list.head)
+            {
+                ByteArray::Node* node = list.pop();
+                if(m_bytes + list.size <= max_bytes)
+                {
+                    depot.push(node);
+                    m_bytes += list.size;
+                }
+                else
+                {
+                    frees.push_back(node);
+                }
+                --count;
+            }
+        }
+        s_pool_retained.fetch_sub(frees.size() * list.size, std::memory_order_relaxed);
+        for(auto& i : frees)
+        {
+            delete i;
+        }
+    }
+
+private:
+    NodeFreeList& getList(size_t size)
+    {
+        for(auto& i : m_lists)
+        {
+            if(i.size == size)
+            {
+                return i;
+            }
+        }
+        m_lists.push_back(NodeFreeList());
+        m_lists.back().size = size;
+        return m_lists.back();
+    }
+
+private:
+    MutexType m_mutex;
+    /// 内存块大小种类不多，线性查找就够了
+    std::vector<NodeFreeList> m_lists;
+    uint64_t m_bytes = 0;
+};
+
+/**
+ * @brief   线程本地缓存，线程退出时全部还给仓库
+ */
+struct NodeThreadCache
+{
+    ~NodeThreadCache();
+
+    NodeFreeList& getList(size_t size)
+    {
+        for(auto& i : lists)
+        {
+            if(i.size == size)
+            {
+                return i;
+            }
+        }
+        lists.push_back(NodeFreeList());
+        NodeFreeList& list = lists.back();
+        list.size = size;
+        list.limit = std::max<uint64_t>(4, g_bytearray_pool_thread_bytes->getValue() / size);
+        return list;
+    }
+
+    std::vector<NodeFreeList> lists;
+};
+
+static thread_local bool t_node_cache_dead = false;
+
+NodeThreadCache::~NodeThreadCache()
+{
+    t_node_cache_dead = true;
+    for(auto& i : lists)
+    {
+        NodeDepot::GetInstance()->give(i, i.count);
+    }
+}
+
+/**
+ * @brief   线程退出过程中(缓存已析构)返回nullptr
+ */
+static NodeThreadCache* GetNodeThreadCache()
+{
+    if(t_node_cache_dead)
+    {
+        return nullptr;
+    }
+    static thread_local NodeThreadCache s_cache;
+    return &s_cache;
+}
+
+}
+
+ByteArray::PoolStats ByteArray::GetPoolStats()
+{
+    PoolStats stats;
+    stats.allocs = s_pool_allocs.load(std::memory_order_relaxed);
+    stats.hits = s_pool_hits.load(std::memory_order_relaxed);
+    stats.retained_bytes = s_pool_retained.load(std::memory_order_relaxed);
+    return stats;
+}
+
+ByteArray::Node* ByteArray::AllocNode(size_t size)
+{
+    s_pool_allocs.fetch_add(1, std::memory_order_relaxed);
+    NodeThreadCache* cache = GetNodeThreadCache();
+    if(cache)
+    {
+        NodeFreeList& list = cache->getList(size);
+        if(!list.head)
+        {
+            NodeDepot::GetInstance()->take(list, list.limit / 2 + 1);
+        }
+        if(list.head)
+        {
+            s_pool_hits.fetch_add(1, std::memory_order_relaxed);
+            s_pool_retained.fetch_sub(size, std::memory_order_relaxed);
+            Node* node = list.pop();
+            node->ref.store(1, std::memory_order_relaxed);
+            return node;
+        }
+    }
+    return new Node(size);
+}
+
+void ByteArray::FreeNode(Node* node)
+{
+    // 还有别的ByteArray在用这个内存块
+    if(node->ref.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    {
+        return;
+    }
+    if(node->mapping)
+    {
+        // 映射的内存块不进池子，释放最后一个时自动munmap
+        delete node;
+        return;
+    }
+
+    NodeThreadCache* cache = GetNodeThreadCache();
+    if(!cache)
+    {
+        delete node;
+        return;
+    }
+
+    NodeFreeList& list = cache->getList(node->size);
+    list.push(node);
+    s_pool_retained.fetch_add(node->size, std::memory_order_relaxed);
+    if(list.count > list.limit)
+    {
+        // 还一半给仓库，仓库放不下的会被释放掉
+        NodeDepot::GetInstance()->give(list, list.count / 2);
+    }
+}
+
 ByteArray::Node::Node(size_t s)
     : ptr(new char[s])
     , next(nullptr)
     , size(s)
+    , ref(1)
 {
 
 }
@@ -23,13 +340,14 @@ ByteArray::Node::Node()
     : ptr(nullptr)
     , next(nullptr)
     , size(0)
+    , ref(1)
 {
 
 }
 
 ByteArray::Node::~Node()
 {
-    if(ptr)
+    if(ptr && !mapping)
     {
         delete[] ptr;
     }
@@ -41,31 +359,171 @@ ByteArray::ByteArray(size_t base_size)
     , m_capacity(base_size)
     , m_size(0)
     , m_endian(SYLAR_BIG_ENDIAN)
-    , m_root(new Node(base_size))
-    , m_cur(m_root)
+    , m_offset(0)
+    , m_consumeMode(false)
 {
-
+    m_nodes.push_back(AllocNode(base_size));
 }
 
 ByteArray::~ByteArray()
 {
-    Node* tmp = m_root;
-    while(tmp)
+    truncateMappedFile();
+    for(auto& i : m_nodes)
+    {
+        FreeNode(i);    // 还给内存块池，共享的内存块等最后一个使用者释放
+    }
+}
+
+/**
+ * @brief   varint编码到p，返回编码后的字节数，p至少要有10个字节
+ */
+static inline size_t EncodeVarint(uint8_t* p, uint64_t value)
+{
+    if(value < 0x80)
+    {
+        p[0] = value;
+        return 1;
+    }
+    size_t i = 0;
+    while(value >= 0x80)
+    {
+        p[i++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    p[i++] = value;
+    return i;
+}
+
+/**
+ * @brief   从[p, p+avail)解码最多max_len字节的varint
+ *
+ * @return  返回消耗的字节数，avail里找不到结尾(并且不到max_len)返回0
+ */
+static inline size_t DecodeVarint(const uint8_t* p, size_t avail, size_t max_len, uint64_t& v)
+{
+    if(SYLAR_LIKELY(avail > 0 && p[0] < 0x80))
+    {
+        v = p[0];
+        return 1;
+    }
+#if defined(__BMI2__) && SYLAR_BYTE_ORDER == SYLAR_LITTLE_ENDIAN
+    if(avail >= 8)
+    {
+        // 一次读8个字节，最高位为0的第一个字节就是结尾，用pext把每字节的低7位拼起来
+        uint64_t x;
+        memcpy(&x, p, sizeof(x));
+        uint64_t stop = ~x & 0x8080808080808080ull;
+        if(stop)
+        {
+            size_t len = (__builtin_ctzll(stop) >> 3) + 1;
+            if(len <= max_len)
+            {
+                uint64_t mask = len == 8 ? ~0ull : ((1ull << (len * 8)) - 1);
+                v = _pext_u64(x & mask, 0x7f7f7f7f7f7f7f7full);
+                return len;
+            }
+        }
+    }
+#endif
+    uint64_t result = 0;
+    size_t n = avail < max_len ? avail : max_len;
+    for(size_t i = 0; i < n; ++i)
+    {
+        uint64_t b = p[i];
+        result |= (b & 0x7f) << (7 * i);
+        if(b < 0x80 || i + 1 == max_len)
+        {
+            v = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+uint8_t* ByteArray::getContiguousWrite(size_t size)
+{
+    size_t phys = m_position + m_offset;
+    size_t idx = phys / m_baseSize;
+    size_t npos = phys % m_baseSize;
+    if(idx >= m_nodes.size() || m_baseSize - npos < size)
+    {
+        return nullptr;
+    }
+    return (uint8_t*)getWritableNode(idx)->ptr + npos;
+}
+
+template<class T>
+void ByteArray::writeFixed(T value)
+{
+    uint8_t* p = getContiguousWrite(sizeof(T));
+    if(SYLAR_LIKELY(p != nullptr))
     {
-        m_cur = tmp;
-        tmp = tmp->next;
-        delete m_cur;   // 调用Node的析构函数，里面再delete掉一个节点所占的char数组
+        memcpy(p, &value, sizeof(T));
+        m_position += sizeof(T);
+        if(m_position > m_size)
+        {
+            m_size = m_position;
+        }
+        return;
+    }
+    write(&value, sizeof(T));
+}
+
+template<class T>
+T ByteArray::readFixed()
+{
+    T v;
+    size_t phys = m_position + m_offset;
+    size_t npos = phys % m_baseSize;
+    if(SYLAR_LIKELY(m_baseSize - npos >= sizeof(T) && getReadSize() >= sizeof(T)))
+    {
+        memcpy(&v, m_nodes[phys / m_baseSize]->ptr + npos, sizeof(T));
+        m_position += sizeof(T);
+        if(m_consumeMode && m_position + m_offset >= m_baseSize)
+        {
+            compact();
+        }
+        return v;
     }
+    read(&v, sizeof(T));
+    return v;
+}
+
+bool ByteArray::readVarintFast(uint64_t& v, size_t max_len)
+{
+    size_t phys = m_position + m_offset;
+    size_t npos = phys % m_baseSize;
+    size_t avail = m_baseSize - npos;
+    if(avail > getReadSize())
+    {
+        avail = getReadSize();
+    }
+    if(avail == 0)
+    {
+        return false;
+    }
+    size_t len = DecodeVarint((const uint8_t*)m_nodes[phys / m_baseSize]->ptr + npos
+                            , avail, max_len, v);
+    if(len == 0)
+    {
+        return false;
+    }
+    m_position += len;
+    if(m_consumeMode && m_position + m_offset >= m_baseSize)
+    {
+        compact();
+    }
+    return true;
 }
 
 void ByteArray::writeFint8(int8_t value)
 {
-    write(&value, sizeof(value));
+    writeFixed(value);
 }
 
 void ByteArray::writeFuint8(uint8_t value)
 {
-    write(&value, sizeof(value));
+    writeFixed(value);
 }
 
 void ByteArray::writeFint16(int16_t value)
@@ -74,7 +532,7 @@ void ByteArray::writeFint16(int16_t value)
     {
         value = byteswap(value);
     }
-    write(&value, sizeof(value));
+    writeFixed(value);
 }
 
 void ByteArray::writeFuint16(uint16_t value)
@@ -83,7 +541,7 @@ void ByteArray::writeFuint16(uint16_t value)
     {
         value = byteswap(value);
     }
-    write(&value, sizeof(value));
+    writeFixed(value);
 }
 
 void ByteArray::writeFint32(int32_t value)
@@ -92,7 +550,7 @@ void ByteArray::writeFint32(int32_t value)
     {
         value = byteswap(value);
     }
-    write(&value, sizeof(value));
+    writeFixed(value);
 }
 
 void ByteArray::writeFuint32(uint32_t value)
@@ -101,7 +559,7 @@ void ByteArray::writeFuint32(uint32_t value)
     {
         value = byteswap(value);
     }
-    write(&value, sizeof(value));
+    writeFixed(value);
 }
 
 void ByteArray::writeFint64(int64_t value)
@@ -110,7 +568,7 @@ void ByteArray::writeFint64(int64_t value)
     {
         value = byteswap(value);
     }
-    write(&value, sizeof(value));
+    writeFixed(value);
 }
 
 void ByteArray::writeFuint64(uint64_t value)
@@ -119,7 +577,7 @@ void ByteArray::writeFuint64(uint64_t value)
     {
         value = byteswap(value);
     }
-    write(&value, sizeof(value));
+    writeFixed(value);
 }
 
 static uint32_t EncodeZigzag32(const int32_t& v)
@@ -163,15 +621,20 @@ void ByteArray::writeInt32(int32_t value)
 
 void ByteArray::writeUint32(uint32_t value)
 {
-    uint8_t tmp[5];
-    uint8_t i = 0;
-    while(value >= 0x80)
+    // 当前内存块放得下最长的编码就直接写进内存块
+    uint8_t* p = getContiguousWrite(5);
+    if(SYLAR_LIKELY(p != nullptr))
     {
-        tmp[i++] = (value & 0x7F) | 0x80;
-        value >>= 7;
+        m_position += EncodeVarint(p, value);
+        if(m_position > m_size)
+        {
+            m_size = m_position;
+        }
+        return;
     }
-    tmp[i++] = value;
-    write(tmp, i);
+
+    uint8_t tmp[5];
+    write(tmp, EncodeVarint(tmp, value));
 }
 
 void ByteArray::writeInt64(int64_t value)
@@ -181,15 +644,19 @@ void ByteArray::writeInt64(int64_t value)
 
 void ByteArray::writeUint64(uint64_t value)
 {
-    uint8_t tmp[10];
-    uint8_t i = 0;
-    while(value >= 0x80)
+    uint8_t* p = getContiguousWrite(10);
+    if(SYLAR_LIKELY(p != nullptr))
     {
-        tmp[i++] = (value & 0x7F) | 0x80;
-        value >>= 7;
+        m_position += EncodeVarint(p, value);
+        if(m_position > m_size)
+        {
+            m_size = m_position;
+        }
+        return;
     }
-    tmp[i++] = value;
-    write(tmp, i);
+
+    uint8_t tmp[10];
+    write(tmp, EncodeVarint(tmp, value));
 }
 
 void ByteArray::writeFloat(float value)
@@ -237,21 +704,16 @@ void ByteArray::writeStringWithoutLength(const std::string& value)
 
 int8_t ByteArray::readFint8()
 {
-    int8_t v;
-    read(&v, sizeof(v));
-    return v;
+    return readFixed<int8_t>();
 }
 
 uint8_t ByteArray::readFuint8()
 {
-    uint8_t v;
-    read(&v, sizeof(v));
-    return v;
+    return readFixed<uint8_t>();
 }
 
 #define XX(type) \
-    type v; \
-    read(&v, sizeof(v)); \
+    type v = readFixed<type>(); \
     if(m_endian == SYLAR_BYTE_ORDER) \
     { \
         return v; \
@@ -300,7 +762,13 @@ int32_t ByteArray::readInt32()
 
 uint32_t ByteArray::readUint32()
 {
-    uint32_t result = 0;
+    uint64_t result = 0;
+    if(SYLAR_LIKELY(readVarintFast(result, 5)))
+    {
+        return result;
+    }
+
+    // 跨内存块的慢路径，一个字节一个字节读
     for(int i=0; i<32; i+=7)
     {
         uint8_t b = readFuint8();
@@ -325,6 +793,11 @@ int64_t ByteArray::readInt64()
 uint64_t ByteArray::readUint64()
 {
     uint64_t result = 0;
+    if(SYLAR_LIKELY(readVarintFast(result, 10)))
+    {
+        return result;
+    }
+
     for(int i=0; i<64; i+=7)
     {
         uint8_t b = readFuint8();
@@ -393,19 +866,247 @@ std::string ByteArray::readStringVint()
     return buff;
 }
 
+/**
+ * @brief   把src里n个elem_size字节的元素逐个反转字节序写到dst，dst和src可以是同一块内存
+ */
+static void ByteswapArray(void* dst, const void* src, size_t n, size_t elem_size)
+{
+    const uint8_t* s = (const uint8_t*)src;
+    uint8_t* d = (uint8_t*)dst;
+    size_t i = 0;
+#if defined(__SSSE3__)
+    // 16字节一组，用pshufb按元素大小重排字节
+    static const int8_t s_masks[3][16] = {
+        {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+        {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+        {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8}
+    };
+    int m = elem_size == 2 ? 0 : (elem_size == 4 ? 1 : 2);
+    __m128i mask = _mm_loadu_si128((const __m128i*)s_masks[m]);
+    size_t per = 16 / elem_size;
+    for(; i + per <= n; i += per)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i * elem_size));
+        _mm_storeu_si128((__m128i*)(d + i * elem_size), _mm_shuffle_epi8(v, mask));
+    }
+#endif
+    for(; i < n; ++i)
+    {
+        const uint8_t* sp = s + i * elem_size;
+        uint8_t* dp = d + i * elem_size;
+        if(elem_size == 2)
+        {
+            uint16_t v;
+            memcpy(&v, sp, sizeof(v));
+            v = byteswap(v);
+            memcpy(dp, &v, sizeof(v));
+        }
+        else if(elem_size == 4)
+        {
+            uint32_t v;
+            memcpy(&v, sp, sizeof(v));
+            v = byteswap(v);
+            memcpy(dp, &v, sizeof(v));
+        }
+        else
+        {
+            uint64_t v;
+            memcpy(&v, sp, sizeof(v));
+            v = byteswap(v);
+            memcpy(dp, &v, sizeof(v));
+        }
+    }
+}
+
+void ByteArray::writeFixedArray(const void* values, size_t n, size_t elem_size)
+{
+    if(elem_size == 1 || m_endian == SYLAR_BYTE_ORDER)
+    {
+        write(values, n * elem_size);
+        return;
+    }
+
+    // 分段转换到栈上的缓冲区再写，不改调用者的数据
+    uint8_t buff[4096];
+    size_t per = sizeof(buff) / elem_size;
+    const uint8_t* src = (const uint8_t*)values;
+    while(n > 0)
+    {
+        size_t count = n > per ? per : n;
+        ByteswapArray(buff, src, count, elem_size);
+        write(buff, count * elem_size);
+        src += count * elem_size;
+        n -= count;
+    }
+}
+
+void ByteArray::readFixedArray(void* values, size_t n, size_t elem_size)
+{
+    read(values, n * elem_size);
+    if(elem_size != 1 && m_endian != SYLAR_BYTE_ORDER)
+    {
+        ByteswapArray(values, values, n, elem_size);
+    }
+}
+
+void ByteArray::writeVarintArray(const int32_t* values, size_t n)
+{
+    for(size_t i = 0; i < n; ++i)
+    {
+        writeUint32(EncodeZigzag32(values[i]));
+    }
+}
+
+void ByteArray::writeVarintArray(const uint32_t* values, size_t n)
+{
+    for(size_t i = 0; i < n; ++i)
+    {
+        writeUint32(values[i]);
+    }
+}
+
+void ByteArray::writeVarintArray(const int64_t* values, size_t n)
+{
+    for(size_t i = 0; i < n; ++i)
+    {
+        writeUint64(EncodeZigzag64(values[i]));
+    }
+}
+
+void ByteArray::writeVarintArray(const uint64_t* values, size_t n)
+{
+    for(size_t i = 0; i < n; ++i)
+    {
+        writeUint64(values[i]);
+    }
+}
+
+void ByteArray::readVarintArray(int32_t* values, size_t n)
+{
+    for(size_t i = 0; i < n; ++i)
+    {
+        values[i] = DecodeZigzag32(readUint32());
+    }
+}
+
+void ByteArray::readVarintArray(uint32_t* values, size_t n)
+{
+    for(size_t i = 0; i < n; ++i)
+    {
+        values[i] = readUint32();
+    }
+}
+
+void ByteArray::readVarintArray(int64_t* values, size_t n)
+{
+    for(size_t i = 0; i < n; ++i)
+    {
+        values[i] = DecodeZigzag64(readUint64());
+    }
+}
+
+void ByteArray::readVarintArray(uint64_t* values, size_t n)
+{
+    for(size_t i = 0; i < n; ++i)
+    {
+        values[i] = readUint64();
+    }
+}
+
 void ByteArray::clear()
 {
     m_position = m_size = 0;
     m_capacity = m_baseSize;
-    Node* tmp = m_root->next;   // 保留根节点
-    while(tmp)
+    m_offset = 0;
+    for(size_t i = 1; i < m_nodes.size(); ++i)     // 保留根节点
+    {
+        FreeNode(m_nodes[i]);
+    }
+    m_nodes.resize(1);
+}
+
+void ByteArray::discard(size_t len)
+{
+    if(len > m_size)
+    {
+        len = m_size;
+    }
+    if(len == 0)
+    {
+        return;
+    }
+    if(len == m_size)
+    {
+        // 数据都丢掉了，直接回到初始状态
+        clear();
+        return;
+    }
+
+    size_t phys = len + m_offset;
+    size_t count = phys / m_baseSize;   // 可以整块丢掉的内存块数
+    for(size_t i = 0; i < count; ++i)
     {
-        m_cur = tmp;
-        tmp = tmp->next;
-        delete m_cur;
+        FreeNode(m_nodes[i]);
     }
-    m_cur = m_root;
-    m_root->next = NULL;
+    m_nodes.erase(m_nodes.begin(), m_nodes.begin() + count);
+    m_offset = phys - count * m_baseSize;
+
+    m_position = m_position > len ? m_position - len : 0;
+    m_size -= len;
+    m_capacity -= len;
+}
+
+void ByteArray::compact()
+{
+    discard(m_position);
+}
+
+/**
+ * @brief   从块内偏移npos开始的len字节跨了几个内存块
+ */
+static inline size_t GetBufferCount(size_t npos, uint64_t len, size_t base_size)
+{
+    return (npos + len + base_size - 1) / base_size;
+}
+
+/**
+ * @brief   从块内偏移npos开始，count个iovec最多能描述多少字节
+ */
+static inline uint64_t ClampBufferLength(size_t npos, size_t count, size_t base_size)
+{
+    return count ? (uint64_t)count * base_size - npos : 0;
+}
+
+uint64_t ByteArray::getAppendBuffers(std::vector<iovec>& buffers, uint64_t len)
+{
+    if(len == 0)
+    {
+        return 0;
+    }
+    // addCapacity按m_position算剩余容量，这里要的是m_size之后的len个字节
+    addCapacity(m_size - m_position + len);
+    return getWritableBuffers(buffers, len, m_size);
+}
+
+uint64_t ByteArray::getAppendBuffers(iovec* buffers, size_t& count, uint64_t len)
+{
+    len = std::min<uint64_t>(len, ClampBufferLength((m_size + m_offset) % m_baseSize, count, m_baseSize));
+    if(len == 0)
+    {
+        count = 0;
+        return 0;
+    }
+    addCapacity(m_size - m_position + len);
+    return getWritableBuffers(buffers, count, len, m_size);
+}
+
+void ByteArray::commitAppend(size_t len)
+{
+    if(m_size + len > m_capacity)
+    {
+        throw std::out_of_range("commit_append out of range");
+    }
+    m_size += len;
 }
 
 void ByteArray::write(const void* buf, size_t size)
@@ -416,32 +1117,21 @@ void ByteArray::write(const void* buf, size_t size)
     }
     addCapacity(size);      // 先根据需要扩充容量
 
-    size_t npos = m_position % m_baseSize;  // 当前内存块所用的字节数
-    size_t ncap = m_cur->size - npos;       // 当前内存块所剩下的字节数
-    size_t bpos = 0;            // 已经分给使用者的内存字节数
+    size_t npos = (m_position + m_offset) % m_baseSize;  // 当前内存块所用的字节数
+    size_t idx = (m_position + m_offset) / m_baseSize;   // 当前内存块的下标
+    size_t bpos = 0;            // 已经写入的字节数
     while(size > 0)
     {
-        if(ncap >= size)  // 当前内存块所剩下的内存够用
-        {
-            memcpy(m_cur->ptr + npos, (const char*)buf + bpos, size);
-            if(m_cur->size == (npos + size)) // 当前内存块已用完，更新当前可用内存块位置
-            {
-                m_cur = m_cur->next;
-            }
-            m_position += size;     // 当前位置变更
-            bpos += size;           // 分配给buf的位置更新
-            size = 0;               // 所要的内存字节数变0，也就是满足需求了
-        }
-        else
-        {
-            memcpy(m_cur->ptr + npos, (const char*)buf + bpos, ncap); // 先分完当前的内存块
-            m_position += ncap;     // 当前位置变更，加上已经分的字节数
-            bpos += ncap;           // 已经分给使用者ncap个字节
-            size -= ncap;           // 需求量减少ncap个字节
-            m_cur = m_cur->next;    // 当前内存块已经用完，更新当前可用内存块
-            ncap = m_cur->size;     // 下一个内存块的所剩下字节数，也就是下一块内存块的大小
-            npos = 0;               // 下一个内存块是刚刚才next到的，所用字节数肯定是0
-        }
+        Node* cur = getWritableNode(idx);
+        size_t ncap = cur->size - npos;     // 当前内存块所剩下的字节数
+        size_t len = ncap >= size ? size : ncap;
+        memcpy(cur->ptr + npos, (const char*)buf + bpos, len);
+        m_position += len;
+        bpos += len;
+        size -= len;
+        // 没写完的话，下一个内存块从头开始写
+        ++idx;
+        npos = 0;
     }
 
     // 当前位置比当前使用内存量大，则更新当前内存使用量
@@ -459,34 +1149,13 @@ void ByteArray::read(void* buf, size_t size)
         throw std::out_of_range("not enough len");
     }
 
-    // 下面读取的代码和写入的代码的区别只是在memcpy的时候，
-    // 读取时 memcpy源地址和目的地址 与 写入时调转
-    size_t npos = m_position % m_baseSize;
-    size_t ncap = m_cur->size - npos;
-    size_t bpos = 0;
-    while(size > 0)
+    read(buf, size, m_position);
+    m_position += size;
+
+    // consume模式下，读完一整块就把读过的数据丢掉
+    if(m_consumeMode && m_position + m_offset >= m_baseSize)
     {
-        if(ncap >= size)
-        {
-            memcpy((char*)buf + bpos, m_cur->ptr + npos, size);
-            if(m_cur->size == (npos + size))
-            {
-                m_cur = m_cur->next;
-            }
-            m_position += size;
-            bpos += size;
-            size = 0;
-        }
-        else
-        {
-            memcpy((char*)buf + bpos, m_cur->ptr + npos, ncap);
-            m_position += ncap;
-            bpos += ncap;
-            size -= ncap;
-            m_cur = m_cur->next;
-            ncap = m_cur->size;
-            npos = 0;
-        }
+        compact();
     }
 }
 
@@ -494,40 +1163,24 @@ void ByteArray::read(void* buf, size_t size, size_t position) const
 {
     // 总使用量减去要读取的位置，也就是能读到的字节数。
     // 需要读取的比能读到的要大，则认为异常。
-    if(size > (m_size - position))
+    if(position > m_size || size > (m_size - position))
     {
         throw std::out_of_range("not enough len");
     }
 
-    // 下面代码和不指定位置读取的代码的区别是：
-    // 1、不使用m_position；2、没有副作用，不直接改m_cur
-    size_t npos = position % m_baseSize;    
-    size_t ncap = m_cur->size - npos;
+    size_t npos = (position + m_offset) % m_baseSize;
+    size_t idx = (position + m_offset) / m_baseSize;
     size_t bpos = 0;
-    Node* cur = m_cur;      // 无副作用，不影响原有数据结构
     while(size > 0)
     {
-        if(ncap >= size)
-        {
-            memcpy((char*)buf + bpos, cur->ptr + npos, size);
-            if(cur->size == (npos + size))
-            {
-                cur = cur->next;
-            }
-            position += size;
-            bpos += size;
-            size = 0;
-        }
-        else
-        {
-            memcpy((char*)buf + bpos, cur->ptr + npos, ncap);
-            position += ncap;
-            bpos += ncap;
-            size -= ncap;
-            cur = cur->next;
-            ncap = cur->size;
-            npos = 0;
-        }
+        Node* cur = m_nodes[idx];
+        size_t ncap = cur->size - npos;
+        size_t len = ncap >= size ? size : ncap;
+        memcpy((char*)buf + bpos, cur->ptr + npos, len);
+        bpos += len;
+        size -= len;
+        ++idx;
+        npos = 0;
     }
 }
 
@@ -544,79 +1197,295 @@ void ByteArray::setPosition(size_t v)
     {
         m_size = m_position;
     }
+}
 
-    // 因为当前位置变了，那么指向当前内存块的指针也要变
-    m_cur = m_root;
-    while(v > m_cur->size)
+bool ByteArray::writeToFile(const std::string& name) const
+{
+    // trunc覆盖写
+    int fd = ::open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
     {
-        v -= m_cur->size;
-        m_cur = m_cur->next;
+        SYLAR_LOG_ERROR(g_logger) << "writeToFile name=" << name
+            << " error, errno=" << errno << " errstr=" << strerror(errno);
+        return false;
     }
-    if(v == m_cur->size)
+
+    // 直接把内存块writev出去，不经过用户态缓冲
+    std::vector<iovec> iovs;
+    getReadBuffers(iovs, getReadSize());
+    size_t idx = 0;
+    while(idx < iovs.size())
     {
-        m_cur = m_cur->next;
+        int count = std::min<size_t>(iovs.size() - idx, IOV_MAX);
+        ssize_t rt = ::writev(fd, &iovs[idx], count);
+        if(rt < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            SYLAR_LOG_ERROR(g_logger) << "writeToFile name=" << name
+                << " writev error, errno=" << errno << " errstr=" << strerror(errno);
+            ::close(fd);
+            return false;
+        }
+        // 可能只写了一部分，跳过已经写完的
+        while(rt > 0)
+        {
+            if((size_t)rt >= iovs[idx].iov_len)
+            {
+                rt -= iovs[idx].iov_len;
+                ++idx;
+            }
+            else
+            {
+                iovs[idx].iov_base = (char*)iovs[idx].iov_base + rt;
+                iovs[idx].iov_len -= rt;
+                rt = 0;
+            }
+        }
     }
+    ::close(fd);
+    return true;
 }
 
-bool ByteArray::writeToFile(const std::string& name) const
+bool ByteArray::readFromFile(const std::string& name)
 {
-    std::ofstream ofs;
-    // trunc覆盖写，binary以二进制模式打开
-    ofs.open(name, std::ios::trunc | std::ios::binary);
-    if(!ofs)
+    int fd = ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
     {
-        SYLAR_LOG_ERROR(g_logger) << "writeToFile name=" << name
+        SYLAR_LOG_ERROR(g_logger) << "readFromFile name=" << name
             << " error, errno=" << errno << " errstr=" << strerror(errno);
         return false;
     }
 
-    int64_t read_size = getReadSize();
-    int64_t pos = m_position;
-    Node* cur = m_cur;
-    while(read_size > 0)
+    // 知道文件大小就一次准备好容量，不知道(比如/proc下的文件)就一块一块读到文件结束
+    struct stat st;
+    uint64_t left = (fstat(fd, &st) == 0 && st.st_size > 0) ? st.st_size : 0;
+    // 每轮最多准备IOV_MAX个块，大文件不用一次把所有块的iovec都生成出来
+    std::vector<iovec> iovs(IOV_MAX);
+    while(true)
     {
-        int diff = pos % m_baseSize;    // 当前块不可读(已经读完)的字节数
-
-        // 1、要读的内容比一整块要大，则读完一整块剩下的那些
-        // 2、要读的内容比一整块少，则读？？？
-        // 假设一块10字节，可读9字节，不可读是3字节，则读9-3=6字节，bug???
-        // 假设一块10字节，可读1字节，不可读是3字节，则读1-3=-5字节，bug???
-        // 应该是：
-        // int64_t len = 0;
-        // if(read_size > (int64_t)m_baseSize - diff)
-        //      len = (int64_t)m_baseSize - diff;
-        // else
-        //      len = read_size;
-        int64_t len = (read_size > (int64_t)m_baseSize ? m_baseSize : read_size) - diff;
-        ofs.write(cur->ptr + diff, len);
-        cur = cur->next;
-        pos += len;
-        read_size -= len;
+        size_t count = iovs.size();
+        getWriteBuffers(&iovs[0], count, left ? left : m_baseSize);
+        ssize_t rt = ::readv(fd, &iovs[0], count);
+        if(rt < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            SYLAR_LOG_ERROR(g_logger) << "readFromFile name=" << name
+                << " readv error, errno=" << errno << " errstr=" << strerror(errno);
+            ::close(fd);
+            return false;
+        }
+        if(rt == 0)
+        {
+            break;
+        }
+        setPosition(m_position + rt);
+        left = left > (uint64_t)rt ? left - rt : 0;
     }
-
+    ::close(fd);
     return true;
 }
 
-bool ByteArray::readFromFile(const std::string& name)
+bool ByteArray::mapFile(const std::string& name, bool writable)
 {
-    std::ifstream ifs;
-    ifs.open(name, std::ios::binary);
-    if(!ifs)
+    long page = sysconf(_SC_PAGESIZE);
+    if(writable && m_baseSize % page != 0)
     {
-        SYLAR_LOG_ERROR(g_logger) << "readFromFile name=" << name
+        SYLAR_LOG_ERROR(g_logger) << "mapFile name=" << name
+            << " base_size=" << m_baseSize << " is not a multiple of page size " << page;
+        return false;
+    }
+
+    int fd = ::open(name.c_str(), writable ? (O_RDWR | O_CREAT | O_CLOEXEC)
+                                           : (O_RDONLY | O_CLOEXEC), 0644);
+    if(fd < 0)
+    {
+        SYLAR_LOG_ERROR(g_logger) << "mapFile name=" << name
             << " error, errno=" << errno << " errstr=" << strerror(errno);
         return false;
     }
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        SYLAR_LOG_ERROR(g_logger) << "mapFile name=" << name
+            << " fstat error, errno=" << errno << " errstr=" << strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    uint64_t size = st.st_size;
+
+    static std::atomic<uint64_t> s_mapped_file_id = {0};
+    std::shared_ptr<MappedFile> mf = std::make_shared<MappedFile>();
+    mf->id = ++s_mapped_file_id;
+    mf->name = name;
+    mf->writable = writable;
+    size_t map_len = size;
+    if(writable)
+    {
+        // 扩展的大小取内存块大小的整数倍，这样内存块不会跨映射段
+        size_t seg = g_bytearray_mmap_segment_bytes->getValue();
+        mf->segmentBytes = seg < m_baseSize ? m_baseSize : seg / m_baseSize * m_baseSize;
+        map_len = (size + mf->segmentBytes - 1) / mf->segmentBytes * mf->segmentBytes;
+        if(map_len == 0)
+        {
+            map_len = mf->segmentBytes;
+        }
+        if(map_len > size && ftruncate(fd, map_len) != 0)
+        {
+            SYLAR_LOG_ERROR(g_logger) << "mapFile name=" << name
+                << " ftruncate error, errno=" << errno << " errstr=" << strerror(errno);
+            ::close(fd);
+            return false;
+        }
+    }
+    else if(size == 0)
+    {
+        // 空文件没法映射，当成空的ByteArray
+        ::close(fd);
+        unmapFile();
+        clear();
+        return true;
+    }
+
+    void* addr = mmap(nullptr, map_len, writable ? (PROT_READ | PROT_WRITE) : PROT_READ
+                    , writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    if(addr == MAP_FAILED)
+    {
+        SYLAR_LOG_ERROR(g_logger) << "mapFile name=" << name
+            << " mmap error, errno=" << errno << " errstr=" << strerror(errno);
+        if(writable && map_len > size)
+        {
+            ftruncate(fd, size);
+        }
+        ::close(fd);
+        return false;
+    }
+    if(writable)
+    {
+        mf->fd = fd;
+        mf->fileSize = map_len;
+    }
+    else
+    {
+        madvise(addr, map_len, MADV_SEQUENTIAL);
+        ::close(fd);
+    }
+    std::shared_ptr<MappedSegment> seg = std::make_shared<MappedSegment>(addr, map_len, 0, writable);
+    seg->fileId = mf->id;
 
-    std::shared_ptr<char> buff(new char[m_baseSize], [](char* ptr) { delete[] ptr; });
-    while(!ifs.eof())
+    // 原来的数据不要了
+    unmapFile();
+    for(auto& i : m_nodes)
     {
-        ifs.read(buff.get(), m_baseSize);   // 每次读取一块
-        write(buff.get(), ifs.gcount());    // gcount()返回最近无格式输入操作所提取的字符数
+        FreeNode(i);
     }
+    m_nodes.clear();
+
+    // 数据部分切成内存块，只读映射最后一块只有文件剩下的那些
+    size_t used = 0;
+    do
+    {
+        Node* node = new Node();
+        node->ptr = seg->addr + used;
+        node->size = std::min<size_t>(m_baseSize, map_len - used);
+        node->mapping = seg;
+        m_nodes.push_back(node);
+        used += m_baseSize;
+    } while(used < size);
+    mf->segment = seg;
+    mf->segmentUsed = used;
+
+    m_mapFile = mf;
+    m_position = 0;
+    m_size = size;
+    m_offset = 0;
+    m_capacity = m_nodes.size() * m_baseSize;
     return true;
 }
 
+void ByteArray::unmapFile()
+{
+    if(!m_mapFile)
+    {
+        return;
+    }
+    truncateMappedFile();
+    m_mapFile.reset();
+    clear();
+    if(m_nodes[0]->mapping)
+    {
+        FreeNode(m_nodes[0]);
+        m_nodes[0] = AllocNode(m_baseSize);
+    }
+}
+
+void ByteArray::truncateMappedFile()
+{
+    if(!m_mapFile || !m_mapFile->writable)
+    {
+        return;
+    }
+
+    // 数据末尾在文件里的位置，由最后一个字节所在内存块在映射段里的位置算出来
+    uint64_t end = 0;
+    if(m_size > 0)
+    {
+        size_t phys = m_size - 1 + m_offset;
+        Node* node = m_nodes[phys / m_baseSize];
+        if(!node->mapping)
+        {
+            return;
+        }
+        end = node->mapping->offset + (node->ptr - node->mapping->addr)
+            + phys % m_baseSize + 1;
+    }
+    if(ftruncate(m_mapFile->fd, end) != 0)
+    {
+        SYLAR_LOG_ERROR(g_logger) << "truncate mapped file name=" << m_mapFile->name
+            << " error, errno=" << errno << " errstr=" << strerror(errno);
+    }
+    m_mapFile->fileSize = end;
+}
+
+ByteArray::Node* ByteArray::allocMappedNode()
+{
+    MappedFile& mf = *m_mapFile;
+    if(!mf.segment || mf.segmentUsed + m_baseSize > mf.segment->len)
+    {
+        uint64_t offset = mf.fileSize;
+        if(ftruncate(mf.fd, offset + mf.segmentBytes) != 0)
+        {
+            SYLAR_LOG_ERROR(g_logger) << "grow mapped file name=" << mf.name
+                << " error, errno=" << errno << " errstr=" << strerror(errno);
+            throw std::bad_alloc();
+        }
+        void* addr = mmap(nullptr, mf.segmentBytes, PROT_READ | PROT_WRITE
+                        , MAP_SHARED, mf.fd, offset);
+        if(addr == MAP_FAILED)
+        {
+            SYLAR_LOG_ERROR(g_logger) << "grow mapped file name=" << mf.name
+                << " mmap error, errno=" << errno << " errstr=" << strerror(errno);
+            throw std::bad_alloc();
+        }
+        mf.segment = std::make_shared<MappedSegment>(addr, mf.segmentBytes, offset, true);
+        mf.segment->fileId = mf.id;
+        mf.segmentUsed = 0;
+        mf.fileSize = offset + mf.segmentBytes;
+    }
+
+    Node* node = new Node();
+    node->ptr = mf.segment->addr + mf.segmentUsed;
+    node->size = m_baseSize;
+    node->mapping = mf.segment;
+    mf.segmentUsed += m_baseSize;
+    return node;
+}
+
 bool ByteArray::isLittleEndian() const
 {
     return m_endian == SYLAR_LITTLE_ENDIAN;
@@ -664,118 +1533,220 @@ std::string ByteArray::toHexString() const
 
 uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers, uint64_t len) const
 {
-    len = len > getReadSize() ? getReadSize() : len;
-    if(len == 0)
+    return getReadBuffers(buffers, len, m_position);
+}
+
+uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers, uint64_t len, uint64_t position) const
+{
+    if(position >= m_size)
     {
         return 0;
     }
+    len = len > m_size - position ? m_size - position : len;
+    size_t old = buffers.size();
+    size_t count = GetBufferCount((position + m_offset) % m_baseSize, len, m_baseSize);
+    buffers.resize(old + count);
+    uint64_t size = getReadBuffers(&buffers[old], count, len, position);
+    buffers.resize(old + count);
+    return size;
+}
 
-    uint64_t size = len;
-    size_t npos = m_position % m_baseSize;
-    size_t ncap = m_cur->size - npos;
-    struct iovec iov;
-    Node* cur = m_cur;
+uint64_t ByteArray::getReadBuffers(iovec* buffers, size_t& count, uint64_t len, uint64_t position) const
+{
+    // 能读的是position到m_size之间的数据
+    if(position >= m_size)
+    {
+        count = 0;
+        return 0;
+    }
+    len = len > m_size - position ? m_size - position : len;
 
-    while(len > 0)
+    uint64_t size = 0;
+    size_t n = 0;
+    size_t npos = (position + m_offset) % m_baseSize;
+    size_t idx = (position + m_offset) / m_baseSize;
+    while(len > 0 && n < count)
     {
-        if(ncap >= len)
-        {
-            iov.iov_base = cur->ptr + npos;
-            iov.iov_len = len;
-            len = 0;
-        }
-        else
-        {
-            iov.iov_base = cur->ptr + npos;
-            iov.iov_len = ncap;
-            len -= ncap;
-            cur = cur->next;
-            ncap = cur->size;
-            npos = 0;
-        }
-        buffers.push_back(iov);
+        Node* cur = m_nodes[idx];
+        size_t ncap = cur->size - npos;
+        iovec& iov = buffers[n++];
+        iov.iov_base = cur->ptr + npos;
+        iov.iov_len = ncap >= len ? len : ncap;
+        len -= iov.iov_len;
+        size += iov.iov_len;
+        ++idx;
+        npos = 0;
     }
+    count = n;
     return size;
 }
 
-uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers, uint64_t len, uint64_t position) const
+uint64_t ByteArray::getWriteBuffers(std::vector<iovec>& buffers, uint64_t len)
 {
-    // 这里的判断好像没啥用，因为下面用的position是外面传进来的，
-    // 与m_position是没有关系的，bug???
-    len = len > getReadSize() ? getReadSize() : len;
     if(len == 0)
     {
         return 0;
     }
+    size_t old = buffers.size();
+    size_t count = GetBufferCount((m_position + m_offset) % m_baseSize, len, m_baseSize);
+    buffers.resize(old + count);
+    uint64_t size = getWriteBuffers(&buffers[old], count, len);
+    buffers.resize(old + count);
+    return size;
+}
 
-    uint64_t size = len;
-    size_t npos = position % m_baseSize;
-    size_t count = position / m_baseSize;
-    Node* cur = m_root;
-    while(count > 0)
+uint64_t ByteArray::getWriteBuffers(iovec* buffers, size_t& count, uint64_t len)
+{
+    // 只准备count个iovec装得下的容量
+    len = std::min<uint64_t>(len, ClampBufferLength((m_position + m_offset) % m_baseSize, count, m_baseSize));
+    if(len == 0)
     {
-        cur = cur->next;
-        --count;
+        count = 0;
+        return 0;
     }
-    
-    size_t ncap = cur->size - npos;
-    struct iovec iov;
-    while(len > 0)
+    addCapacity(len);
+    return getWritableBuffers(buffers, count, len, m_position);
+}
+
+uint64_t ByteArray::getWritableBuffers(std::vector<iovec>& buffers, uint64_t len, uint64_t position)
+{
+    size_t old = buffers.size();
+    size_t count = GetBufferCount((position + m_offset) % m_baseSize, len, m_baseSize);
+    buffers.resize(old + count);
+    uint64_t size = getWritableBuffers(&buffers[old], count, len, position);
+    buffers.resize(old + count);
+    return size;
+}
+
+uint64_t ByteArray::getWritableBuffers(iovec* buffers, size_t& count, uint64_t len, uint64_t position)
+{
+    uint64_t size = 0;
+    size_t n = 0;
+    size_t npos = (position + m_offset) % m_baseSize;
+    size_t idx = (position + m_offset) / m_baseSize;
+    while(len > 0 && n < count)
     {
-        if(ncap >= len)
-        {
-            iov.iov_base = cur->ptr + npos;
-            iov.iov_len = len;
-            len = 0;
-        }
-        else
-        {
-            iov.iov_base = cur->ptr + npos;
-            iov.iov_len = ncap;
-            len -= ncap;
-            cur = cur->next;
-            ncap = cur->size;
-            npos = 0;
-        }
-        buffers.push_back(iov);
+        Node* cur = getWritableNode(idx);
+        size_t ncap = cur->size - npos;
+        iovec& iov = buffers[n++];
+        iov.iov_base = cur->ptr + npos;
+        iov.iov_len = ncap >= len ? len : ncap;
+        len -= iov.iov_len;
+        size += iov.iov_len;
+        ++idx;
+        npos = 0;
     }
+    count = n;
     return size;
 }
 
-uint64_t ByteArray::getWriteBuffers(std::vector<iovec>& buffers, uint64_t len)
+ByteArray::Node* ByteArray::getWritableNode(size_t idx)
+{
+    Node* node = m_nodes[idx];
+    // 和别的ByteArray共享的、映射进来的，写之前先复制一份；只有自己读写映射的文件里
+    // 没被共享的内存块才直接写到文件里。slice/append拿到的映射内存块就算所有者已经不在了
+    // 也不能写：所有者unmap时文件已经截断，写到截断之后的位置会SIGBUS
+    bool copy_on_write = node->ref.load(std::memory_order_acquire) > 1
+                        || (node->mapping && !(m_mapFile && m_mapFile->writable
+                                                && node->mapping->fileId == m_mapFile->id));
+    if(copy_on_write)
+    {
+        Node* copy = AllocNode(m_baseSize);
+        // 只复制自己的数据所在的部分：映射的内存块后面可能已经超出文件末尾(截断了)，读会SIGBUS
+        size_t node_begin = idx * m_baseSize;
+        size_t data_end = m_offset + m_size;
+        size_t end = data_end > node_begin ? std::min(node->size, data_end - node_begin) : 0;
+        size_t begin = std::min(idx == 0 ? m_offset : 0, end);
+        memcpy(copy->ptr + begin, node->ptr + begin, end - begin);
+        FreeNode(node);
+        m_nodes[idx] = copy;
+        node = copy;
+    }
+    return node;
+}
+
+ByteArray::ptr ByteArray::slice(size_t pos, size_t len) const
+{
+    if(pos > m_size || len > m_size - pos)
+    {
+        throw std::out_of_range("slice out of range");
+    }
+    ByteArray::ptr ba(new ByteArray(m_baseSize));
+    ba->m_endian = m_endian;
+    ba->appendRange(*this, pos, len);
+    ba->m_position = 0;
+    return ba;
+}
+
+void ByteArray::append(const ByteArray& ba)
+{
+    appendRange(ba, ba.m_position, ba.getReadSize());
+}
+
+void ByteArray::appendRange(const ByteArray& src, size_t pos, size_t len)
 {
     if(len == 0)
     {
-        return 0;
+        return;
+    }
+    if(&src == this || src.m_baseSize != m_baseSize)
+    {
+        // 内存块大小不同没法共享，只能复制
+        std::string tmp;
+        tmp.resize(len);
+        src.read(&tmp[0], len, pos);
+        write(tmp.c_str(), len);
+        return;
+    }
+    if(pos > src.m_size || len > src.m_size - pos)
+    {
+        throw std::out_of_range("append out of range");
     }
-    addCapacity(len);
 
-    uint64_t size = len;
-    size_t npos = m_position % m_baseSize;
-    size_t ncap = m_cur->size - npos;
-    struct iovec iov;
-    Node* cur = m_cur;
+    if(m_size == 0)
+    {
+        // 自己是空的，直接沿用源数据在内存块里的偏移，第一块也能共享
+        clear();
+        m_offset = (pos + src.m_offset) % m_baseSize;
+        m_capacity = m_baseSize - m_offset;
+    }
 
     while(len > 0)
     {
-        if(ncap >= len)
+        size_t sphys = pos + src.m_offset;
+        Node* snode = src.m_nodes[sphys / m_baseSize];
+        size_t soff = sphys % m_baseSize;
+        size_t n = m_baseSize - soff > len ? len : m_baseSize - soff;
+
+        // 写在末尾，并且两边在内存块里的偏移一样(偏移不为0时只能是空的时候)，才能共享内存块
+        // 读写映射的要把数据写进文件，不能共享
+        size_t dphys = m_position + m_offset;
+        if(m_position == m_size && dphys % m_baseSize == soff
+                && !(m_mapFile && m_mapFile->writable)
+                && (soff == 0 || m_size == 0))
         {
-            iov.iov_base = cur->ptr + npos;
-            iov.iov_len = len;
-            len = 0;
+            size_t idx = dphys / m_baseSize;
+            snode->ref.fetch_add(1, std::memory_order_relaxed);
+            if(idx < m_nodes.size())
+            {
+                FreeNode(m_nodes[idx]);
+                m_nodes[idx] = snode;
+            }
+            else
+            {
+                m_nodes.push_back(snode);
+                m_capacity += m_baseSize;
+            }
+            m_position += n;
+            m_size = m_position;
         }
         else
         {
-            iov.iov_base = cur->ptr + npos;
-            iov.iov_len = ncap;
-            len -= ncap;
-            cur = cur->next;
-            ncap = cur->size;
-            npos = 0;
+            write(snode->ptr + soff, n);
         }
-        buffers.push_back(iov);
+        pos += n;
+        len -= n;
     }
-    return size;
 }
 
 void ByteArray::addCapacity(size_t size)
@@ -794,31 +1765,13 @@ void ByteArray::addCapacity(size_t size)
     size = size - old_cap;  // 得到需要扩充的容量大小
     // ceil(x) 返回大于或者等于x的最小整数
     size_t count = ceil(1.0 * size / m_baseSize);   // 得到需要扩充的块数
-    
-    // 遍历得到最后一个节点
-    Node* tmp = m_root;
-    while(tmp->next)
-    {
-        tmp = tmp->next;
-    }
-
-    Node* first = NULL;     // 记录扩充的第一块内存块的位置
     for(size_t i=0; i<count; ++i)
     {
-        tmp->next = new Node(m_baseSize);
-        if(first == NULL)
-        {
-            first = tmp->next;
-        }
-        tmp = tmp->next;
+        // 读写映射的从文件里扩
+        bool mapped = m_mapFile && m_mapFile->writable;
+        m_nodes.push_back(mapped ? allocMappedNode() : AllocNode(m_baseSize));
         m_capacity += m_baseSize;   // 容量加上一个内存块
     }
-
-    // 如果剩余容量已经是0了，那么扩充的第一块内容块就是当前可用内存块所在的位置
-    if(old_cap == 0)        
-    {
-        m_cur = first;
-    }
 }
 
 }
@@ -9,9 +9,11 @@
 #define __SYLAR_BYTEARRAY_H__
 
 #include <memory>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <stdint.h>
+#include <type_traits>
 #include <sys/types.h>
 #include <sys/socket.h>
 
@@ -26,6 +28,9 @@ class ByteArray
 public:
     typedef std::shared_ptr<ByteArray> ptr;
 
+    struct MappedSegment;
+    struct MappedFile;
+
     /**
      * @brief  存储节点 
      */
@@ -42,12 +47,38 @@ public:
 
         /// 内存块地址指针
         char* ptr;
-        /// 下一个内存块地址
+        /// 内存块池空闲链表里的下一个内存块
         Node* next;
         /// 内存块大小
         size_t size;
+        /// 引用计数，slice/append会让多个ByteArray共享同一个内存块
+        std::atomic<uint32_t> ref;
+        /// 内存块是映射进来的文件时，持有所在的映射段，ptr不需要释放
+        std::shared_ptr<MappedSegment> mapping;
+    };
+
+    /**
+     * @brief   内存块池的统计信息
+     */
+    struct PoolStats
+    {
+        /// 申请内存块的次数
+        uint64_t allocs;
+        /// 从池里拿到(没有new)的次数
+        uint64_t hits;
+        /// 池里(线程缓存+全局仓库)缓存着的内存块字节数
+        uint64_t retained_bytes;
+
+        double hitRate() const { return allocs ? (double)hits / allocs : 0; }
     };
 
+    /**
+     * @brief   返回内存块池的统计信息
+     * @details 内存块按大小分类缓存，先放在线程本地缓存，缓存满了一半还给全局仓库，
+     *          全局仓库的上限由配置 bytearray.pool.depot_bytes 决定
+     */
+    static PoolStats GetPoolStats();
+
     /**
      * @brief   按指定大小的内存块构造
      *
@@ -119,7 +150,67 @@ public:
     std::string readStringF64();
     std::string readStringVint();
 
+    /**
+     * @brief   写入n个定长类型(整型、float、double)的数组，按ByteArray的字节序
+     * @details 等价于逐个writeFint32/writeDouble...，字节序转换是批量做的(支持SSSE3时用字节重排指令)，
+     *          不需要转换时直接整段memcpy到内存块
+     */
+    template<class T>
+    void writeArray(const T* values, size_t n)
+    {
+        static_assert(std::is_arithmetic<T>::value
+                && (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8)
+                , "writeArray only supports fixed-width arithmetic types");
+        writeFixedArray(values, n, sizeof(T));
+    }
+
+    /**
+     * @brief   读取n个定长类型的数组，对应writeArray
+     */
+    template<class T>
+    void readArray(T* values, size_t n)
+    {
+        static_assert(std::is_arithmetic<T>::value
+                && (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8)
+                , "readArray only supports fixed-width arithmetic types");
+        readFixedArray(values, n, sizeof(T));
+    }
+
+    /**
+     * @brief   写入n个可压缩整型的数组，逐个编码，紧挨着存放(不带长度)
+     */
+    void writeVarintArray(const int32_t* values, size_t n);
+    void writeVarintArray(const uint32_t* values, size_t n);
+    void writeVarintArray(const int64_t* values, size_t n);
+    void writeVarintArray(const uint64_t* values, size_t n);
+
+    void readVarintArray(int32_t* values, size_t n);
+    void readVarintArray(uint32_t* values, size_t n);
+    void readVarintArray(int64_t* values, size_t n);
+    void readVarintArray(uint64_t* values, size_t n);
+
     void clear();
+
+    /**
+     * @brief   丢弃最前面的len个字节，整块丢弃的内存块还给内存块池
+     * @details 之后所有位置都前移len，当前位置小于len的变为0
+     */
+    void discard(size_t len);
+
+    /**
+     * @brief   丢弃当前位置之前(已经读过)的数据，当前位置变为0
+     */
+    void compact();
+
+    /**
+     * @brief   设置consume模式
+     * @details consume模式下，顺序read每读完一整块就自动compact，读过的内存块还给内存块池，
+     *          当前位置就是读位置，新数据用getAppendBuffers/commitAppend追加到末尾。
+     *          这样一个ByteArray可以长期作为连接的输入缓存，内存占用只跟未读数据量有关。
+     */
+    void setConsumeMode(bool v) { m_consumeMode = v; }
+    bool isConsumeMode() const { return m_consumeMode; }
+
     void write(const void* buf, size_t size);
     void read(void* buf, size_t size);
 
@@ -137,10 +228,40 @@ public:
     void setPosition(size_t v);
     
     /**
-     * @brief  把ByteArray的数据写入到文件中 
+     * @brief   把ByteArray可读取的数据(当前位置到末尾)写入到文件中，按内存块writev
      */
     bool writeToFile(const std::string& name) const;
+
+    /**
+     * @brief   把文件内容读到当前位置，直接readv到内存块里
+     */
     bool readFromFile(const std::string& name);
+
+    /**
+     * @brief   把文件映射进来作为ByteArray的数据，原有数据会被清空，当前位置为0
+     *
+     * @param   name        文件名
+     * @param   writable    false: 只读映射，写入时复制到普通内存块，不会改到文件；
+     *                      true: 读写映射，写入直接落到文件里；被slice()/append()共享的内存块
+     *                      写入时照样先复制，双方互不影响：所有者对共享中的内存块的写入
+     *                      不会落到文件里，slice/append得到的ByteArray的写入任何时候都不会
+     *                      落到文件里(所有者不在了也一样)，
+     *                      容量不够时按 bytearray.mmap.segment_bytes 扩展文件，
+     *                      要求内存块大小是页大小的整数倍，文件不存在会创建
+     *
+     * @return  映射失败返回false，ByteArray不变
+     */
+    bool mapFile(const std::string& name, bool writable = false);
+
+    /**
+     * @brief   结束映射，读写映射会把文件截断到实际数据的长度，之后ByteArray为空
+     */
+    void unmapFile();
+
+    /**
+     * @brief   是否是映射的文件
+     */
+    bool isMapped() const { return (bool)m_mapFile; }
     
     /**
      * @brief  返回内存块的大小 
@@ -173,17 +294,127 @@ public:
      */
     uint64_t getWriteBuffers(std::vector<iovec>& buffers, uint64_t len);
 
+    /**
+     * @brief   获取数据末尾之后len字节的可写入缓存，不改变当前位置
+     */
+    uint64_t getAppendBuffers(std::vector<iovec>& buffers, uint64_t len);
+
+    /**
+     * @brief   获取可读取的缓存，保存到调用者提供的iovec数组中，从position位置开始
+     * @details 下面三个是上面对应接口的不分配内存版本，给每次都要做一次系统调用的地方用
+     *
+     * @param   buffers iovec数组
+     * @param   count   传入数组的大小，传出实际用了几个
+     *
+     * @return  返回iovec描述的字节数，数组不够大时会小于len
+     */
+    uint64_t getReadBuffers(iovec* buffers, size_t& count, uint64_t len, uint64_t position) const;
+
+    /**
+     * @brief   获取可写入的缓存，保存到调用者提供的iovec数组中，只准备数组装得下的容量
+     */
+    uint64_t getWriteBuffers(iovec* buffers, size_t& count, uint64_t len);
+
+    /**
+     * @brief   获取数据末尾之后的可写入缓存，保存到调用者提供的iovec数组中，不改变当前位置
+     */
+    uint64_t getAppendBuffers(iovec* buffers, size_t& count, uint64_t len);
+
+    /**
+     * @brief   确认getAppendBuffers拿到的缓存里写入了len个字节，数据量增加len
+     */
+    void commitAppend(size_t len);
+
+    /**
+     * @brief   返回从pos开始len字节数据的视图，和当前ByteArray共享内存块，不复制数据
+     * @details 任何一方之后再往共享的内存块里写，都会先复制出自己的一份(copy-on-write)，
+     *          返回的ByteArray当前位置为0
+     */
+    ByteArray::ptr slice(size_t pos, size_t len) const;
+
+    /**
+     * @brief   把ba可读取的数据(当前位置到末尾)写到当前位置，ba不变
+     * @details 写在末尾并且两边在内存块里对齐时(比如ba是slice出来的，或者当前ByteArray是空的)
+     *          直接共享内存块，否则复制
+     */
+    void append(const ByteArray& ba);
+
     /**
      * @brief   返回数据的长度(当前总数据量)
      */
     size_t getSize() const { return m_size; }
 
 private:
+    /**
+     * @brief   从内存块池申请一个size大小的内存块
+     */
+    static Node* AllocNode(size_t size);
+
+    /**
+     * @brief   把内存块还给内存块池
+     */
+    static void FreeNode(Node* node);
+
     /**
      * @brief   扩容ByteArray，使其可以容纳size个数据 
      */
     void addCapacity(size_t size);
     
+    /**
+     * @brief   写入/读取n个elem_size字节的元素，需要时批量转换字节序
+     */
+    void writeFixedArray(const void* values, size_t n, size_t elem_size);
+    void readFixedArray(void* values, size_t n, size_t elem_size);
+
+    /**
+     * @brief   当前位置开始的size个字节都在同一个内存块里时，返回可以直接写入的地址，否则返回nullptr
+     */
+    uint8_t* getContiguousWrite(size_t size);
+
+    /**
+     * @brief   定长类型的快速路径，在当前内存块里放得下时直接memcpy，否则走write/read
+     */
+    template<class T>
+    void writeFixed(T value);
+    template<class T>
+    T readFixed();
+
+    /**
+     * @brief   varint在当前内存块里能完整解码时直接解码
+     *
+     * @param   v       解码结果
+     * @param   max_len 最多读取的字节数，uint32为5，uint64为10
+     *
+     * @return  解码成功返回true；跨内存块返回false，不改变当前位置
+     */
+    bool readVarintFast(uint64_t& v, size_t max_len);
+
+    /**
+     * @brief   读写映射时，从映射的文件里分配一个内存块，不够时扩展文件
+     */
+    Node* allocMappedNode();
+
+    /**
+     * @brief   读写映射时，把文件截断到实际数据的长度
+     */
+    void truncateMappedFile();
+
+    /**
+     * @brief   返回第idx个内存块，和别的ByteArray共享时先复制一份(copy-on-write)
+     */
+    Node* getWritableNode(size_t idx);
+
+    /**
+     * @brief   获取从position开始len字节的可写入缓存，需要先保证容量足够
+     */
+    uint64_t getWritableBuffers(std::vector<iovec>& buffers, uint64_t len, uint64_t position);
+    uint64_t getWritableBuffers(iovec* buffers, size_t& count, uint64_t len, uint64_t position);
+
+    /**
+     * @brief   把src从pos开始的len字节数据写到当前位置，能共享的内存块直接共享
+     */
+    void appendRange(const ByteArray& src, size_t pos, size_t len);
+
     /**
      * @brief   获取当前的可写入容量
      */
@@ -200,10 +431,14 @@ private:
     size_t m_size;
     /// 字节序,默认大端
     int8_t m_endian;
-    /// 第一个内存块的指针
-    Node* m_root;
-    /// 当前操作内存块的指针
-    Node* m_cur;
+    /// 按顺序的所有内存块，位置pos所在的内存块是m_nodes[(pos + m_offset) / m_baseSize]
+    std::vector<Node*> m_nodes;
+    /// 第一个内存块前面已经丢弃的字节数
+    size_t m_offset;
+    /// 是否consume模式
+    bool m_consumeMode;
+    /// 读写映射的文件(只读映射时也会有，用来判断是否映射)
+    std::shared_ptr<MappedFile> m_mapFile;
 };
 
 }
@@ -1,5 +1,8 @@
 #include "config.h"
 #include "env.h"
+#include "iomanager.h"
+#include <sys/inotify.h>
+#include <limits.h>
 
 namespace sylar
 {
@@ -36,11 +39,66 @@ static void ListAllMember(const std::string& prefix,
     }
 }
 
+/**
+ * @brief   比较两棵YAML子树的内容是否一样，map按顺序比较
+ */
+static bool IsSameNode(const YAML::Node& a, const YAML::Node& b)
+{
+    if(a.Type() != b.Type())
+    {
+        return false;
+    }
+    switch(a.Type())
+    {
+        case YAML::NodeType::Scalar:
+            return a.Scalar() == b.Scalar();
+        case YAML::NodeType::Sequence:
+            if(a.size() != b.size())
+            {
+                return false;
+            }
+            for(size_t i = 0; i < a.size(); ++i)
+            {
+                if(!IsSameNode(a[i], b[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        case YAML::NodeType::Map:
+        {
+            if(a.size() != b.size())
+            {
+                return false;
+            }
+            for(auto ait = a.begin(), bit = b.begin(); ait != a.end(); ++ait, ++bit)
+            {
+                if(!IsSameNode(ait->first, bit->first)
+                        || !IsSameNode(ait->second, bit->second))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default:
+            return true;
+    }
+}
+
 void Config::LoadFromYaml(const YAML::Node& root)
+{
+    AppliedMap applied;
+    LoadFromYaml(root, applied);
+}
+
+size_t Config::LoadFromYaml(const YAML::Node& root, AppliedMap& applied)
 {
     std::list<std::pair<std::string, const YAML::Node> > all_nodes;
     ListAllMember("", root, all_nodes);     // 平铺所有配置项到 all_nodes 中
 
+    AppliedMap now_applied;
+    size_t count = 0;
     for(auto& i : all_nodes)    // 逐个更新配置
     {
         std::string key = i.first;
@@ -54,23 +112,78 @@ void Config::LoadFromYaml(const YAML::Node& root)
 
         if(var)
         {
+            // 子树和上次应用的一样、之后也没被改过，就不用再序列化、fromString了
+            auto it = applied.find(key);
+            if(it != applied.end() && it->second.version == var->getVersion()
+                    && IsSameNode(it->second.node, i.second))
+            {
+                now_applied.insert(*it);
+                continue;
+            }
+            ++count;
+            bool ok = false;
             if(i.second.IsScalar())
             {
-                var->fromString(i.second.Scalar());
+                ok = var->fromString(i.second.Scalar());
             }
             else
             {
                 std::stringstream ss;
                 ss << i.second;
-                var->fromString(ss.str());
+                ok = var->fromString(ss.str());
+            }
+            if(ok)
+            {
+                AppliedNode node;
+                node.node = i.second;
+                node.version = var->getVersion();
+                now_applied.insert(std::make_pair(key, node));
             }
         }
     }
+    applied.swap(now_applied);
+    return count;
 }
 
 static std::map<std::string, uint64_t> s_file2modifytime;
+/// 每个配置文件上次实际应用的内容
+static std::map<std::string, Config::AppliedMap> s_file2applied;
 static sylar::Mutex s_mutex;
 
+/**
+ * @brief   加载一个配置文件，和这个文件上次加载的内容比较，只更新有变化的配置项
+ *
+ * @param   force   不和上次的内容比较，更新所有配置项
+ */
+static void LoadConfFile(const std::string& file, bool force)
+{
+    Config::AppliedMap applied;
+    if(!force)
+    {
+        sylar::Mutex::Lock lk(s_mutex);
+        auto it = s_file2applied.find(file);
+        if(it != s_file2applied.end())
+        {
+            applied = it->second;
+        }
+    }
+
+    try
+    {
+        YAML::Node root = YAML::LoadFile(file);
+        size_t count = Config::LoadFromYaml(root, applied);
+        {
+            sylar::Mutex::Lock lk(s_mutex);
+            s_file2applied[file].swap(applied);
+        }
+        SYLAR_LOG_INFO(g_logger) << "LoadConfFile file=" << file << " ok changed=" << count;
+    }
+    catch(...)
+    {
+        SYLAR_LOG_ERROR(g_logger) << "LoadConfFile file=" << file << " failed";
+    }
+}
+
 void Config::LoadFromConfDir(const std::string& path, bool force)
 {
     std::string absoulte_path = sylar::EnvMgr::GetInstance()->getAbsolutePath(path);
@@ -91,17 +204,176 @@ void Config::LoadFromConfDir(const std::string& path, bool force)
             s_file2modifytime[i] = st.st_mtime;
         }
 
-        try
+        LoadConfFile(i, force);
+    }
+}
+
+namespace
+{
+
+/**
+ * @brief   配置目录的inotify监听
+ */
+struct ConfDirWatcher
+{
+    sylar::Mutex mutex;
+    int fd = -1;
+    /// 每次监听加1，fd号被复用时区分新旧监听
+    uint64_t gen = 0;
+    IOManager* iom = nullptr;
+    /// inotify的watch描述符对应的目录
+    std::map<int, std::string> dirs;
+
+    static ConfDirWatcher& Get()
+    {
+        static ConfDirWatcher s_watcher;
+        return s_watcher;
+    }
+
+    /**
+     * @brief   fd可读时调用：读出所有事件，重新加载变化的文件，再注册下一次读事件
+     */
+    static void OnEvent(int fd, uint64_t gen)
+    {
+        ConfDirWatcher& w = Get();
+        std::set<std::string> files;
         {
-            YAML::Node root = YAML::LoadFile(i);
-            LoadFromYaml(root);
-            SYLAR_LOG_INFO(g_logger) << "LoadConfFile file=" << i << " ok";
+            // 持锁读，UnwatchConfDir关闭fd之后不会读到复用了这个fd的别的文件
+            sylar::Mutex::Lock lk(w.mutex);
+            if(w.fd != fd || w.gen != gen)
+            {
+                return;
+            }
+            alignas(struct inotify_event) char buf[4096];
+            while(true)
+            {
+                ssize_t n = read(fd, buf, sizeof(buf));
+                if(n <= 0)
+                {
+                    break;
+                }
+                for(char* p = buf; p < buf + n; )
+                {
+                    struct inotify_event* ev = (struct inotify_event*)p;
+                    p += sizeof(struct inotify_event) + ev->len;
+                    if(!ev->len)
+                    {
+                        continue;
+                    }
+                    std::string name(ev->name);
+                    auto it = w.dirs.find(ev->wd);
+                    if(it == w.dirs.end() || name.size() < 4
+                            || name.compare(name.size() - 4, 4, ".yml") != 0)
+                    {
+                        continue;
+                    }
+                    files.insert(it->second + "/" + name);
+                }
+            }
         }
-        catch(...)
+
+        for(auto& i : files)
+        {
+            {
+                struct stat st;
+                if(lstat(i.c_str(), &st))
+                {
+                    continue;
+                }
+                sylar::Mutex::Lock lk(s_mutex);
+                s_file2modifytime[i] = st.st_mtime;
+            }
+            // 同一秒里改两次修改时间不变，这里不看修改时间，靠内容比较
+            LoadConfFile(i, false);
+        }
+
+        sylar::Mutex::Lock lk(w.mutex);
+        if(w.fd == fd && w.gen == gen)
+        {
+            w.iom->addEvent(fd, IOManager::READ, std::bind(&ConfDirWatcher::OnEvent, fd, gen));
+        }
+    }
+};
+
+}
+
+bool Config::WatchConfDir(const std::string& path, IOManager* iom)
+{
+    if(!iom)
+    {
+        iom = IOManager::GetThis();
+    }
+    if(!iom)
+    {
+        SYLAR_LOG_ERROR(g_logger) << "WatchConfDir path=" << path << " not in IOManager";
+        return false;
+    }
+
+    std::string absoulte_path = sylar::EnvMgr::GetInstance()->getAbsolutePath(path);
+    std::set<std::string> dirs;
+    dirs.insert(absoulte_path);
+    std::vector<std::string> files;
+    FSUtil::ListAllFile(files, absoulte_path, ".yml");
+    for(auto& i : files)
+    {
+        dirs.insert(i.substr(0, i.rfind('/')));
+    }
+
+    ConfDirWatcher& w = ConfDirWatcher::Get();
+    sylar::Mutex::Lock lk(w.mutex);
+    if(w.fd != -1)
+    {
+        SYLAR_LOG_ERROR(g_logger) << "WatchConfDir path=" << path << " already watching";
+        return false;
+    }
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(fd < 0)
+    {
+        SYLAR_LOG_ERROR(g_logger) << "inotify_init1 errno=" << errno
+            << " errstr=" << strerror(errno);
+        return false;
+    }
+    w.dirs.clear();
+    for(auto& i : dirs)
+    {
+        // 编辑器一般是写临时文件再rename过来，所以也要关注IN_MOVED_TO
+        int wd = inotify_add_watch(fd, i.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if(wd < 0)
         {
-            SYLAR_LOG_ERROR(g_logger) << "LoadConfFile file=" << i << " failed";
+            SYLAR_LOG_ERROR(g_logger) << "inotify_add_watch dir=" << i << " errno=" << errno
+                << " errstr=" << strerror(errno);
+            continue;
         }
+        w.dirs[wd] = i;
+    }
+    if(w.dirs.empty() || iom->addEvent(fd, IOManager::READ
+                , std::bind(&ConfDirWatcher::OnEvent, fd, w.gen + 1)))
+    {
+        close(fd);
+        w.dirs.clear();
+        return false;
+    }
+    w.fd = fd;
+    ++w.gen;
+    w.iom = iom;
+    SYLAR_LOG_INFO(g_logger) << "WatchConfDir path=" << absoulte_path << " dirs=" << w.dirs.size();
+    return true;
+}
+
+void Config::UnwatchConfDir()
+{
+    ConfDirWatcher& w = ConfDirWatcher::Get();
+    sylar::Mutex::Lock lk(w.mutex);
+    if(w.fd == -1)
+    {
+        return;
     }
+    // delEvent不触发回调，已经在调度队列里的回调看到fd变了会直接返回
+    w.iom->delEvent(w.fd, IOManager::READ);
+    close(w.fd);
+    w.fd = -1;
+    w.iom = nullptr;
+    w.dirs.clear();
 }
 
 void Config::Visit(std::function<void(ConfigVarBase::ptr)> cb)
@@ -11,6 +11,7 @@
 #include <boost/lexical_cast.hpp>
 #include <yaml-cpp/yaml.h>
 #include <memory>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <set>
@@ -23,6 +24,8 @@
 namespace sylar
 {
 
+class IOManager;
+
 /**
  * @brief   配置变量的基类
  */
@@ -34,6 +37,7 @@ public:
     ConfigVarBase(const std::string& name, const std::string& description = "")
         : m_name(name)
         , m_description(description)
+        , m_index(NextIndex())
     {
         std::transform(m_name.begin(), m_name.end(), m_name.begin(), ::tolower);    // 转小写
     }
@@ -47,9 +51,48 @@ public:
     virtual bool fromString(const std::string& val) = 0;
     virtual std::string getTypeName() const = 0;
 
+    /**
+     * @brief   值的版本号，每次修改加1
+     */
+    virtual uint64_t getVersion() const = 0;
+
+protected:
+    /**
+     * @brief   线程缓存的配置值快照
+     */
+    struct ThreadSlot
+    {
+        /// 缓存的是哪个版本，0表示还没缓存
+        uint64_t version = 0;
+        std::shared_ptr<const void> value;
+    };
+
+    /**
+     * @brief   当前线程里第index个配置变量的缓存
+     * @details 每个配置变量构造时分到一个下标，线程缓存是按下标访问的数组，不需要查表加锁
+     */
+    static ThreadSlot& GetThreadSlot(uint32_t index)
+    {
+        static thread_local std::vector<ThreadSlot> t_slots;
+        if(index >= t_slots.size())
+        {
+            t_slots.resize(index + 1);
+        }
+        return t_slots[index];
+    }
+
+private:
+    static uint32_t NextIndex()
+    {
+        static std::atomic<uint32_t> s_index(0);
+        return s_index++;
+    }
+
 protected:
     std::string m_name;
     std::string m_description;
+    /// 线程缓存的下标
+    uint32_t m_index;
 };
 
 /**
@@ -286,6 +329,9 @@ public:
 
 /**
  * @brief   配置参数模板子类，保存对应类型的参数值
+ * @details 值保存在shared_ptr<const T>里，修改时整个换掉(原子替换)，不在原地改；
+ *          getRef()读当前线程缓存的快照，只比较一次版本号，不加锁也不复制，
+ *          getValue()返回副本，snapshot()返回快照的shared_ptr
  *
  * @tparam T    具体的配置参数类型
  * @tparam FromStr  从 std::string 转换成 T 类型的仿函数
@@ -303,7 +349,7 @@ public:
 
     ConfigVar(const std::string& name, const T& default_value, const std::string& description = "")
         : ConfigVarBase(name, description)
-        , m_val(default_value)
+        , m_val(std::make_shared<T>(default_value))
     {}
 
 
@@ -314,8 +360,7 @@ public:
     {
         try
         {
-            RWMutexType::ReadLock lk(m_mutex);
-            return ToStr()(m_val);
+            return ToStr()(*snapshot());
         }
         catch(std::exception& e)
         {
@@ -334,6 +379,7 @@ public:
         try
         {
             setValue(FromStr()(val));
+            return true;
         }
         catch(std::exception& e)
         {
@@ -347,15 +393,41 @@ public:
 
     const T getValue()
     {
-        RWMutexType::ReadLock lk(m_mutex);
-        return m_val;
+        return getRef();
+    }
+
+    /**
+     * @brief   当前值的引用，不加锁不复制
+     * @details 引用的是当前线程缓存的快照，在本线程发现值变化(下一次调用getRef)之前有效，
+     *          不要跨线程、跨协程切换保存
+     */
+    const T& getRef()
+    {
+        ThreadSlot& slot = GetThreadSlot(m_index);
+        // 先读版本号再取值：setValue先换值再加版本号，读到新版本号就一定能取到新值
+        uint64_t version = m_version.load(std::memory_order_acquire);
+        if(slot.version != version)
+        {
+            slot.value = snapshot();
+            slot.version = version;
+        }
+        return *static_cast<const T*>(slot.value.get());
+    }
+
+    /**
+     * @brief   当前值的快照，之后的修改不影响它
+     */
+    std::shared_ptr<const T> snapshot() const
+    {
+        return std::atomic_load(&m_val);
     }
 
     void setValue(const T& v)
     {
         {
             RWMutexType::ReadLock lk(m_mutex);
-            if(v == m_val)
+            std::shared_ptr<const T> old = snapshot();
+            if(v == *old)
             {
                 return;
             }
@@ -363,11 +435,12 @@ public:
             // 遍历调用回调函数，通知参数变更
             for(auto& i : m_cbs)
             {
-                i.second(m_val, v);
+                i.second(*old, v);
             }
         }
         RWMutexType::WriteLock lk(m_mutex);
-        m_val = v;
+        std::atomic_store(&m_val, std::shared_ptr<const T>(std::make_shared<T>(v)));
+        m_version.fetch_add(1, std::memory_order_release);
     }
 
     std::string getTypeName() const override
@@ -375,6 +448,11 @@ public:
         return TypeToName<T>();
     }
 
+    uint64_t getVersion() const override
+    {
+        return m_version.load(std::memory_order_acquire);
+    }
+
     uint64_t addListener(on_change_cb cb)
     {
         static uint64_t s_fun_id = 0;
@@ -404,8 +482,11 @@ public:
     }
 
 private:
+    /// 保护回调函数，串行化修改
     RWMutexType m_mutex;
-    T m_val;
+    std::shared_ptr<const T> m_val;
+    /// 每次修改加1，从1开始，线程缓存的0表示还没缓存
+    std::atomic<uint64_t> m_version = {1};
     std::map<uint64_t, on_change_cb> m_cbs;
 };
 
@@ -459,7 +540,7 @@ public:
     static typename ConfigVar<T>::ptr Lookup(const std::string& name)
     {
         RWMutexType::ReadLock lk(GetMutex());
-        auto it = GetDatas().end();
+        auto it = GetDatas().find(name);
         if(it == GetDatas().end())
         {
             return nullptr;
@@ -467,15 +548,53 @@ public:
         return std::dynamic_pointer_cast<ConfigVar<T> >(it->second);
     }
 
+    /**
+     * @brief   已经应用到配置项上的YAML子树
+     */
+    struct AppliedNode
+    {
+        YAML::Node node;
+        /// 应用之后配置项的版本号，之后被setValue改过就不一样了
+        uint64_t version = 0;
+    };
+    /// 配置项名称 -> 上次应用的子树
+    typedef std::map<std::string, AppliedNode> AppliedMap;
+
     static void LoadFromYaml(const YAML::Node& root);
 
+    /**
+     * @brief   和上一次实际应用的内容比较，只更新YAML子树有变化的配置项
+     * @details 上次没应用上的(配置项还没注册、转换失败)和应用之后又被setValue改过的都会重新应用
+     *
+     * @param   applied 输入上一次应用的子树，输出这一次应用的子树
+     *
+     * @return  更新了几个配置项
+     */
+    static size_t LoadFromYaml(const YAML::Node& root, AppliedMap& applied);
+
     /**
      * @brief   从配置文件加载配置到缓存
+     * @details 修改时间变了的文件重新解析，和这个文件上次加载的内容比较，只更新有变化的配置项
      *
      * @param   path    相对路径
-     * @param   force   是否强制更新(不管配置文件是否有变化)，默认为 false
+     * @param   force   是否强制更新(不管配置文件是否有变化，更新所有配置项)，默认为 false
      */
     static void LoadFromConfDir(const std::string& path, bool force = false);
+
+    /**
+     * @brief   监听配置目录，有.yml文件写完或者移进来时只重新加载这个文件
+     * @details inotify的fd注册在iom上，不需要轮询目录；只监听目录和当时已经有配置文件的子目录。
+     *          同时只能监听一个目录，iom停止前要调用UnwatchConfDir，否则iom一直有事件停不下来
+     *
+     * @param   path    相对路径
+     * @param   iom     为nullptr时使用当前线程的IOManager
+     */
+    static bool WatchConfDir(const std::string& path, IOManager* iom = nullptr);
+
+    /**
+     * @brief   停止监听配置目录
+     */
+    static void UnwatchConfDir();
     
     static ConfigVarBase::ptr LookupBase(const std::string& name);
     
@@ -20,6 +20,18 @@ FdCtx::FdCtx(int fd)
     init();
 }
 
+FdCtx::FdCtx(int fd, uint64_t recv_timeout)
+    : m_isInit(true)
+    , m_isSocket(true)
+    , m_sysNonblock(true)
+    , m_userNonblock(false)
+    , m_isClosed(false)
+    , m_fd(fd)
+    , m_recvTimeout(recv_timeout)
+    , m_sendTimeout(-1)
+{
+}
+
 FdCtx::~FdCtx()
 {
 }
@@ -130,6 +142,23 @@ FdCtx::ptr FdManager::get(int fd, bool auto_create)
     return ctx;
 }
 
+FdCtx::ptr FdManager::addSocket(int fd, uint64_t recv_timeout)
+{
+    if(fd == -1)
+    {
+        return nullptr;
+    }
+
+    FdCtx::ptr ctx(new FdCtx(fd, recv_timeout));
+    RWMutexType::WriteLock lock(m_mutex);
+    if(fd >= (int)m_datas.size())
+    {
+        m_datas.resize(fd * 1.5);
+    }
+    m_datas[fd] = ctx;
+    return ctx;
+}
+
 void FdManager::del(int fd)
 {
     RWMutexType::WriteLock lk(m_mutex);
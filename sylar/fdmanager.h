@@ -25,6 +25,15 @@ public:
     typedef std::shared_ptr<FdCtx> ptr;
 
     FdCtx(int fd);
+
+    /**
+     * @brief   构造已知是非阻塞socket的上下文，不再fstat和fcntl
+     * @details 给accept4(SOCK_NONBLOCK)得到的连接用
+     *
+     * @param   fd          文件描述符
+     * @param   recv_timeout 读超时时间(毫秒)
+     */
+    FdCtx(int fd, uint64_t recv_timeout);
     ~FdCtx();
 
     bool isInit() const { return m_isInit; }
@@ -92,6 +101,16 @@ public:
      * @return  返回对应文件描述符类 FdCtx::ptr
      */
     FdCtx::ptr get(int fd, bool auto_create = false);
+
+    /**
+     * @brief   登记一个已经是非阻塞的socket(accept4得到的连接)
+     *
+     * @param   fd  文件描述符
+     * @param   recv_timeout 读超时时间(毫秒)
+     *
+     * @return  返回新建的 FdCtx::ptr
+     */
+    FdCtx::ptr addSocket(int fd, uint64_t recv_timeout = -1);
     void del(int fd);
 
 private:
@@ -91,6 +91,38 @@ uint64_t Fiber::GetFiberId()
     return 0;
 }
 
+Fiber::LocalMapPtr Fiber::GetLocals()
+{
+    return t_fiber ? t_fiber->m_locals : nullptr;
+}
+
+const std::string* Fiber::FindLocal(const std::string& key)
+{
+    if(!t_fiber || !t_fiber->m_locals)
+    {
+        return nullptr;
+    }
+    auto it = t_fiber->m_locals->find(key);
+    return it == t_fiber->m_locals->end() ? nullptr : &it->second;
+}
+
+void Fiber::SetLocal(const std::string& key, const std::string& val)
+{
+    Fiber::ptr cur = GetThis();
+    // 快照可能被子协程共享着，复制一份再改
+    std::shared_ptr<LocalMap> locals = cur->m_locals
+            ? std::make_shared<LocalMap>(*cur->m_locals) : std::make_shared<LocalMap>();
+    if(val.empty())
+    {
+        locals->erase(key);
+    }
+    else
+    {
+        (*locals)[key] = val;
+    }
+    cur->m_locals = locals->empty() ? nullptr : locals;
+}
+
 /**
  * @brief   协程执行函数，执行完成返回到线程的主协程
  */
@@ -187,9 +219,10 @@ Fiber::Fiber()
 Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool use_caller)
     : m_id(++s_fiber_id)
     , m_cb(cb)
+    , m_locals(GetLocals())
 {
     ++s_fiber_count;
-    m_stacksize = stacksize ? stacksize : g_fiber_stack_size->getValue();
+    m_stacksize = stacksize ? stacksize : g_fiber_stack_size->getRef();
 
     m_stack = StackAllocator::Alloc(m_stacksize);
     if(getcontext(&m_ctx))
@@ -242,6 +275,7 @@ Fiber::~Fiber()
 void Fiber::reset(std::function<void()> cb)
 {
     m_cb = cb;
+    m_locals = GetLocals();
     if(getcontext(&m_ctx))
     {
         SYLAR_ASSERT2(false, "getcontext");        
@@ -10,6 +10,8 @@
 
 #include <memory>
 #include <functional>
+#include <map>
+#include <string>
 #include <ucontext.h>
 
 namespace sylar
@@ -22,6 +24,9 @@ class Fiber : public std::enable_shared_from_this<Fiber>
 {
 public:
     typedef std::shared_ptr<Fiber> ptr;
+    /// 协程局部变量，创建后不再修改，修改时复制一份新的(写时复制)
+    typedef std::map<std::string, std::string> LocalMap;
+    typedef std::shared_ptr<const LocalMap> LocalMapPtr;
 
     // 协程运行状态
     enum State
@@ -51,6 +56,14 @@ public:
     void setState(State s) { m_state = s; }
     State getState() const { return m_state; }
 
+    /**
+     * @brief   协程局部变量
+     * @details 新建的协程(包括Scheduler::schedule(cb)时所在的协程)继承创建者的局部变量，
+     *          继承只是共享同一份快照，之后任何一方修改都不影响另一方
+     */
+    const LocalMapPtr& getLocals() const { return m_locals; }
+    void setLocals(const LocalMapPtr& v) { m_locals = v; }
+
 public:
     static void SetThis(Fiber* f);
     static Fiber::ptr GetThis();
@@ -61,6 +74,23 @@ public:
     static uint64_t TotalFibers();
     static uint64_t GetFiberId();
 
+    /**
+     * @brief   当前协程的局部变量快照，不在协程里返回nullptr
+     */
+    static LocalMapPtr GetLocals();
+
+    /**
+     * @brief   查找当前协程的局部变量
+     *
+     * @return  没有返回nullptr，指针在当前协程修改局部变量之前有效
+     */
+    static const std::string* FindLocal(const std::string& key);
+
+    /**
+     * @brief   设置当前协程的局部变量，val为空表示删除
+     */
+    static void SetLocal(const std::string& key, const std::string& val);
+
     static void MainFunc();
     static void CallerMainFunc();
 
@@ -77,6 +107,8 @@ private:
     void* m_stack = nullptr;
     /// 协程运行函数
     std::function<void()> m_cb;
+    /// 协程局部变量
+    LocalMapPtr m_locals;
 };
 
 }
@@ -1,5 +1,6 @@
 #include "http.h"
 #include "sylar/util.h"
+#include "sylar/config.h"
 
 namespace sylar
 {
@@ -7,6 +8,9 @@ namespace sylar
 namespace http
 {
 
+static sylar::ConfigVar<std::string>::ptr g_http_trace_header =
+    sylar::Config::Lookup("http.trace_header", std::string("X-Request-Id"), "http trace id header");
+
 HttpMethod StringToHttpMethod(const std::string& m)
 {
 #define XX(num, name, string) \
@@ -63,6 +67,11 @@ const char* HttpStatusTostring(const HttpStatus& s)
     }
 }
 
+const std::string& GetTraceHeader()
+{
+    return g_http_trace_header->getRef();
+}
+
 bool CaseInsensitiveLess::operator()(const std::string& lhs, const std::string& rhs) const
 {
     return strcasecmp(lhs.c_str(), rhs.c_str()) < 0;
@@ -105,6 +114,17 @@ std::string HttpRequest::getCookie(const std::string& key, const std::string& de
     return it == m_cookies.end() ? def : it->second;
 }
 
+std::string HttpRequest::getRouteParam(const std::string& key, const std::string& def) const
+{
+    auto it = m_routeParams.find(key);
+    return it == m_routeParams.end() ? def : it->second;
+}
+
+void HttpRequest::setRouteParam(const std::string& key, const std::string& val)
+{
+    m_routeParams[key] = val;
+}
+
 void HttpRequest::setHeader(const std::string& key, const std::string& val)
 {
     m_headers[key] = val;
@@ -347,6 +367,10 @@ void HttpResponse::delHeader(const std::string& key)
 
 std::ostream& HttpResponse::dump(std::ostream& os) const
 {
+    if(m_rawData)
+    {
+        return os << *m_rawData;
+    }
     os << "HTTP/"
        << ((uint32_t)(m_version >> 4))
        << "."
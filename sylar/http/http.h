@@ -170,6 +170,11 @@ const char* HttpMethodToString(const HttpMethod& m);
  */
 const char* HttpStatusTostring(const HttpStatus& s);
 
+/**
+ * @brief   传递trace id用的头部名称，配置 http.trace_header
+ */
+const std::string& GetTraceHeader();
+
 /**
  * @brief   忽略大小写比较的仿函数
  */
@@ -251,6 +256,7 @@ public:
     const MapType& getHeaders() const { return m_headers; }
     const MapType& getParams() const { return m_params; }
     const MapType& getCookies() const { return m_cookies; }
+    const MapType& getRouteParams() const { return m_routeParams; }
 
     void setMethod(HttpMethod v) { m_method = v; }
     void setVersion(uint8_t v) { m_version = v; }
@@ -267,10 +273,18 @@ public:
     void setHeaders(const MapType& v) { m_headers = v; }
     void setParams(const MapType& v) { m_params = v; }
     void setCookies(const MapType& v) { m_cookies = v; }
+    void setRouteParams(const MapType& v) { m_routeParams = v; }
     
     std::string getHeader(const std::string& key, const std::string& def = "") const;
     std::string getParam(const std::string& key, const std::string& def = "");
     std::string getCookie(const std::string& key, const std::string& def = "");
+
+    /**
+     * @brief   获取路由参数，如路由 /user/:id 匹配 /user/12 得到 id=12，
+     *          尾部通配 * 匹配到的剩余路径以 "*" 为key
+     */
+    std::string getRouteParam(const std::string& key, const std::string& def = "") const;
+    void setRouteParam(const std::string& key, const std::string& val);
     
     void setHeader(const std::string& key, const std::string& val);
     void setParam(const std::string& key, const std::string& val);
@@ -312,6 +326,12 @@ public:
         return getAs(m_params, key, def);
     }
     
+    template<class T>
+    T getRouteParamAs(const std::string& key, const T& def = T())
+    {
+        return getAs(m_routeParams, key, def);
+    }
+
     template<class T>
     bool checkGetCookieAs(const std::string& key, T& val, const T& def = T())
     {
@@ -360,6 +380,8 @@ private:
     MapType m_params;
     /// 请求cookie map
     MapType m_cookies;
+    /// 路由参数map
+    MapType m_routeParams;
 };
 
 /**
@@ -411,6 +433,14 @@ public:
         return getAs(m_headers, key, def);
     }
 
+    /**
+     * @brief   预先序列化好的完整响应报文
+     * @details 非空时dump和HttpSession::sendResponse直接输出它，忽略其他字段
+     */
+    std::shared_ptr<const std::string> getRawData() const { return m_rawData; }
+    void setRawData(std::shared_ptr<const std::string> v) { m_rawData = v; }
+    const std::vector<std::string>& getCookies() const { return m_cookies; }
+
     std::ostream& dump(std::ostream& os) const;
     std::string toString() const;
 
@@ -437,6 +467,8 @@ private:
     MapType m_headers;
     /// 响应cookie 
     std::vector<std::string> m_cookies;
+    /// 预先序列化好的响应报文
+    std::shared_ptr<const std::string> m_rawData;
 };
 
 std::ostream& operator<<(std::ostream& os, const HttpRequest& req);
@@ -0,0 +1,238 @@
+#include "http_compress.h"
+#include "sylar/config.h"
+#include "sylar/log.h"
+#include "sylar/util.h"
+#include <set>
+
+namespace sylar
+{
+
+namespace http
+{
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<bool>::ptr g_http_compress_enable =
+    sylar::Config::Lookup("http.compress.enable", true, "http response compress enable");
+
+static sylar::ConfigVar<uint64_t>::ptr g_http_compress_min_size =
+    sylar::Config::Lookup("http.compress.min_size", (uint64_t)1024, "http response compress min body size");
+
+static sylar::ConfigVar<int32_t>::ptr g_http_compress_level =
+    sylar::Config::Lookup("http.compress.level", (int32_t)6, "http response compress level(1-9)");
+
+static sylar::ConfigVar<std::set<std::string> >::ptr g_http_compress_mime_types =
+    sylar::Config::Lookup("http.compress.mime_types"
+            , std::set<std::string>{"text/html", "text/plain", "text/css", "text/xml"
+                , "text/javascript", "application/json", "application/javascript"
+                , "application/xml"}
+            , "http response compress mime types");
+
+namespace
+{
+/**
+ * @brief   gzip/deflate两个压缩流池，压缩等级变化时整体替换
+ */
+struct CompressPools
+{
+    typedef Spinlock MutexType;
+
+    CompressPools()
+    {
+        reset(g_http_compress_level->getValue());
+        g_http_compress_level->addListener(
+                [this](const int32_t& ov, const int32_t& nv){
+                reset(nv);
+        });
+    }
+
+    void reset(int32_t level)
+    {
+        if(level < 1 || level > 9)
+        {
+            SYLAR_LOG_ERROR(g_logger) << "invalid http.compress.level=" << level
+                << ", use default";
+            level = ZlibStream::DEFAULT_COMPRESSION;
+        }
+        auto gzip = std::make_shared<ZlibStreamPool>(true, ZlibStream::GZIP, level);
+        // http的deflate编码实际上是zlib格式(RFC 1950)
+        auto deflate = std::make_shared<ZlibStreamPool>(true, ZlibStream::ZLIB, level);
+        MutexType::Lock lk(mutex);
+        gzipPool = gzip;
+        deflatePool = deflate;
+        compressLevel = level;
+    }
+
+    ZlibStream::ptr get(const std::string& encoding)
+    {
+        ZlibStreamPool::ptr pool;
+        {
+            MutexType::Lock lk(mutex);
+            pool = encoding == "gzip" ? gzipPool : deflatePool;
+        }
+        return pool->get();
+    }
+
+    int getLevel()
+    {
+        MutexType::Lock lk(mutex);
+        return compressLevel;
+    }
+
+    MutexType mutex;
+    ZlibStreamPool::ptr gzipPool;
+    ZlibStreamPool::ptr deflatePool;
+    int compressLevel = ZlibStream::DEFAULT_COMPRESSION;
+};
+
+static CompressPools& GetPools()
+{
+    static CompressPools s_pools;
+    return s_pools;
+}
+
+/**
+ * @brief   Content-Type是否在白名单里(忽略;后面的参数)
+ */
+static bool IsCompressibleType(const std::string& content_type)
+{
+    if(content_type.empty())
+    {
+        return false;
+    }
+    std::string mime = sylar::StringUtil::Trim(content_type.substr(0, content_type.find(';')));
+    std::transform(mime.begin(), mime.end(), mime.begin(), ::tolower);
+    return g_http_compress_mime_types->getRef().count(mime) > 0;
+}
+}
+
+std::string NegotiateContentEncoding(HttpRequest::ptr req)
+{
+    std::string accept = req->getHeader("accept-encoding");
+    if(accept.empty())
+    {
+        return "";
+    }
+
+    // Accept-Encoding: gzip;q=1.0, deflate;q=0.5, *;q=0
+    float gzip_q = -1;
+    float deflate_q = -1;
+    float any_q = -1;
+    size_t pos = 0;
+    while(pos < accept.size())
+    {
+        size_t end = accept.find(',', pos);
+        if(end == std::string::npos)
+        {
+            end = accept.size();
+        }
+        std::string item = accept.substr(pos, end - pos);
+        pos = end + 1;
+
+        float q = 1;
+        size_t semi = item.find(';');
+        if(semi != std::string::npos)
+        {
+            size_t qpos = item.find("q=", semi);
+            if(qpos != std::string::npos)
+            {
+                q = atof(item.c_str() + qpos + 2);
+            }
+            item.resize(semi);
+        }
+        item = sylar::StringUtil::Trim(item);
+        if(strcasecmp(item.c_str(), "gzip") == 0)
+        {
+            gzip_q = q;
+        }
+        else if(strcasecmp(item.c_str(), "deflate") == 0)
+        {
+            deflate_q = q;
+        }
+        else if(item == "*")
+        {
+            any_q = q;
+        }
+    }
+    if(gzip_q < 0)
+    {
+        gzip_q = any_q;
+    }
+    if(deflate_q < 0)
+    {
+        deflate_q = any_q;
+    }
+
+    // 权重相同时优先gzip
+    if(gzip_q > 0 && gzip_q >= deflate_q)
+    {
+        return "gzip";
+    }
+    if(deflate_q > 0)
+    {
+        return "deflate";
+    }
+    return "";
+}
+
+/**
+ * @brief   响应要用的压缩格式，不压缩返回空串
+ */
+static std::string GetResponseEncoding(HttpRequest::ptr req, HttpResponse::ptr rsp)
+{
+    if(!g_http_compress_enable->getValue() || rsp->getRawData()
+            || !rsp->getHeader("content-encoding").empty()
+            || !IsCompressibleType(rsp->getHeader("content-type")))
+    {
+        return "";
+    }
+    return NegotiateContentEncoding(req);
+}
+
+ZlibStream::ptr CreateResponseEncoder(HttpRequest::ptr req, HttpResponse::ptr rsp)
+{
+    std::string encoding = GetResponseEncoding(req, rsp);
+    if(encoding.empty())
+    {
+        return nullptr;
+    }
+    ZlibStream::ptr zs = GetPools().get(encoding);
+    if(!zs)
+    {
+        return nullptr;
+    }
+    rsp->setHeader("Content-Encoding", encoding);
+    rsp->setHeader("Vary", "Accept-Encoding");
+    return zs;
+}
+
+bool CompressResponse(HttpRequest::ptr req, HttpResponse::ptr rsp)
+{
+    const std::string& body = rsp->getBody();
+    if(body.size() < g_http_compress_min_size->getValue())
+    {
+        return false;
+    }
+    std::string encoding = GetResponseEncoding(req, rsp);
+    if(encoding.empty())
+    {
+        return false;
+    }
+    // 消息体是完整的，一次压完，输出只分配一次
+    std::string out;
+    if(ZlibStream::Compress(body.c_str(), body.size(), out
+                , encoding == "gzip" ? ZlibStream::GZIP : ZlibStream::ZLIB
+                , GetPools().getLevel()) != Z_OK)
+    {
+        SYLAR_LOG_ERROR(g_logger) << "compress response fail, path=" << req->getPath();
+        return false;
+    }
+    rsp->setHeader("Content-Encoding", encoding);
+    rsp->setHeader("Vary", "Accept-Encoding");
+    rsp->setBody(out);
+    return true;
+}
+
+}
+
+}
@@ -0,0 +1,48 @@
+/**
+ * @filename    http_compress.h
+ * @brief   http响应压缩
+ * @author  L-ge
+ * @version 0.1
+ * @modify  2022-07-24
+ */
+#ifndef __SYLAR_HTTP_COMPRESS_H__
+#define __SYLAR_HTTP_COMPRESS_H__
+
+#include "http.h"
+#include "sylar/streams/zlib_stream.h"
+
+namespace sylar
+{
+
+namespace http
+{
+
+/**
+ * @brief   根据请求的Accept-Encoding协商响应的压缩格式
+ *
+ * @return  "gzip" 或 "deflate"，不压缩返回空串
+ */
+std::string NegotiateContentEncoding(HttpRequest::ptr req);
+
+/**
+ * @brief   取一个与协商结果对应的压缩流(池化)，并设置响应的Content-Encoding/Vary头部
+ * @details 给分段生成消息体的Servlet用: 每生成一段就write进去，
+ *          最后flush()，用getResult()设置响应的消息体
+ *
+ * @return  不需要压缩返回nullptr
+ */
+ZlibStream::ptr CreateResponseEncoder(HttpRequest::ptr req, HttpResponse::ptr rsp);
+
+/**
+ * @brief   按配置(http.compress.*)压缩响应消息体
+ * @details 已有Content-Encoding、已序列化好的、类型不在白名单中或小于min_size的响应不压缩
+ *
+ * @return  是否做了压缩
+ */
+bool CompressResponse(HttpRequest::ptr req, HttpResponse::ptr rsp);
+
+}
+
+}
+
+#endif
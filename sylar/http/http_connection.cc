@@ -182,108 +182,114 @@ HttpConnection::~HttpConnection()
     SYLAR_LOG_DEBUG(g_logger) << "HttpConnection::~HttpConnection";
 }
 
+int HttpConnection::fillBuffer()
+{
+    if(!m_buffer)
+    {
+        uint64_t buff_size = HttpResponseParser::GetHttpResponseBufferSize();
+        m_buffer = std::make_shared<HttpParseBuffer>(
+                std::min(buff_size, (uint64_t)1024), buff_size);
+    }
+    if(!m_buffer->reserve())
+    {
+        return 0;
+    }
+    int len = read(m_buffer->writeBegin(), m_buffer->writable());
+    if(len > 0)
+    {
+        m_buffer->commit(len);
+    }
+    return len;
+}
+
+bool HttpConnection::readBody(std::string& body, size_t len)
+{
+    size_t old_size = body.size();
+    body.resize(old_size + len);
+    // 先取缓存中已经读到的部分，剩下的直接读进body，不经过缓存
+    size_t have = m_buffer ? std::min(len, m_buffer->size()) : 0;
+    if(have > 0)
+    {
+        memcpy(&body[old_size], m_buffer->begin(), have);
+        m_buffer->consume(have);
+    }
+    if(len > have)
+    {
+        if(readFixSize(&body[old_size + have], len - have) <= 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 HttpResponse::ptr HttpConnection::recvResponse() 
 {
     HttpResponseParser::ptr parser(new HttpResponseParser);
-    uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();
-    std::shared_ptr<char> buffer(new char[buff_size + 1], [](char* ptr){
-                                 delete[] ptr;
-                                });
-    char* data = buffer.get();
-    int offset = 0;
     // 和 HttpSession::recvRequest() 处的用法是类似的，可以看那里的注释
     do
     {
-        int len = read(data + offset, buff_size - offset);
-        if(len <= 0) 
-        {
-            close();
-            return nullptr;
-        }
-        len += offset;
-        data[len] = '\0';   // 是ragel那里解析要求的
-        size_t nparse = parser->execute(data, len, false);
-        if(parser->hasError()) 
+        if(m_buffer && m_buffer->size() > parser->getOffset())
         {
-            close();
-            return nullptr;
+            parser->resume(m_buffer->begin(), m_buffer->size());
+            if(parser->hasError())
+            {
+                close();
+                return nullptr;
+            }
+            if(parser->isFinished())
+            {
+                break;
+            }
         }
-        offset = len - nparse;
-        if(offset == (int)buff_size) 
+        if(fillBuffer() <= 0)
         {
             close();
             return nullptr;
         }
-        if(parser->isFinished()) 
-        {
-            break;
-        }
     } while(true);
+    m_buffer->consume(parser->getOffset());
     
     auto& client_parser = parser->getParser();
     std::string body;
     // 下面是分块的时候的解析
     if(client_parser.chunked) 
     {
-        int len = offset;
         do 
         {
-            bool begin = true;
+            // 每个chunk头部重新从缓存起始处解析
+            parser->resetChunk();
             do
             {
-                if(!begin || len == 0) 
+                if(m_buffer->size() > parser->getOffset())
                 {
-                    int rt = read(data + len, buff_size - len);
-                    if(rt <= 0)
+                    parser->resume(m_buffer->begin(), m_buffer->size());
+                    if(parser->hasError())
                     {
                         close();
                         return nullptr;
                     }
-                    len += rt;
-                }
-                data[len] = '\0';
-                size_t nparse = parser->execute(data, len, true);
-                if(parser->hasError())
-                {
-                    close();
-                    return nullptr;
+                    if(parser->isFinished())
+                    {
+                        break;
+                    }
                 }
-                len -= nparse;
-                if(len == (int)buff_size) 
+                if(fillBuffer() <= 0)
                 {
                     close();
                     return nullptr;
                 }
-                begin = false;
-            } while(!parser->isFinished());
-            //len -= 2;
+            } while(true);
+            m_buffer->consume(parser->getOffset());
             
             SYLAR_LOG_DEBUG(g_logger) << "content_len=" << client_parser.content_len;
-            if(client_parser.content_len + 2 <= len) 
+            // chunk数据后面还跟着\r\n
+            if(!readBody(body, client_parser.content_len + 2))
             {
-                body.append(data, client_parser.content_len);
-                memmove(data, data + client_parser.content_len + 2
-                        , len - client_parser.content_len - 2);
-                len -= client_parser.content_len + 2;
-            }
-            else 
-            {
-                body.append(data, len);
-                int left = client_parser.content_len - len + 2;
-                while(left > 0) 
-                {
-                    int rt = read(data, left > (int)buff_size ? (int)buff_size : left);
-                    if(rt <= 0) 
-                    {
-                        close();
-                        return nullptr;
-                    }
-                    body.append(data, rt);
-                    left -= rt;
-                }
-                body.resize(body.size() - 2);
-                len = 0;
+                close();
+                return nullptr;
             }
+            body.resize(body.size() - 2);
         } while(!client_parser.chunks_done);
     }
     else
@@ -291,27 +297,10 @@ HttpResponse::ptr HttpConnection::recvResponse()
         int64_t length = parser->getContentLength();
         if(length > 0) 
         {
-            body.resize(length);
-
-            int len = 0;
-            if(length >= offset) 
-            {
-                memcpy(&body[0], data, offset);
-                len = offset;
-            }
-            else
+            if(!readBody(body, length))
             {
-                memcpy(&body[0], data, length);
-                len = length;
-            }
-            length -= offset;
-            if(length > 0)
-            {
-                if(readFixSize(&body[len], length) <= 0) 
-                {
-                    close();
-                    return nullptr;
-                }
+                close();
+                return nullptr;
             }
         }
     }
@@ -345,6 +334,16 @@ HttpResponse::ptr HttpConnection::recvResponse()
 
 int HttpConnection::sendRequest(HttpRequest::ptr rsp) 
 {
+    // 把当前协程的trace id传给下游，调用方自己设置了的不覆盖
+    std::string trace_id = sylar::GetTraceId();
+    if(!trace_id.empty())
+    {
+        const std::string& trace_header = GetTraceHeader();
+        if(!rsp->hasHeader(trace_header))
+        {
+            rsp->setHeader(trace_header, trace_id);
+        }
+    }
     std::stringstream ss;
     ss << *rsp;
     std::string data = ss.str();
@@ -11,6 +11,7 @@
 #include <list>
 #include "sylar/streams/socket_stream.h"
 #include "http.h"
+#include "http_parser.h"
 #include "sylar/uri.h"
 #include "sylar/mutex.h"
 
@@ -157,6 +158,23 @@ public:
     int sendRequest(HttpRequest::ptr req);
 
 private:
+    /**
+     * @brief   从socket读数据追加到m_buffer
+     *
+     * @return  >0 读到的长度
+     *          =0 对方关闭或缓存已满
+     *          <0 Socket异常
+     */
+    int fillBuffer();
+
+    /**
+     * @brief   从m_buffer和socket中读取len个字节追加到body
+     */
+    bool readBody(std::string& body, size_t len);
+
+private:
+    /// 接收缓存，连接复用时多余的数据留给下一个响应
+    HttpParseBuffer::ptr m_buffer;
     uint64_t m_createTime = 0;
     uint64_t m_request = 0;
 };
@@ -137,8 +137,65 @@ void on_request_http_field(void* data, const char* field, size_t flen, const cha
     parser->getData()->setHeader(std::string(field, flen), std::string(value, vlen));
 }
 
+HttpParseBuffer::HttpParseBuffer(size_t init_size, size_t max_size)
+    : m_rpos(0)
+    , m_wpos(0)
+    , m_maxSize(max_size)
+{
+    if(init_size > max_size)
+    {
+        init_size = max_size;
+    }
+    m_buffer.resize(init_size + 1);
+    m_buffer[0] = '\0';
+}
+
+void HttpParseBuffer::commit(size_t len)
+{
+    m_wpos += len;
+    m_buffer[m_wpos] = '\0';
+}
+
+void HttpParseBuffer::consume(size_t len)
+{
+    m_rpos += len;
+    if(m_rpos >= m_wpos)
+    {
+        // 全部消费完了，直接回到头部，省掉以后的compact
+        m_rpos = m_wpos = 0;
+        m_buffer[0] = '\0';
+    }
+}
+
+bool HttpParseBuffer::reserve()
+{
+    if(writable() > 0)
+    {
+        return true;
+    }
+    if(m_rpos > 0)
+    {
+        // 头部有已消费的空间，先把未消费的数据搬过去
+        size_t len = size();
+        memmove(&m_buffer[0], &m_buffer[m_rpos], len);
+        m_rpos = 0;
+        m_wpos = len;
+        m_buffer[m_wpos] = '\0';
+        return true;
+    }
+    size_t cap = capacity();
+    if(cap >= m_maxSize)
+    {
+        return false;
+    }
+    cap = cap * 2 > m_maxSize ? m_maxSize : cap * 2;
+    m_buffer.resize(cap + 1);
+    return true;
+}
+
 HttpRequestParser::HttpRequestParser()
-    : m_error(0)
+    : m_offset(0)
+    , m_error(0)
 {
     m_data.reset(new sylar::http::HttpRequest);
     
@@ -169,6 +226,18 @@ size_t HttpRequestParser::execute(char* data, size_t len)
     return offset;
 }
 
+size_t HttpRequestParser::resume(const char* data, size_t len)
+{
+    if(m_offset >= len)
+    {
+        return 0;
+    }
+    // off>0时ragel会保留mark等位置，跨多次调用的字段也能正确解析
+    size_t nparse = http_parser_execute(&m_parser, data, len, m_offset);
+    m_offset += nparse;
+    return nparse;
+}
+
 int HttpRequestParser::isFinished()
 {
     return http_parser_finish(&m_parser);
@@ -253,7 +322,8 @@ void on_response_http_field(void* data, const char* field, size_t flen, const ch
 }
 
 HttpResponseParser::HttpResponseParser()
-    : m_error(0)
+    : m_offset(0)
+    , m_error(0)
 {
     m_data.reset(new sylar::http::HttpResponse);
     
@@ -280,6 +350,28 @@ size_t HttpResponseParser::execute(char* data, size_t len, bool chunck)
     return offset;
 }
 
+size_t HttpResponseParser::resume(const char* data, size_t len)
+{
+    if(m_offset >= len)
+    {
+        return 0;
+    }
+    int nparse = httpclient_parser_execute(&m_parser, data, len, m_offset);
+    if(nparse < 0)
+    {
+        setError(1002);
+        return 0;
+    }
+    m_offset += nparse;
+    return nparse;
+}
+
+void HttpResponseParser::resetChunk()
+{
+    httpclient_parser_init(&m_parser);
+    m_offset = 0;
+}
+
 int HttpResponseParser::isFinished()
 {
     return httpclient_parser_finish(&m_parser);
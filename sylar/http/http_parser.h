@@ -8,6 +8,7 @@
 #ifndef __SYLAR_HTTP_PARSER_H__
 #define __SYLAR_HTTP_PARSER_H__
 
+#include <vector>
 #include "http.h"
 #include "http11_parser.h"
 #include "httpclient_parser.h"
@@ -18,6 +19,76 @@ namespace sylar
 namespace http
 {
 
+/**
+ * @brief   协议解析用的可增长缓存
+ * @details 新数据总是追加在尾部，已消费的数据只是移动读指针，不做搬移。
+ *          只有在尾部空间不够时，才把未消费的数据搬到头部(compact)，
+ *          搬完仍然不够才扩容，最大不超过max_size。
+ *          解析器记录的偏移量都是相对begin()的，compact和扩容都不会改变它们。
+ *          尾部始终多留一个字节并写'\0'，满足ragel解析的要求。
+ */
+class HttpParseBuffer
+{
+public:
+    typedef std::shared_ptr<HttpParseBuffer> ptr;
+
+    /**
+     * @brief   构造函数
+     *
+     * @param   init_size   初始容量
+     * @param   max_size    最大容量
+     */
+    HttpParseBuffer(size_t init_size, size_t max_size);
+
+    /**
+     * @brief   未消费数据的起始地址
+     */
+    char* begin() { return &m_buffer[m_rpos]; }
+
+    /**
+     * @brief   未消费数据的长度
+     */
+    size_t size() const { return m_wpos - m_rpos; }
+
+    /**
+     * @brief   可写入位置
+     */
+    char* writeBegin() { return &m_buffer[m_wpos]; }
+
+    /**
+     * @brief   尾部可写入的长度
+     */
+    size_t writable() const { return m_buffer.size() - 1 - m_wpos; }
+
+    /**
+     * @brief   确认写入了len个字节
+     */
+    void commit(size_t len);
+
+    /**
+     * @brief   消费(丢弃)头部len个字节，只移动读指针
+     */
+    void consume(size_t len);
+
+    /**
+     * @brief   保证尾部至少还有1个字节可写，必要时compact或扩容
+     *
+     * @return  已达最大容量且缓存已满返回false
+     */
+    bool reserve();
+
+    size_t capacity() const { return m_buffer.size() - 1; }
+    size_t getMaxSize() const { return m_maxSize; }
+private:
+    std::vector<char> m_buffer;
+    /// 读位置
+    size_t m_rpos;
+    /// 写位置
+    size_t m_wpos;
+    /// 最大容量
+    size_t m_maxSize;
+};
+
 /**
  * @brief   http请求解析类
  */
@@ -37,6 +108,21 @@ public:
      * @return  返回实际解析的长度，并且将已解析的数据移除
      */
     size_t execute(char* data, size_t len);
+
+    /**
+     * @brief   增量解析协议，从上次停止的位置继续，不搬移数据
+     *
+     * @param   data    协议文本缓存，两次调用之间已传入的数据位置不能改变
+     * @param   len     缓存中的数据总长度(包括之前已经解析过的)
+     *
+     * @return  本次新解析的长度
+     */
+    size_t resume(const char* data, size_t len);
+
+    /**
+     * @brief   已经解析到的位置(相对data起始)
+     */
+    size_t getOffset() const { return m_offset; }
     
     /**
      * @brief   是否解析完成
@@ -67,6 +153,8 @@ public:
 private:
     http_parser m_parser;
     HttpRequest::ptr m_data;
+    /// resume模式下已解析的位置
+    size_t m_offset;
     /// 错误码
     /// 1000: invalid method
     /// 1001: invalid version
@@ -97,6 +185,26 @@ public:
      * @return  返回实际解析的长度，并且移除已解析的数据
      */
     size_t execute(char* data, size_t len, bool chunck);
+
+    /**
+     * @brief   增量解析http响应协议，从上次停止的位置继续，不搬移数据
+     *
+     * @param   data    协议数据缓存，data[len]必须为'\0'(ragel的要求)
+     * @param   len     缓存中的数据总长度(包括之前已经解析过的)
+     *
+     * @return  本次新解析的长度
+     */
+    size_t resume(const char* data, size_t len);
+
+    /**
+     * @brief   开始解析下一个chunk头部，解析位置归零
+     */
+    void resetChunk();
+
+    /**
+     * @brief   已经解析到的位置(相对data起始)
+     */
+    size_t getOffset() const { return m_offset; }
     int isFinished();
     int hasError();
     HttpResponse::ptr getData() const { return m_data; }
@@ -111,6 +219,8 @@ public:
 private:
     httpclient_parser m_parser;
     HttpResponse::ptr m_data;
+    /// resume模式下已解析的位置
+    size_t m_offset;
     /// 错误码
     /// 1001: invalid version
     /// 1002: invalid field
@@ -1,5 +1,7 @@
 #include "http_server.h"
+#include "http_compress.h"
 #include "sylar/log.h"
+#include <random>
 //#include "sylar/http/servlets/config_servlet.h"
 //#include "sylar/http/servlets/status_servlet.h"
 
@@ -25,6 +27,17 @@ HttpServer::HttpServer(bool keepalive
     //m_dispatch->addServlet("/_/config", Servlet::ptr(new ConfigServlet));
 }
 
+/**
+ * @brief   请求没带trace id时生成一个，16位十六进制随机数
+ */
+static std::string NewTraceId()
+{
+    static thread_local std::mt19937_64 s_rand(std::random_device{}());
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)s_rand());
+    return std::string(buf, 16);
+}
+
 void HttpServer::setName(const std::string& v)
 {
     TcpServer::setName(v);
@@ -35,21 +48,32 @@ void HttpServer::handleClient(Socket::ptr client)
 {
     SYLAR_LOG_DEBUG(g_logger) << "handleClient " << *client;
     HttpSession::ptr session(new HttpSession(client));
+    std::string trace_header = GetTraceHeader();
     do
     {
         auto req = session->recvRequest();
         if(!req)
         {
-            SYLAR_LOG_DEBUG(g_logger) << "recv http request fail, errno="
+            SYLAR_LOG_DEBUG_LIMIT(g_logger, 100) << "recv http request fail, errno="
                 << errno << " errstr=" << strerror(errno)
                 << " client:" << *client << " keep_alive=" << m_isKeepalive;
             break;
         }
 
+        // trace id放在协程局部变量里，处理请求时的日志(%R)和发出的http请求都会带上
+        std::string trace_id = req->getHeader(trace_header);
+        if(trace_id.empty())
+        {
+            trace_id = NewTraceId();
+        }
+        sylar::SetTraceId(trace_id);
+
         HttpResponse::ptr rsp(new HttpResponse(req->getVersion()
                     , req->isClose() || !m_isKeepalive));
         rsp->setHeader("Server", getName());
+        rsp->setHeader(trace_header, trace_id);
         m_dispatch->handle(req, rsp, session);  // 交给ServletDispatch处理
+        CompressResponse(req, rsp);             // 按Accept-Encoding压缩消息体
         session->sendResponse(rsp);
 
         if(!m_isKeepalive || req->isClose())
@@ -58,6 +82,7 @@ void HttpServer::handleClient(Socket::ptr client)
         }
     } while(true);
 
+    sylar::SetTraceId("");
     session->close();
 }
 
@@ -12,60 +12,68 @@ HttpSession::HttpSession(Socket::ptr sock, bool owner)
 {
 }
 
+int HttpSession::fillBuffer()
+{
+    if(!m_buffer)
+    {
+        uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();
+        m_buffer = std::make_shared<HttpParseBuffer>(
+                std::min(buff_size, (uint64_t)1024), buff_size);
+    }
+    if(!m_buffer->reserve())
+    {
+        // 缓存满了还没解析完，请求头过大
+        return 0;
+    }
+    int len = read(m_buffer->writeBegin(), m_buffer->writable());
+    if(len > 0)
+    {
+        m_buffer->commit(len);
+    }
+    return len;
+}
+
 HttpRequest::ptr HttpSession::recvRequest()
 {
     HttpRequestParser::ptr parser(new HttpRequestParser);
-    uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();
-    std::shared_ptr<char> buffer(new char[buff_size], [](char* ptr){ delete[] ptr; });  // 自定义删除函数
-    char* data = buffer.get();      // 虽然用了智能指针，但是使用的时候还是直接用裸指针
-    int offset = 0;     // 偏移量，尚未解析完的数据
-    // 先去理解parser->execute里面的memmove方法，再看这个do-while循环会比较容易理解
+    // 解析器自己记录解析到的位置，每次只解析新读到的数据，已读数据不做搬移。
+    // m_buffer在请求头解析完之前不会消费数据，compact和扩容也不改变相对位置
     do
     {
-        int len = read(data + offset, buff_size - offset);  // 有offset个字节的数据尚未解析，因此偏移量是offset
-        if(len <= 0)
+        if(m_buffer && m_buffer->size() > parser->getOffset())
         {
-            close();
-            return nullptr;
-        }
-        len += offset;                  // 加上上一次没解析完的数据，这次再一起解析
-        size_t nparse = parser->execute(data, len); // 这里面有memmove的动作，所以是从data开始解析就行
-        if(parser->hasError())
-        {
-            close();
-            return nullptr;
+            parser->resume(m_buffer->begin(), m_buffer->size());
+            if(parser->hasError())
+            {
+                close();
+                return nullptr;
+            }
+            if(parser->isFinished())
+            {
+                break;
+            }
         }
-        offset = len - nparse;          // 尚未解析完成的数据
-        if(offset == (int)buff_size)    // 尚未解析完的数据等于原始数据，相当于没解析成功一点东西，即失败
+        if(fillBuffer() <= 0)
         {
             close();
             return nullptr;
         }
-        if(parser->isFinished())
-        {
-            break;
-        }
     } while(true);
 
+    m_buffer->consume(parser->getOffset());
+
     int64_t length = parser->getContentLength();    // 消息主体的长度(不包括http首部)
     if(length > 0)
     {
         std::string body;
         body.resize(length);
         
-        int len = 0;
-        if(length >= offset)
-        {
-            memcpy(&body[0], data, offset);
-            len = offset;
-        }
-        else
-        {
-            memcpy(&body[0], data, length);
-            len = length;
-        }
+        // 先取缓存中已经读到的部分，剩下的直接读进body
+        int64_t len = std::min(length, (int64_t)m_buffer->size());
+        memcpy(&body[0], m_buffer->begin(), len);
+        m_buffer->consume(len);
 
-        length -= offset;   // 减掉已经copy到body的长度
+        length -= len;
         if(length > 0)
         {
             if(readFixSize(&body[len], length) <= 0)
@@ -81,8 +89,58 @@ HttpRequest::ptr HttpSession::recvRequest()
     return parser->getData();
 }
 
+int HttpSession::writevFixSize(iovec* iov, size_t count)
+{
+    size_t total = 0;
+    while(count > 0)
+    {
+        int len = m_socket->send(iov, count);
+        if(len <= 0)
+        {
+            return len;
+        }
+        total += len;
+        // 跳过已经发完的段，发了一半的段调整起始位置
+        size_t left = len;
+        while(count > 0 && left >= iov->iov_len)
+        {
+            left -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if(count > 0)
+        {
+            iov->iov_base = (char*)iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+    return total;
+}
+
 int HttpSession::sendResponse(HttpResponse::ptr rsp)
 {
+    auto raw = rsp->getRawData();
+    if(raw)
+    {
+        // 已经序列化好的报文(比如缓存命中)，直接发送；
+        // 报文里不带trace id，把这个请求的插在状态行后面，不复制报文
+        const std::string& trace_header = GetTraceHeader();
+        std::string trace_id = rsp->getHeader(trace_header);
+        size_t pos = trace_id.empty() ? std::string::npos : raw->find("\r\n");
+        if(pos == std::string::npos)
+        {
+            return writeFixSize(raw->c_str(), raw->size());
+        }
+        std::string line = trace_header + ": " + trace_id + "\r\n";
+        iovec iov[3];
+        iov[0].iov_base = (void*)raw->c_str();
+        iov[0].iov_len = pos + 2;
+        iov[1].iov_base = (void*)line.c_str();
+        iov[1].iov_len = line.size();
+        iov[2].iov_base = (void*)(raw->c_str() + pos + 2);
+        iov[2].iov_len = raw->size() - pos - 2;
+        return writevFixSize(iov, 3);
+    }
     std::stringstream ss;
     ss << *rsp;             // 重载了<<运算符，输出的其实就是一个http报文了
     std::string data = ss.str();
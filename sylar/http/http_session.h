@@ -10,6 +10,7 @@
 
 #include "sylar/streams/socket_stream.h"
 #include "http.h"
+#include "http_parser.h"
 
 namespace sylar
 {
@@ -45,6 +46,28 @@ public:
      *          <0 Socket异常
      */
     int sendResponse(HttpResponse::ptr rsp);
+
+private:
+    /**
+     * @brief   从socket读数据追加到m_buffer
+     *
+     * @return  >0 读到的长度
+     *          =0 对方关闭或缓存已满
+     *          <0 Socket异常
+     */
+    int fillBuffer();
+
+    /**
+     * @brief   把几段数据一起发完(writev)
+     *
+     * @return  >0 发送的总长度
+     *          <=0 同write
+     */
+    int writevFixSize(iovec* iov, size_t count);
+
+private:
+    /// 接收缓存，跨请求保留，长连接上多余的数据留给下一个请求
+    HttpParseBuffer::ptr m_buffer;
 };
 
 }
@@ -183,9 +183,13 @@ int httpclient_parser_init(httpclient_parser *parser)  {
 int httpclient_parser_execute(httpclient_parser *parser, const char *buffer, size_t len, size_t off)  
 {
     parser->nread = 0;
-    parser->mark = 0;
-    parser->field_len = 0;
-    parser->field_start = 0;
+    /* off > 0 means resuming on the same buffer, keep the marks of a
+     * token that was split across calls */
+    if(off == 0) {
+        parser->mark = 0;
+        parser->field_len = 0;
+        parser->field_start = 0;
+    }
 
     const char *p, *pe;
     int cs = parser->cs;
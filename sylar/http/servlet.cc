@@ -1,4 +1,5 @@
 #include "servlet.h"
+#include "sylar/log.h"
 #include <fnmatch.h>
 
 namespace sylar
@@ -20,10 +21,271 @@ int32_t FunctionServlet::handle(sylar::http::HttpRequest::ptr request
     return m_cb(request, response, session);
 }
 
+struct ServletRouter::Node
+{
+    /// 静态边(压缩后的公共前缀)
+    std::string label;
+    /// 静态子节点，按label首字符排序，首字符互不相同
+    std::vector<std::unique_ptr<Node> > children;
+    /// 参数子节点，匹配一个路径段
+    std::unique_ptr<Node> param;
+    /// 在此结束的路由项，-1表示没有
+    int route = -1;
+    /// 以此为前缀的尾部通配路由项，-1表示没有
+    int wildcard = -1;
+
+    /**
+     * @brief   查找首字符为c的静态子节点的位置
+     */
+    std::vector<std::unique_ptr<Node> >::const_iterator findChild(char c) const
+    {
+        return std::lower_bound(children.begin(), children.end(), c
+                , [](const std::unique_ptr<Node>& n, char v) {
+                    return n->label[0] < v;
+                });
+    }
+};
+
+ServletRouter::ServletRouter()
+    : m_root(new Node)
+{
+}
+
+ServletRouter::~ServletRouter()
+{
+}
+
+void ServletRouter::addExact(const std::string& uri, IServletCreator::ptr creator)
+{
+    m_exacts[uri] = creator;
+}
+
+bool ServletRouter::IsTreeGlob(const std::string& pattern)
+{
+    for(size_t i = 0; i < pattern.size(); ++i)
+    {
+        switch(pattern[i])
+        {
+            case '*':
+                if(i + 1 != pattern.size())
+                {
+                    return false;
+                }
+                break;
+            case '?':
+            case '[':
+            case '\\':
+                return false;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+ServletRouter::Node* ServletRouter::insertStatic(Node* node, const std::string& str)
+{
+    size_t pos = 0;
+    while(pos < str.size())
+    {
+        auto it = node->findChild(str[pos]);
+        if(it == node->children.end() || (*it)->label[0] != str[pos])
+        {
+            // 没有公共前缀，直接挂一个新节点
+            Node* child = new Node;
+            child->label = str.substr(pos);
+            node->children.insert(it, std::unique_ptr<Node>(child));
+            return child;
+        }
+
+        Node* child = it->get();
+        size_t n = 0;
+        while(n < child->label.size() && pos + n < str.size()
+                && child->label[n] == str[pos + n])
+        {
+            ++n;
+        }
+        if(n < child->label.size())
+        {
+            // 只有部分公共前缀，把原节点拆成两段
+            Node* mid = new Node;
+            mid->label = child->label.substr(0, n);
+            child->label.erase(0, n);
+            auto& slot = node->children[it - node->children.begin()];
+            mid->children.push_back(std::move(slot));
+            slot.reset(mid);
+            child = mid;
+        }
+        pos += n;
+        node = child;
+    }
+    return node;
+}
+
+int ServletRouter::addRouteItem(const std::vector<std::string>& names, IServletCreator::ptr creator)
+{
+    Route r;
+    r.names = names;
+    r.creator = creator;
+    m_routes.push_back(r);
+    return m_routes.size() - 1;
+}
+
+bool ServletRouter::addRoute(const std::string& pattern, IServletCreator::ptr creator)
+{
+    Node* node = m_root.get();
+    std::vector<std::string> names;
+    std::string literal;
+    for(size_t i = 0; i < pattern.size(); ++i)
+    {
+        char c = pattern[i];
+        if(c == ':' && (i == 0 || pattern[i - 1] == '/'))
+        {
+            size_t end = pattern.find('/', i);
+            if(end == std::string::npos)
+            {
+                end = pattern.size();
+            }
+            if(end == i + 1)
+            {
+                return false;
+            }
+            node = insertStatic(node, literal);
+            literal.clear();
+            if(!node->param)
+            {
+                node->param.reset(new Node);
+            }
+            node = node->param.get();
+            names.push_back(pattern.substr(i + 1, end - i - 1));
+            i = end - 1;
+        }
+        else if(c == '*' && i + 1 == pattern.size())
+        {
+            node = insertStatic(node, literal);
+            names.push_back("*");
+            node->wildcard = addRouteItem(names, creator);
+            return true;
+        }
+        else
+        {
+            literal.push_back(c);
+        }
+    }
+    node = insertStatic(node, literal);
+    node->route = addRouteItem(names, creator);
+    return true;
+}
+
+void ServletRouter::addGlob(const std::string& pattern, IServletCreator::ptr creator)
+{
+    if(!IsTreeGlob(pattern))
+    {
+        m_globs.push_back(std::make_pair(pattern, creator));
+        return;
+    }
+    std::vector<std::string> names;
+    if(!pattern.empty() && pattern.back() == '*')
+    {
+        Node* node = insertStatic(m_root.get(), pattern.substr(0, pattern.size() - 1));
+        names.push_back("*");
+        node->wildcard = addRouteItem(names, creator);
+    }
+    else
+    {
+        Node* node = insertStatic(m_root.get(), pattern);
+        node->route = addRouteItem(names, creator);
+    }
+}
+
+bool ServletRouter::matchNode(const Node* node, const std::string& uri, size_t pos
+                              , std::vector<std::string>& values, int& route) const
+{
+    if(pos == uri.size() && node->route >= 0)
+    {
+        route = node->route;
+        return true;
+    }
+    if(pos < uri.size())
+    {
+        // 静态子节点优先
+        auto it = node->findChild(uri[pos]);
+        if(it != node->children.end() && (*it)->label[0] == uri[pos])
+        {
+            const std::string& label = (*it)->label;
+            if(uri.compare(pos, label.size(), label) == 0
+                    && matchNode(it->get(), uri, pos + label.size(), values, route))
+            {
+                return true;
+            }
+        }
+        // 其次参数节点
+        if(node->param && uri[pos] != '/')
+        {
+            size_t end = uri.find('/', pos);
+            if(end == std::string::npos)
+            {
+                end = uri.size();
+            }
+            values.push_back(uri.substr(pos, end - pos));
+            if(matchNode(node->param.get(), uri, end, values, route))
+            {
+                return true;
+            }
+            values.pop_back();
+        }
+    }
+    // 最后尾部通配，回溯时自然就是最长前缀优先
+    if(node->wildcard >= 0)
+    {
+        values.push_back(uri.substr(pos));
+        route = node->wildcard;
+        return true;
+    }
+    return false;
+}
+
+IServletCreator::ptr ServletRouter::match(const std::string& uri, ParamList* params) const
+{
+    auto mit = m_exacts.find(uri);
+    if(mit != m_exacts.end())
+    {
+        return mit->second;
+    }
+
+    std::vector<std::string> values;
+    int route = -1;
+    if(matchNode(m_root.get(), uri, 0, values, route))
+    {
+        const Route& r = m_routes[route];
+        if(params)
+        {
+            for(size_t i = 0; i < r.names.size() && i < values.size(); ++i)
+            {
+                params->push_back(std::make_pair(r.names[i], values[i]));
+            }
+        }
+        return r.creator;
+    }
+
+    for(auto it = m_globs.begin(); it != m_globs.end(); ++it)
+    {
+        if(!fnmatch(it->first.c_str(), uri.c_str(), 0))
+        {
+            return it->second;
+        }
+    }
+    return nullptr;
+}
+
+static std::atomic<uint64_t> s_dispatch_id = {0};
+
 ServletDispatch::ServletDispatch()
     : Servlet("ServletDispatch")
+    , m_id(++s_dispatch_id)
 {
     m_default.reset(new NotFoundServlet("sylar/1.0"));
+    rebuildRouter();
 }
 
 int32_t ServletDispatch::handle(sylar::http::HttpRequest::ptr request
@@ -31,7 +293,12 @@ int32_t ServletDispatch::handle(sylar::http::HttpRequest::ptr request
                      , sylar::http::HttpSession::ptr session)
 {
     // 通过请求的路径拿到Servlet进行处理
-    auto slt = getMatchedServlet(request->getPath());
+    ServletRouter::ParamList params;
+    auto slt = getMatchedServlet(request->getPath(), &params);
+    for(auto& i : params)
+    {
+        request->setRouteParam(i.first, i.second);
+    }
     if(slt)
     {
         slt->handle(request, response, session);
@@ -43,12 +310,14 @@ void ServletDispatch::addServlet(const std::string& uri, Servlet::ptr slt)
 {
     RWMutexType::WriteLock lk(m_mutex);
     m_datas[uri] = std::make_shared<HoldServletCreator>(slt);
+    rebuildRouter();
 }
 
 void ServletDispatch::addServlet(const std::string& uri, FunctionServlet::callback cb)
 {
     RWMutexType::WriteLock lk(m_mutex);
     m_datas[uri] = std::make_shared<HoldServletCreator>(std::make_shared<FunctionServlet>(cb));
+    rebuildRouter();
 }
 
 void ServletDispatch::addGlobServlet(const std::string& uri, Servlet::ptr slt)
@@ -64,6 +333,7 @@ void ServletDispatch::addGlobServlet(const std::string& uri, Servlet::ptr slt)
         }
     }
     m_globs.push_back(std::make_pair(uri, std::make_shared<HoldServletCreator>(slt)));
+    rebuildRouter();
 }
 
 void ServletDispatch::addGlobServlet(const std::string& uri, FunctionServlet::callback cb)
@@ -75,6 +345,7 @@ void ServletDispatch::addServletCreatot(const std::string& uri, IServletCreator:
 {
     RWMutexType::WriteLock lk(m_mutex);
     m_datas[uri] = creator;
+    rebuildRouter();
 }
 
 void ServletDispatch::addGlobServletCreatot(const std::string& uri, IServletCreator::ptr creator)
@@ -89,12 +360,14 @@ void ServletDispatch::addGlobServletCreatot(const std::string& uri, IServletCrea
         }
     }
     m_globs.push_back(std::make_pair(uri, creator));
+    rebuildRouter();
 }
 
 void ServletDispatch::delServlet(const std::string& uri)
 {
     RWMutexType::WriteLock lk(m_mutex);
     m_datas.erase(uri);
+    rebuildRouter();
 }
 
 void ServletDispatch::delGlobServlet(const std::string& uri)
@@ -108,6 +381,47 @@ void ServletDispatch::delGlobServlet(const std::string& uri)
             break;
         }
     }
+    rebuildRouter();
+}
+
+void ServletDispatch::addParamServlet(const std::string& uri, Servlet::ptr slt)
+{
+    addParamServletCreator(uri, std::make_shared<HoldServletCreator>(slt));
+}
+
+void ServletDispatch::addParamServlet(const std::string& uri, FunctionServlet::callback cb)
+{
+    addParamServletCreator(uri, std::make_shared<HoldServletCreator>(
+                std::make_shared<FunctionServlet>(cb)));
+}
+
+void ServletDispatch::addParamServletCreator(const std::string& uri, IServletCreator::ptr creator)
+{
+    RWMutexType::WriteLock lk(m_mutex);
+    for(auto it = m_params.begin(); it != m_params.end(); ++it)
+    {
+        if(it->first == uri)
+        {
+            m_params.erase(it);
+            break;
+        }
+    }
+    m_params.push_back(std::make_pair(uri, creator));
+    rebuildRouter();
+}
+
+void ServletDispatch::delParamServlet(const std::string& uri)
+{
+    RWMutexType::WriteLock lk(m_mutex);
+    for(auto it = m_params.begin(); it != m_params.end(); ++it)
+    {
+        if(it->first == uri)
+        {
+            m_params.erase(it);
+            break;
+        }
+    }
+    rebuildRouter();
 }
 
 Servlet::ptr ServletDispatch::getServlet(const std::string& uri)
@@ -130,25 +444,67 @@ Servlet::ptr ServletDispatch::getGlobServlet(const std::string& uri)
     return nullptr;
 }
 
-Servlet::ptr ServletDispatch::getMatchedServlet(const std::string& uri)
+namespace
 {
-    RWMutexType::ReadLock lk(m_mutex);
-    auto mit = m_datas.find(uri);
-    if(mit != m_datas.end())                // 先精准
+/**
+ * @brief   线程局部的路由表缓存，版本号没变时不需要碰共享的引用计数
+ */
+struct RouterCache
+{
+    uint64_t id = 0;
+    uint64_t version = 0;
+    std::shared_ptr<const ServletRouter> router;
+};
+
+static thread_local RouterCache t_router_cache;
+}
+
+void ServletDispatch::rebuildRouter()
+{
+    // 重建出一份新的只读路由表，整体替换(RCU)，正在使用旧表的线程不受影响
+    std::shared_ptr<ServletRouter> router = std::make_shared<ServletRouter>();
+    for(auto& i : m_datas)
     {
-        return mit->second->get();
+        router->addExact(i.first, i.second);
     }
-
-    for(auto it = m_globs.begin(); it != m_globs.end(); ++it)   // 再模糊
+    for(auto& i : m_params)
     {
-        // fnmatch(pattern, string, flags);
-        // pattern: 要检索的模式；string: 要检查的字符串或文件；flags: 可选
-        if(!fnmatch(it->first.c_str(), uri.c_str(), 0)) 
+        if(!router->addRoute(i.first, i.second))
         {
-            return it->second->get();
+            SYLAR_LOG_ERROR(SYLAR_LOG_NAME("system")) << "invalid servlet route: " << i.first;
         }
     }
-    return m_default;       // 最后默认
+    for(auto& i : m_globs)
+    {
+        router->addGlob(i.first, i.second);
+    }
+    std::atomic_store(&m_router, std::shared_ptr<const ServletRouter>(router));
+    ++m_version;
+}
+
+const ServletRouter* ServletDispatch::getRouter()
+{
+    uint64_t version = m_version;
+    RouterCache& cache = t_router_cache;
+    if(cache.id != m_id || cache.version != version)
+    {
+        cache.router = std::atomic_load(&m_router);
+        cache.id = m_id;
+        cache.version = version;
+    }
+    return cache.router.get();
+}
+
+Servlet::ptr ServletDispatch::getMatchedServlet(const std::string& uri)
+{
+    return getMatchedServlet(uri, nullptr);
+}
+
+Servlet::ptr ServletDispatch::getMatchedServlet(const std::string& uri, ServletRouter::ParamList* params)
+{
+    // 先精准，再路由树，再模糊，都没有就返回默认
+    auto creator = getRouter()->match(uri, params);
+    return creator ? creator->get() : m_default;
 }
 
 void ServletDispatch::listAllServletCreator(std::map<std::string, IServletCreator::ptr>& infos)
@@ -13,6 +13,7 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <atomic>
 #include "http.h"
 #include "http_session.h"
 #include "sylar/mutex.h"
@@ -123,6 +124,89 @@ public:
     std::string getName() const override { return TypeToName<T>(); }
 };
 
+/**
+ * @brief   Servlet路由表(radix tree)
+ * @details 构建完成后只读，由ServletDispatch整体替换(RCU)，查找时不需要加锁。
+ *          匹配优先级: 精准匹配 > 静态/参数路由 > 尾部通配(最长前缀优先) > 其他模糊匹配(按添加顺序)
+ *          路由格式:
+ *              /user/list          静态路径
+ *              /user/:id/info      :id 匹配一个路径段(不含'/')
+ *              /static_*           末尾的'*'为尾部通配，匹配剩余的全部路径(可为空)
+ */
+class ServletRouter
+{
+public:
+    typedef std::shared_ptr<ServletRouter> ptr;
+    /// 匹配到的路由参数，按出现的顺序
+    typedef std::vector<std::pair<std::string, std::string> > ParamList;
+
+    ServletRouter();
+    ~ServletRouter();
+
+    /**
+     * @brief   添加精准匹配
+     */
+    void addExact(const std::string& uri, IServletCreator::ptr creator);
+
+    /**
+     * @brief   添加参数路由
+     *
+     * @param   pattern 路由格式，如 /user/:id 、/static_*
+     *
+     * @return  格式非法(参数名为空)返回false
+     */
+    bool addRoute(const std::string& pattern, IServletCreator::ptr creator);
+
+    /**
+     * @brief   添加模糊匹配(fnmatch格式)
+     * @details 没有特殊字符或只有末尾一个'*'的编译进路由树，其他的按顺序用fnmatch匹配
+     */
+    void addGlob(const std::string& pattern, IServletCreator::ptr creator);
+
+    /**
+     * @brief   查找uri对应的ServletCreator
+     *
+     * @param   uri     请求路径
+     * @param   params  [out] 路由参数，可为nullptr
+     *
+     * @return  没匹配到返回nullptr
+     */
+    IServletCreator::ptr match(const std::string& uri, ParamList* params = nullptr) const;
+
+    /**
+     * @brief   模糊匹配是否可以编译进路由树
+     */
+    static bool IsTreeGlob(const std::string& pattern);
+
+private:
+    struct Node;
+
+    /**
+     * @brief   路由项
+     */
+    struct Route
+    {
+        /// 参数名，尾部通配为"*"
+        std::vector<std::string> names;
+        IServletCreator::ptr creator;
+    };
+
+    Node* insertStatic(Node* node, const std::string& str);
+    int addRouteItem(const std::vector<std::string>& names, IServletCreator::ptr creator);
+    bool matchNode(const Node* node, const std::string& uri, size_t pos
+                   , std::vector<std::string>& values, int& route) const;
+
+private:
+    /// 精准匹配
+    std::unordered_map<std::string, IServletCreator::ptr> m_exacts;
+    /// 路由树根节点
+    std::unique_ptr<Node> m_root;
+    /// 路由项
+    std::vector<Route> m_routes;
+    /// 无法编译进路由树的模糊匹配
+    std::vector<std::pair<std::string, IServletCreator::ptr> > m_globs;
+};
+
 /**
  * @brief   Servlet分发器
  */
@@ -171,8 +255,19 @@ public:
         addGlobServletCreator(uri, std::make_shared<ServletCreator<T> >());
     }
 
+    /**
+     * @brief   添加参数路由Servlet
+     *
+     * @param   uri 路由格式 /user/:id 、/static_* ，参数通过HttpRequest::getRouteParam获取
+     * @param   slt Servlet
+     */
+    void addParamServlet(const std::string& uri, Servlet::ptr slt);
+    void addParamServlet(const std::string& uri, FunctionServlet::callback cb);
+    void addParamServletCreator(const std::string& uri, IServletCreator::ptr creator);
+
     void delServlet(const std::string& uri);
     void delGlobServlet(const std::string& uri);
+    void delParamServlet(const std::string& uri);
 
     Servlet::ptr getDefault() const { return m_default; }
     void setDefault(Servlet::ptr v) { m_default = v; }
@@ -189,11 +284,28 @@ public:
      */
     Servlet::ptr getMatchedServlet(const std::string& uri);
 
+    /**
+     * @brief   通过uri获取Servlet，同时输出路由参数
+     */
+    Servlet::ptr getMatchedServlet(const std::string& uri, ServletRouter::ParamList* params);
+
     void listAllServletCreator(std::map<std::string, IServletCreator::ptr>& infos);
     void listAllGlobServletCreator(std::map<std::string, IServletCreator::ptr>& infos);
 
 private:
-    /// 读写互斥量
+    /**
+     * @brief   获取当前发布的路由表，只比较版本号，不加锁
+     * @details 返回的指针由线程局部缓存持有，在本线程下一次调用前有效
+     */
+    const ServletRouter* getRouter();
+
+    /**
+     * @brief   用原始数据重建路由表并发布，调用方需持有写锁
+     */
+    void rebuildRouter();
+
+private:
+    /// 读写互斥量(保护下面的原始数据，查找走m_router，不加锁)
     RWMutexType m_mutex;
     /// 精准匹配Servlet map
     /// uri(/sylar/xxx) -> servlet
@@ -201,6 +313,15 @@ private:
     /// 模糊匹配Servlet 数组
     /// uri(/sylar/*) -> servlet
     std::vector<std::pair<std::string, IServletCreator::ptr> > m_globs;
+    /// 参数路由Servlet 数组
+    /// uri(/sylar/:id) -> servlet
+    std::vector<std::pair<std::string, IServletCreator::ptr> > m_params;
+    /// 当前发布的路由表
+    std::shared_ptr<const ServletRouter> m_router;
+    /// 路由表版本号，每次重建加1
+    std::atomic<uint64_t> m_version = {0};
+    /// 分发器唯一id，用于线程局部缓存
+    uint64_t m_id;
     /// 默认servlet，所有路径都没匹配到时使用 
     Servlet::ptr m_default;
 };
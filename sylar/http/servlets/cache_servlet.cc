@@ -0,0 +1,326 @@
+#include "cache_servlet.h"
+#include "sylar/http/http_compress.h"
+#include "sylar/config.h"
+#include "sylar/log.h"
+#include "sylar/util.h"
+#include <sstream>
+
+namespace sylar
+{
+
+namespace http
+{
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint64_t>::ptr g_http_cache_ttl =
+    sylar::Config::Lookup("http.cache.ttl", (uint64_t)(5 * 1000), "http response cache ttl(ms)");
+
+static sylar::ConfigVar<uint64_t>::ptr g_http_cache_max_bytes =
+    sylar::Config::Lookup("http.cache.max_bytes", (uint64_t)(64 * 1024 * 1024), "http response cache max bytes");
+
+static sylar::ConfigVar<uint32_t>::ptr g_http_cache_shards =
+    sylar::Config::Lookup("http.cache.shards", (uint32_t)16, "http response cache shard count");
+
+CachingServlet::CachingServlet(Servlet::ptr servlet, uint64_t ttl_ms, uint64_t max_bytes)
+    : Servlet("CachingServlet")
+    , m_servlet(servlet)
+    , m_ttl(ttl_ms ? ttl_ms : g_http_cache_ttl->getValue())
+{
+    if(!max_bytes)
+    {
+        max_bytes = g_http_cache_max_bytes->getValue();
+    }
+    uint32_t shards = g_http_cache_shards->getValue();
+    if(shards == 0)
+    {
+        shards = 1;
+    }
+    m_shardMaxBytes = max_bytes / shards;
+    for(uint32_t i = 0; i < shards; ++i)
+    {
+        m_shards.emplace_back(new Shard);
+    }
+    m_name = "CachingServlet(" + servlet->getName() + ")";
+}
+
+std::string CachingServlet::MakeKey(HttpRequest::ptr req, HttpResponse::ptr rsp)
+{
+    // 缓存的是整个报文，版本号和connection头部也要区分
+    std::string key = HttpMethodToString(req->getMethod());
+    key.append(1, ' ');
+    key.append(1, (char)rsp->getVersion());
+    key.append(1, rsp->isClose() ? 'c' : 'k');
+    // 缓存的是压缩后的报文，压缩格式不同的分开缓存
+    key.append(NegotiateContentEncoding(req));
+    key.append(req->getPath());
+
+    const std::string& query = req->getQuery();
+    if(!query.empty())
+    {
+        std::vector<std::string> params;
+        size_t pos = 0;
+        while(pos <= query.size())
+        {
+            size_t end = query.find('&', pos);
+            if(end == std::string::npos)
+            {
+                end = query.size();
+            }
+            if(end > pos)
+            {
+                params.push_back(query.substr(pos, end - pos));
+            }
+            pos = end + 1;
+        }
+        std::sort(params.begin(), params.end());
+        key.append(1, '?');
+        for(size_t i = 0; i < params.size(); ++i)
+        {
+            if(i)
+            {
+                key.append(1, '&');
+            }
+            key.append(params[i]);
+        }
+    }
+    return key;
+}
+
+CachingServlet::Shard& CachingServlet::getShard(const std::string& key)
+{
+    return *m_shards[std::hash<std::string>()(key) % m_shards.size()];
+}
+
+int32_t CachingServlet::handle(sylar::http::HttpRequest::ptr request
+                     , sylar::http::HttpResponse::ptr response
+                     , sylar::http::HttpSession::ptr session)
+{
+    if(request->getMethod() != HttpMethod::GET)
+    {
+        return m_servlet->handle(request, response, session);
+    }
+
+    std::string key = MakeKey(request, response);
+    Shard& shard = getShard(key);
+    // 请求明确要求不用缓存的，直接回源，结果照样刷新缓存
+    bool no_cache = request->getHeader("cache-control").find("no-cache") != std::string::npos;
+    Pending::ptr pending;
+    {
+        MutexType::Lock lk(shard.mutex);
+        if(!no_cache)
+        {
+            auto it = shard.items.find(key);
+            if(it != shard.items.end())
+            {
+                Entry::ptr entry = *it->second;
+                if(entry->expire > sylar::GetCurrentMS())
+                {
+                    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                    lk.unlock();
+                    ++m_hits;
+                    serve(entry, request, response);
+                    return 0;
+                }
+                shard.bytes -= entry->data->size();
+                shard.lru.erase(it->second);
+                shard.items.erase(it);
+            }
+
+            auto pit = shard.pendings.find(key);
+            if(pit != shard.pendings.end() && Scheduler::GetThis())
+            {
+                // 已经有协程在回源了，挂起等它的结果
+                Pending::ptr wait = pit->second;
+                wait->waiters.push_back(std::make_pair(Scheduler::GetThis(), Fiber::GetThis()));
+                lk.unlock();
+                Fiber::YieldToHold();
+
+                // 被唤醒时wait->done已经是true，之后不会再改
+                if(wait->entry)
+                {
+                    ++m_hits;
+                    serve(wait->entry, request, response);
+                    return 0;
+                }
+                // 结果不可缓存，自己回源
+                ++m_misses;
+                return m_servlet->handle(request, response, session);
+            }
+        }
+        if(Scheduler::GetThis() && !shard.pendings.count(key))
+        {
+            pending = std::make_shared<Pending>();
+            shard.pendings[key] = pending;
+        }
+    }
+
+    ++m_misses;
+    int32_t rt = 0;
+    try
+    {
+        rt = m_servlet->handle(request, response, session);
+    }
+    catch(...)
+    {
+        if(pending)
+        {
+            finish(shard, key, pending, nullptr);
+        }
+        throw;
+    }
+
+    // 先压缩再缓存，命中时不用重复压缩
+    CompressResponse(request, response);
+    Entry::ptr entry = buildEntry(key, response);
+    if(pending || entry)
+    {
+        finish(shard, key, pending, entry);
+    }
+    if(entry)
+    {
+        serve(entry, request, response);
+    }
+    return rt;
+}
+
+CachingServlet::Entry::ptr CachingServlet::buildEntry(const std::string& key, HttpResponse::ptr rsp)
+{
+    if(rsp->getStatus() != HttpStatus::OK || !rsp->getCookies().empty() || rsp->getRawData())
+    {
+        return nullptr;
+    }
+
+    uint64_t ttl = m_ttl;
+    std::string cc = rsp->getHeader("cache-control");
+    if(!cc.empty())
+    {
+        if(cc.find("no-store") != std::string::npos
+                || cc.find("private") != std::string::npos
+                || cc.find("no-cache") != std::string::npos)
+        {
+            return nullptr;
+        }
+        size_t pos = cc.find("max-age=");
+        if(pos != std::string::npos)
+        {
+            ttl = strtoull(cc.c_str() + pos + 8, nullptr, 10) * 1000;
+        }
+    }
+    if(ttl == 0)
+    {
+        return nullptr;
+    }
+
+    std::string etag = rsp->getHeader("etag");
+    if(etag.empty())
+    {
+        std::stringstream ss;
+        ss << "\"" << std::hex << std::hash<std::string>()(rsp->getBody())
+           << "-" << rsp->getBody().size() << "\"";
+        etag = ss.str();
+        rsp->setHeader("ETag", etag);
+    }
+
+    Entry::ptr entry = std::make_shared<Entry>();
+    entry->key = key;
+    entry->etag = etag;
+    entry->expire = sylar::GetCurrentMS() + ttl;
+    // trace id之类每个请求不一样的头部不能缓存，命中时由HttpSession::sendResponse补上
+    const std::string& trace_header = GetTraceHeader();
+    std::string trace_id = rsp->getHeader(trace_header);
+    if(!trace_id.empty())
+    {
+        rsp->delHeader(trace_header);
+    }
+    entry->data = std::make_shared<const std::string>(rsp->toString());
+    if(!trace_id.empty())
+    {
+        rsp->setHeader(trace_header, trace_id);
+    }
+    if(entry->data->size() > m_shardMaxBytes)
+    {
+        return nullptr;
+    }
+    return entry;
+}
+
+void CachingServlet::finish(Shard& shard, const std::string& key, Pending::ptr pending, Entry::ptr entry)
+{
+    std::vector<std::pair<Scheduler*, Fiber::ptr> > waiters;
+    {
+        MutexType::Lock lk(shard.mutex);
+        if(entry)
+        {
+            auto it = shard.items.find(key);
+            if(it != shard.items.end())
+            {
+                shard.bytes -= (*it->second)->data->size();
+                shard.lru.erase(it->second);
+                shard.items.erase(it);
+            }
+            shard.lru.push_front(entry);
+            shard.items[key] = shard.lru.begin();
+            shard.bytes += entry->data->size();
+            // 超出大小上限，从最久未使用的开始淘汰
+            while(shard.bytes > m_shardMaxBytes && !shard.lru.empty())
+            {
+                Entry::ptr last = shard.lru.back();
+                shard.bytes -= last->data->size();
+                shard.items.erase(last->key);
+                shard.lru.pop_back();
+            }
+        }
+        if(pending)
+        {
+            pending->entry = entry;
+            pending->done = true;
+            pending->waiters.swap(waiters);
+            shard.pendings.erase(key);
+        }
+    }
+    for(auto& i : waiters)
+    {
+        i.first->schedule(i.second);
+    }
+}
+
+void CachingServlet::serve(Entry::ptr entry, HttpRequest::ptr req, HttpResponse::ptr rsp)
+{
+    std::string inm = req->getHeader("if-none-match");
+    if(!inm.empty() && (inm == entry->etag || inm == "*"))
+    {
+        rsp->setStatus(HttpStatus::NOT_MODIFIED);
+        rsp->setHeader("ETag", entry->etag);
+        rsp->setBody("");
+        rsp->setRawData(nullptr);
+        return;
+    }
+    rsp->setRawData(entry->data);
+}
+
+void CachingServlet::clear()
+{
+    for(auto& i : m_shards)
+    {
+        MutexType::Lock lk(i->mutex);
+        i->lru.clear();
+        i->items.clear();
+        i->bytes = 0;
+    }
+}
+
+uint64_t CachingServlet::getBytes()
+{
+    uint64_t bytes = 0;
+    for(auto& i : m_shards)
+    {
+        MutexType::Lock lk(i->mutex);
+        bytes += i->bytes;
+    }
+    return bytes;
+}
+
+}
+
+}
@@ -0,0 +1,144 @@
+/**
+ * @filename    cache_servlet.h
+ * @brief   响应缓存Servlet
+ * @author  L-ge
+ * @version 0.1
+ * @modify  2022-07-24
+ */
+#ifndef __SYLAR_HTTP_SERVLETS_CACHE_SERVLET_H__
+#define __SYLAR_HTTP_SERVLETS_CACHE_SERVLET_H__
+
+#include <list>
+#include <atomic>
+#include <unordered_map>
+#include "sylar/http/servlet.h"
+#include "sylar/fiber.h"
+#include "sylar/scheduler.h"
+#include "sylar/mutex.h"
+
+namespace sylar
+{
+
+namespace http
+{
+
+/**
+ * @brief   响应缓存Servlet(装饰器)
+ * @details 包装一个Servlet，对 GET 请求按 method+path+排序后的query 缓存完整的响应报文。
+ *          - 分片LRU，总大小不超过max_bytes
+ *          - 过期时间优先取响应的 Cache-Control: max-age，没有则用ttl
+ *          - 同一个key并发未命中时只有一个请求会调用被包装的Servlet，其他协程挂起等结果
+ *          - 命中时直接发送缓存的报文，支持 If-None-Match 返回304
+ *          - 按Accept-Encoding协商结果分开缓存压缩后的报文
+ *          只缓存200的响应，带 Set-Cookie 或 Cache-Control: no-store/private/no-cache 的不缓存
+ */
+class CachingServlet : public Servlet
+{
+public:
+    typedef std::shared_ptr<CachingServlet> ptr;
+    typedef Mutex MutexType;
+
+    /**
+     * @brief   构造函数
+     *
+     * @param   servlet     被包装的Servlet
+     * @param   ttl_ms      默认缓存时间(毫秒)，0表示使用配置 http.cache.ttl
+     * @param   max_bytes   缓存总大小上限，0表示使用配置 http.cache.max_bytes
+     */
+    CachingServlet(Servlet::ptr servlet, uint64_t ttl_ms = 0, uint64_t max_bytes = 0);
+
+    virtual int32_t handle(sylar::http::HttpRequest::ptr request
+                         , sylar::http::HttpResponse::ptr response
+                         , sylar::http::HttpSession::ptr session) override;
+
+    /**
+     * @brief   清空缓存
+     */
+    void clear();
+
+    uint64_t getHits() const { return m_hits; }
+    uint64_t getMisses() const { return m_misses; }
+
+    /**
+     * @brief   当前缓存的总字节数
+     */
+    uint64_t getBytes();
+
+private:
+    /**
+     * @brief   缓存项
+     */
+    struct Entry
+    {
+        typedef std::shared_ptr<Entry> ptr;
+        std::string key;
+        /// 序列化好的完整响应报文
+        std::shared_ptr<const std::string> data;
+        std::string etag;
+        /// 过期时间(毫秒)
+        uint64_t expire;
+    };
+
+    /**
+     * @brief   正在回源的请求，后来的同key请求挂在这里等结果
+     */
+    struct Pending
+    {
+        typedef std::shared_ptr<Pending> ptr;
+        bool done = false;
+        Entry::ptr entry;
+        std::vector<std::pair<Scheduler*, Fiber::ptr> > waiters;
+    };
+
+    /**
+     * @brief   缓存分片
+     */
+    struct Shard
+    {
+        MutexType mutex;
+        /// 头部是最近使用的
+        std::list<Entry::ptr> lru;
+        std::unordered_map<std::string, std::list<Entry::ptr>::iterator> items;
+        std::unordered_map<std::string, Pending::ptr> pendings;
+        uint64_t bytes = 0;
+    };
+
+    /**
+     * @brief   生成缓存key，query参数按名字排序
+     */
+    static std::string MakeKey(HttpRequest::ptr req, HttpResponse::ptr rsp);
+
+    /**
+     * @brief   由回源得到的响应生成缓存项，不可缓存返回nullptr
+     */
+    Entry::ptr buildEntry(const std::string& key, HttpResponse::ptr rsp);
+
+    /**
+     * @brief   用缓存项填充响应
+     */
+    void serve(Entry::ptr entry, HttpRequest::ptr req, HttpResponse::ptr rsp);
+
+    /**
+     * @brief   回源结束，写入缓存并唤醒等待的协程
+     */
+    void finish(Shard& shard, const std::string& key, Pending::ptr pending, Entry::ptr entry);
+
+    Shard& getShard(const std::string& key);
+
+private:
+    /// 被包装的Servlet
+    Servlet::ptr m_servlet;
+    /// 默认缓存时间(毫秒)
+    uint64_t m_ttl;
+    /// 每个分片的大小上限
+    uint64_t m_shardMaxBytes;
+    std::vector<std::unique_ptr<Shard> > m_shards;
+    std::atomic<uint64_t> m_hits = {0};
+    std::atomic<uint64_t> m_misses = {0};
+};
+
+}
+
+}
+
+#endif
@@ -1,9 +1,85 @@
 #include "log.h"
 #include "config.h"
+#include "log_binary.h"
+#include "iomanager.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <set>
+#include <deque>
+#include <unordered_map>
+#include <zlib.h>
 
 namespace sylar
 {
 
+static ConfigVar<bool>::ptr g_log_async_enable =
+    Config::Lookup("log.async.enable", false, "log async mode");
+
+static ConfigVar<uint32_t>::ptr g_log_async_buffer_size =
+    Config::Lookup("log.async.buffer_size", (uint32_t)(256 * 1024), "log async per thread buffer size");
+
+static ConfigVar<std::string>::ptr g_log_async_overflow =
+    Config::Lookup("log.async.overflow", std::string("block"), "log async buffer overflow policy: block, drop, drop_below");
+
+static ConfigVar<std::string>::ptr g_log_async_drop_level =
+    Config::Lookup("log.async.drop_level", std::string("WARN"), "log async drop_below policy: drop records below this level");
+
+static ConfigVar<uint32_t>::ptr g_log_limit_summary_interval =
+    Config::Lookup("log.limit.summary_interval", (uint32_t)10000, "log rate limit suppressed summary interval ms");
+
+/// 是否开启了异步日志
+static std::atomic<bool> s_log_async_enabled = {false};
+
+/**
+ * @brief   把iovec里的数据全部写到fd，处理部分写
+ */
+static void WriteFully(int fd, const iovec* buffers, int count)
+{
+    size_t total = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        total += buffers[i].iov_len;
+    }
+    ssize_t rt = 0;
+    do
+    {
+        rt = ::writev(fd, buffers, count);
+    } while(rt < 0 && errno == EINTR);
+    if(rt < 0 || (size_t)rt == total)
+    {
+        return;
+    }
+
+    // 只写了一部分，剩下的逐块写
+    size_t done = rt;
+    for(int i = 0; i < count; ++i)
+    {
+        if(done >= buffers[i].iov_len)
+        {
+            done -= buffers[i].iov_len;
+            continue;
+        }
+        const char* ptr = (const char*)buffers[i].iov_base + done;
+        size_t left = buffers[i].iov_len - done;
+        done = 0;
+        while(left > 0)
+        {
+            rt = ::write(fd, ptr, left);
+            if(rt < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                return;
+            }
+            ptr += rt;
+            left -= rt;
+        }
+    }
+}
+
 const char* LogLevel::ToString(LogLevel::Level level)
 {
     switch(level)
@@ -49,466 +125,1948 @@ LogLevel::Level LogLevel::FromString(const std::string& str)
 #undef XX
 }
 
-LogEvent::LogEvent(std::shared_ptr<Logger> logger, 
-        LogLevel::Level level,
-        const char* file,
-        int32_t line,
-        uint32_t elapse,
-        uint32_t threadId,
-        uint32_t fiberId,
-        uint64_t time,
-        const std::string& threadName)
-    : m_logger(logger)
-    , m_level(level)
-    , m_file(file)
-    , m_line(line)
-    , m_elapse(elapse)
-    , m_threadId(threadId)
-    , m_fiberId(fiberId)
-    , m_time(time)
-    , m_threadName(threadName)
-{
-}
+/// 日志级别变化的次数，判断期间级别变了就不写缓存
+static std::atomic<uint64_t> s_log_level_generation = {0};
 
-void LogEvent::format(const char* fmt, ...)
+/**
+ * @brief   登记过的日志调用点
+ * @details 不析构，退出时其它静态对象的析构里还可能写日志
+ */
+struct LogCallSiteRegistry
 {
-    va_list al;
-    va_start(al, fmt);
-    format(fmt, al);
-    va_end(al);
-}
+    Spinlock mutex;
+    std::vector<LogCallSite*> sites;
 
-void LogEvent::format(const char* fmt, va_list al)
-{
-    char* buf = nullptr;
-    int len = vasprintf(&buf, fmt, al);
-    if(len != -1)
+    static LogCallSiteRegistry* GetInstance()
     {
-        m_ss << std::string(buf, len);
-        free(buf);
+        static LogCallSiteRegistry* s_instance = new LogCallSiteRegistry;
+        return s_instance;
     }
-}
+};
 
-LogEventWrap::LogEventWrap(LogEvent::ptr e)
-    : m_event(e)
+void LogCallSite::InvalidateAll()
 {
-
+    s_log_level_generation.fetch_add(1);
+    LogCallSiteRegistry* registry = LogCallSiteRegistry::GetInstance();
+    Spinlock::Lock lk(registry->mutex);
+    for(auto& i : registry->sites)
+    {
+        i->m_disabled.store(nullptr, std::memory_order_relaxed);
+    }
 }
 
-LogEventWrap::~LogEventWrap()
+bool LogCallSite::update(const Logger* logger, LogLevel::Level level)
 {
-    m_event->getLogger()->log(m_event->getLevel(), m_event);
-}
+    if(!m_registered.load(std::memory_order_acquire))
+    {
+        LogCallSiteRegistry* registry = LogCallSiteRegistry::GetInstance();
+        Spinlock::Lock lk(registry->mutex);
+        if(!m_registered.load(std::memory_order_relaxed))
+        {
+            registry->sites.push_back(this);
+            m_registered.store(true, std::memory_order_release);
+        }
+    }
 
-std::stringstream& LogEventWrap::getSS()
-{
-    return m_event->getSS();
+    uint64_t gen = s_log_level_generation.load();
+    if(logger->getLevel() <= level)
+    {
+        return true;
+    }
+    m_disabled.store(logger);
+    // 判断和写缓存之间级别被改了，缓存可能已经过期，作废掉
+    if(s_log_level_generation.load() != gen)
+    {
+        m_disabled.store(nullptr);
+    }
+    return false;
 }
 
 /**
- * @brief   m:消息
+ * @brief   被限掉过日志的LogRateLimiter
+ * @details 不析构，退出时其它静态对象的析构里还可能写日志
  */
-class  MessageFormatItem : public LogFormatter::FormatItem
+struct LogRateLimiterRegistry
 {
-public:
-    MessageFormatItem(const std::string& str = "") {}
-
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    struct Entry
     {
-        os << event->getContent();
-    }
-};
+        /// 汇总用哪个logger输出
+        std::weak_ptr<Logger> logger;
+        /// 调用点，logger的总预算时为nullptr
+        const char* file = nullptr;
+        int32_t line = 0;
+        /// 这段时间第一次被限掉的时间(毫秒)
+        uint64_t since = 0;
+    };
 
-/**
- * @brief   p:日志级别
- */
-class LevelFormatItem : public LogFormatter::FormatItem
-{
-public:
-    LevelFormatItem(const std::string& str = "") {}
+    Spinlock mutex;
+    std::unordered_map<LogRateLimiter*, Entry> limiters;
+    /// 是否已经安排了汇总的定时器
+    std::atomic<bool> scheduled = {false};
 
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    static LogRateLimiterRegistry* GetInstance()
     {
-        os << LogLevel::ToString(level);
+        static LogRateLimiterRegistry* s_instance = new LogRateLimiterRegistry;
+        return s_instance;
     }
 };
 
-/**
- * @brief   r:累计毫秒数
- */
-class ElapseFormatItem : public LogFormatter::FormatItem
+bool LogRateLimiter::allow(const std::shared_ptr<Logger>& logger, const char* file, int32_t line
+                           , uint32_t rate, uint32_t burst)
 {
-public:
-    ElapseFormatItem(const std::string& str = "") {}
-
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    if(rate == 0)
     {
-        os << event->getElapse();
+        return true;
     }
-};
-
-/**
- * @brief   c:日志名称
- */
-class NameFormatItem : public LogFormatter::FormatItem
-{
-public:
-    NameFormatItem(const std::string& str = "") {}
-
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    uint64_t interval = 1000000000ull / rate;
+    uint64_t tolerance = interval * (burst > 1 ? burst - 1 : 0);
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    uint64_t tat = m_tat.load(std::memory_order_relaxed);
+    while(true)
     {
-        os << event->getLogger()->getName();
+        if(tat > now + tolerance)
+        {
+            suppress(logger, file, line);
+            return false;
+        }
+        uint64_t next = std::max(tat, now) + interval;
+        if(m_tat.compare_exchange_weak(tat, next, std::memory_order_relaxed))
+        {
+            return true;
+        }
     }
-};
+}
 
-/**
- * @brief   t:线程id
- */
-class ThreadIdFormatItem : public LogFormatter::FormatItem
+void LogRateLimiter::suppress(const std::shared_ptr<Logger>& logger, const char* file, int32_t line)
 {
-public:
-    ThreadIdFormatItem(const std::string& str = "") {}
-
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    LogRateLimiterRegistry* registry = LogRateLimiterRegistry::GetInstance();
+    if(m_suppressed.fetch_add(1, std::memory_order_relaxed) == 0)
     {
-        os << event->getThreadId();
+        Spinlock::Lock lk(registry->mutex);
+        auto& entry = registry->limiters[this];
+        entry.logger = logger;
+        entry.file = file;
+        entry.line = line;
+        entry.since = GetCurrentMS();
     }
-};
+    if(registry->scheduled.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    IOManager* iom = IOManager::GetThis();
+    if(iom && !registry->scheduled.exchange(true))
+    {
+        iom->addTimer(g_log_limit_summary_interval->getValue(), &LogRateLimiter::ReportSuppressed);
+    }
+}
 
-/**
- * @brief   n:换行
- */
-class NewLineFormatItem : public LogFormatter::FormatItem
+void LogRateLimiter::unregister()
 {
-public:
-    NewLineFormatItem(const std::string& str = "") {}
+    LogRateLimiterRegistry* registry = LogRateLimiterRegistry::GetInstance();
+    Spinlock::Lock lk(registry->mutex);
+    registry->limiters.erase(this);
+}
 
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+void LogRateLimiter::ReportSuppressed()
+{
+    struct Summary
     {
-        os << std::endl;
-    }
-};
+        Logger::ptr logger;
+        const char* file;
+        int32_t line;
+        uint64_t count;
+        uint64_t ms;
+    };
 
-/**
- * @brief   d:时间
- */
-class DateTimeFormatItem : public LogFormatter::FormatItem
-{
-public:
-    DateTimeFormatItem(const std::string& format = "%Y-%m-%d %H:%M:%S")
-        : m_format(format)
+    LogRateLimiterRegistry* registry = LogRateLimiterRegistry::GetInstance();
+    registry->scheduled = false;
+    std::vector<Summary> summaries;
+    uint64_t now = GetCurrentMS();
     {
-        if(m_format.empty())
+        Spinlock::Lock lk(registry->mutex);
+        for(auto& i : registry->limiters)
         {
-            m_format = "%Y-%m-%d %H:%M:%S";
+            uint64_t count = i.first->m_suppressed.exchange(0, std::memory_order_relaxed);
+            Logger::ptr logger = i.second.logger.lock();
+            if(count && logger)
+            {
+                summaries.push_back({logger, i.second.file, i.second.line, count, now - i.second.since});
+            }
         }
     }
 
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    for(auto& i : summaries)
     {
-        struct tm tm;
-        time_t time = event->getTime();
-        localtime_r(&time, &tm);
-        char buf[64];
-        strftime(buf, sizeof(buf), m_format.c_str(), &tm);
-        os << buf;
+        // 用被限流的调用点的文件和行号，方便找到是哪里
+        LogEvent::ptr event = LogEvent::Create(i.logger, LogLevel::WARN
+                , i.file ? i.file : __FILE__, i.file ? i.line : __LINE__, 0
+                , GetThreadId(), GetFiberId(), time(0), Thread::GetName());
+        if(i.file)
+        {
+            event->getSS() << "log rate limit: suppressed " << i.count
+                           << " records in " << i.ms << "ms";
+        }
+        else
+        {
+            event->getSS() << "logger " << i.logger->getName() << " over budget: suppressed "
+                           << i.count << " records in " << i.ms << "ms";
+        }
+        i.logger->write(LogLevel::WARN, event);
     }
+}
 
-private:
-    std::string m_format;
-};
+LogStreamBuf::LogStreamBuf()
+{
+    m_buf.resize(256);
+    setp(&m_buf[0], &m_buf[0] + m_buf.size());
+}
 
-/**
- * @brief   f:文件名
- */
-class FilenameFormatItem : public LogFormatter::FormatItem
+void LogStreamBuf::reset()
 {
-public:
-    FilenameFormatItem(const std::string& str = "") {}
+    setp(&m_buf[0], &m_buf[0] + m_buf.size());
+}
 
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+void LogStreamBuf::reserve(size_t n)
+{
+    if((size_t)(epptr() - pptr()) >= n)
     {
-        os << event->getFile();
+        return;
     }
-};
+    size_t used = size();
+    size_t cap = m_buf.size();
+    while(cap - used < n)
+    {
+        cap *= 2;
+    }
+    m_buf.resize(cap);
+    setp(&m_buf[0], &m_buf[0] + m_buf.size());
+    pbump(used);
+}
 
-/**
- * @brief   l:行号
- */
-class LineFormatItem : public LogFormatter::FormatItem
+LogStreamBuf::int_type LogStreamBuf::overflow(int_type c)
 {
-public:
-    LineFormatItem(const std::string& str = "") {}
-
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    if(traits_type::eq_int_type(c, traits_type::eof()))
     {
-        os << event->getLine();
+        return traits_type::not_eof(c);
     }
-};
+    reserve(1);
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    return c;
+}
 
-/**
- * @brief   T:Tab
- */
-class TabFormatItem : public LogFormatter::FormatItem
+std::streamsize LogStreamBuf::xsputn(const char* s, std::streamsize n)
 {
-public:
-    TabFormatItem(const std::string& str = "") {}
+    reserve(n);
+    memcpy(pptr(), s, n);
+    pbump(n);
+    return n;
+}
 
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
-    {
-        os << "\t";
-    }
-};
+/// 有几个二进制appender
+static std::atomic<int> s_log_args_capture = {0};
 
-/**
- * @brief   F:协程id
- */
-class FiberIdFormatItem : public LogFormatter::FormatItem
+void LogArgs::EnableCapture()
 {
-public:
-    FiberIdFormatItem(const std::string& str = "") {}
+    ++s_log_args_capture;
+}
 
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
-    {
-        os << event->getFiberId();
-    }
-};
+void LogArgs::DisableCapture()
+{
+    --s_log_args_capture;
+}
+
+bool LogArgs::IsCaptureEnabled()
+{
+    return s_log_args_capture.load(std::memory_order_relaxed) > 0;
+}
+
+namespace
+{
 
 /**
- * @brief   N:线程名称
+ * @brief   格式串里的一个转换说明
  */
-class ThreadNameFormatItem : public LogFormatter::FormatItem
+struct LogArgConversion
 {
-public:
-    ThreadNameFormatItem(const std::string& str = "") {}
-
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    enum Length
     {
-        os << event->getThreadName();
-    }
+        NONE,
+        HH,
+        H,
+        L,
+        LL,
+        J,
+        Z,
+        T,
+        LD,
+    };
+
+    const char* flags = nullptr;
+    int flagsLen = 0;
+    const char* width = nullptr;
+    int widthLen = 0;
+    bool widthStar = false;
+    bool hasPrecision = false;
+    const char* precision = nullptr;
+    int precisionLen = 0;
+    bool precisionStar = false;
+    /// 固定写在格式串里的精度，没有时为-1
+    int precisionValue = -1;
+    Length length = NONE;
+    char type = 0;
 };
 
 /**
- * @brief   直接打印字符串
+ * @brief   解析'%'后面的转换说明
+ *
+ * @return  返回转换字符后面的位置，格式不对返回nullptr
  */
-class StringFormatItem : public LogFormatter::FormatItem
+const char* ParseConversion(const char* p, LogArgConversion& conv)
 {
-public:
-    StringFormatItem(const std::string& str)
-        : m_string(str)
-    {}
+    conv = LogArgConversion();
+    conv.flags = p;
+    while(*p && strchr("-+ #0'", *p))
+    {
+        ++p;
+    }
+    conv.flagsLen = p - conv.flags;
 
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    conv.width = p;
+    if(*p == '*')
     {
-        os << m_string;
+        conv.widthStar = true;
+        ++p;
     }
+    else
+    {
+        while(isdigit(*p))
+        {
+            ++p;
+        }
+    }
+    conv.widthLen = p - conv.width;
 
-private:
-    std::string m_string;
-};
+    if(*p == '.')
+    {
+        conv.hasPrecision = true;
+        ++p;
+        conv.precision = p;
+        if(*p == '*')
+        {
+            conv.precisionStar = true;
+            ++p;
+        }
+        else
+        {
+            conv.precisionValue = 0;
+            while(isdigit(*p))
+            {
+                conv.precisionValue = conv.precisionValue * 10 + (*p - '0');
+                ++p;
+            }
+        }
+        conv.precisionLen = p - conv.precision;
+    }
 
-LogFormatter::LogFormatter(const std::string& pattern)
-    : m_pattern(pattern)
+    switch(*p)
+    {
+        case 'h':
+            ++p;
+            conv.length = LogArgConversion::H;
+            if(*p == 'h')
+            {
+                ++p;
+                conv.length = LogArgConversion::HH;
+            }
+            break;
+        case 'l':
+            ++p;
+            conv.length = LogArgConversion::L;
+            if(*p == 'l')
+            {
+                ++p;
+                conv.length = LogArgConversion::LL;
+            }
+            break;
+        case 'q':
+            ++p;
+            conv.length = LogArgConversion::LL;
+            break;
+        case 'j':
+            ++p;
+            conv.length = LogArgConversion::J;
+            break;
+        case 'z':
+            ++p;
+            conv.length = LogArgConversion::Z;
+            break;
+        case 't':
+            ++p;
+            conv.length = LogArgConversion::T;
+            break;
+        case 'L':
+            ++p;
+            conv.length = LogArgConversion::LD;
+            break;
+        default:
+            break;
+    }
+
+    if(!*p)
+    {
+        return nullptr;
+    }
+    conv.type = *p;
+    return p + 1;
+}
+
+template<class T>
+void PutArg(std::string& out, const T& v)
 {
-    init();
+    out.append((const char*)&v, sizeof(v));
 }
 
-std::string LogFormatter::format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+template<class T>
+bool TakeArg(const char*& p, const char* end, T& v)
 {
-    std::stringstream ss;
-    for(auto& i : m_items)
+    if((size_t)(end - p) < sizeof(v))
     {
-        i->format(ss, logger, level, event);
+        return false;
     }
-    return ss.str();
+    memcpy(&v, p, sizeof(v));
+    p += sizeof(v);
+    return true;
 }
 
-std::ostream& LogFormatter::format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+template<class T>
+void AppendFormat(std::string& out, const char* spec, T v)
 {
-    for(auto& i : m_items)
+    char buf[128];
+    int n = snprintf(buf, sizeof(buf), spec, v);
+    if(n < 0)
     {
-        i->format(ofs, logger, level, event);
+        return;
     }
-    return ofs;
+    if((size_t)n < sizeof(buf))
+    {
+        out.append(buf, n);
+        return;
+    }
+    size_t old = out.size();
+    out.resize(old + n + 1);
+    snprintf(&out[old], n + 1, spec, v);
+    out.resize(old + n);
 }
 
-/**
- * @brief   该日志器逻辑最复杂的函数：对日志样式进行解析。有如下四种格式：
- *          %xxx        是对xxx进行解析
- *          %xxx{yyy}   是对xxx进行解析，它是yyy这种格式的
- *          %%          是对%进行转义
- *          还有一种是直接要打印的字符串，比如[]这种。
- */
-void LogFormatter::init()  //%xxx %xxx{xxx} %%
+}
+
+bool LogArgs::Encode(const char* fmt, va_list al, std::string& out)
 {
-    //str, format, type
-    std::vector<std::tuple<std::string, std::string, int> > vec;    // 存放解析后的样式
-    std::string nstr;                                               // 存放实实在在的、并不是样式的字符串
-    for(size_t i = 0; i < m_pattern.size(); ++i)    // 循环解析每一个字符
+    const char* p = fmt;
+    LogArgConversion conv;
+    while((p = strchr(p, '%')))
     {
-        if(m_pattern[i] != '%')         // 当前字符不是%，就把它缓存到nstr
+        ++p;
+        if(*p == '%')
         {
-            nstr.append(1, m_pattern[i]);
+            ++p;
             continue;
         }
-        // 下面是等于%的情况
-
-
-        // 第i个和第i+1个都是%，那么就是转义，压一个%进nstr 
-        if((i + 1) < m_pattern.size()) 
+        p = ParseConversion(p, conv);
+        if(!p)
         {
-            if(m_pattern[i + 1] == '%') 
-            {
-                nstr.append(1, '%');
-                continue;
-            }
+            return false;
+        }
+        if(conv.widthStar)
+        {
+            PutArg(out, (int32_t)va_arg(al, int));
+        }
+        int precision = conv.precisionValue;
+        if(conv.precisionStar)
+        {
+            precision = va_arg(al, int);
+            PutArg(out, (int32_t)precision);
         }
 
-        size_t n = i + 1;               // 第i个是%，那么从i+1个字符开始解析
-        int fmt_status = 0;             // 解析方式：0是不需要解析格式，1是解析格式
-        size_t fmt_begin = 0;
-
-        std::string str;                // %xxx{yyy}中的xxx
-        std::string fmt;                // %xxx{yyy}中的yyy
-        while(n < m_pattern.size())     // 保证不越界
+        switch(conv.type)
         {
-            if(!fmt_status
-                    && (!isalpha(m_pattern[n])
-                        && m_pattern[n] != '{'
-                        && m_pattern[n] != '}'))    // 表示解析的就是%xxx格式，于是结束这一段样式的解析
+            case 'd':
+            case 'i':
             {
-                str = m_pattern.substr(i + 1, n - i - 1);
+                int64_t v = 0;
+                switch(conv.length)
+                {
+                    case LogArgConversion::HH: v = (signed char)va_arg(al, int); break;
+                    case LogArgConversion::H: v = (short)va_arg(al, int); break;
+                    case LogArgConversion::L: v = va_arg(al, long); break;
+                    case LogArgConversion::LL:
+                    case LogArgConversion::LD: v = va_arg(al, long long); break;
+                    case LogArgConversion::J: v = va_arg(al, intmax_t); break;
+                    case LogArgConversion::Z: v = va_arg(al, ssize_t); break;
+                    case LogArgConversion::T: v = va_arg(al, ptrdiff_t); break;
+                    default: v = va_arg(al, int); break;
+                }
+                PutArg(out, v);
                 break;
             }
-
-            if(fmt_status == 0) 
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
             {
-                if(m_pattern[n] == '{') // 需要解析格式
+                uint64_t v = 0;
+                switch(conv.length)
                 {
-                    str = m_pattern.substr(i + 1, n - i - 1);  // str即为xxx{yyy}中xxx
-                    fmt_status = 1;     // 解析格式
-                    fmt_begin = n;      // 记录需要解析格式的起始位置，即xxx{yyy}中的{的位置
-                    ++n;
-                    continue;
+                    case LogArgConversion::HH: v = (unsigned char)va_arg(al, unsigned int); break;
+                    case LogArgConversion::H: v = (unsigned short)va_arg(al, unsigned int); break;
+                    case LogArgConversion::L: v = va_arg(al, unsigned long); break;
+                    case LogArgConversion::LL:
+                    case LogArgConversion::LD: v = va_arg(al, unsigned long long); break;
+                    case LogArgConversion::J: v = va_arg(al, uintmax_t); break;
+                    case LogArgConversion::Z: v = va_arg(al, size_t); break;
+                    case LogArgConversion::T: v = va_arg(al, ptrdiff_t); break;
+                    default: v = va_arg(al, unsigned int); break;
                 }
+                PutArg(out, v);
+                break;
             }
-            else if(fmt_status == 1)    // 需要解析格式
-            {
-                if(m_pattern[n] == '}') // 结束yyy的查找了
+            case 'c':
+                if(conv.length != LogArgConversion::NONE)
                 {
-                    fmt = m_pattern.substr(fmt_begin + 1, n - fmt_begin - 1);   // fmt即为yyy
-                    fmt_status = 0;     // 重置状态为不需要解析格式
-                    ++n;
-                    break;              // 结束这一段样式的解析了
+                    return false;
                 }
-            }
-            ++n;
-            if(n == m_pattern.size())   // 已经到样式结尾了
+                PutArg(out, (int32_t)va_arg(al, int));
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                if(conv.length == LogArgConversion::LD)
+                {
+                    PutArg(out, va_arg(al, long double));
+                }
+                else
+                {
+                    PutArg(out, va_arg(al, double));
+                }
+                break;
+            case 's':
             {
-                if(str.empty())         // 如果样式为空的话，则样式即为第i+1个字符一直到结束，也就是只有一个样式或已经到了最后一个样式才有这种情况 
+                if(conv.length != LogArgConversion::NONE)
                 {
-                    str = m_pattern.substr(i + 1);
+                    return false;
+                }
+                const char* str = va_arg(al, const char*);
+                if(!str)
+                {
+                    str = "(null)";
                 }
+                // 有精度时字符串可以不以0结尾
+                uint32_t len = precision >= 0 ? strnlen(str, precision) : strlen(str);
+                PutArg(out, len);
+                out.append(str, len);
+                break;
             }
+            case 'p':
+                PutArg(out, (uint64_t)(uintptr_t)va_arg(al, void*));
+                break;
+            default:
+                return false;
         }
+    }
+    return true;
+}
 
-        if(fmt_status == 0)
+bool LogArgs::Decode(const char* fmt, const char* data, size_t len, std::string& out)
+{
+    const char* end = data + len;
+    const char* p = fmt;
+    LogArgConversion conv;
+    std::string spec;
+    std::string str;
+    while(*p)
+    {
+        const char* pct = strchr(p, '%');
+        if(!pct)
         {
-            if(!nstr.empty())   // 如果nstr不为空，则证明是nstr是要打印的字符串，所以以string()的样式存到vector里面去
+            out.append(p);
+            break;
+        }
+        out.append(p, pct - p);
+        p = pct + 1;
+        if(*p == '%')
+        {
+            out.append(1, '%');
+            ++p;
+            continue;
+        }
+        p = ParseConversion(p, conv);
+        if(!p)
+        {
+            return false;
+        }
+
+        // 重新拼出这个转换说明，'*'换成实际的值
+        spec.assign(1, '%');
+        spec.append(conv.flags, conv.flagsLen);
+        if(conv.widthStar)
+        {
+            int32_t width = 0;
+            if(!TakeArg(data, end, width))
             {
-                vec.push_back(std::make_tuple(nstr, std::string(), 0));
-                nstr.clear();
+                return false;
             }
-            vec.push_back(std::make_tuple(str, fmt, 1));
-            i = n - 1;          // n-1再进入下一轮循环
+            spec.append(std::to_string(width));
         }
-        else if(fmt_status == 1) // 因为上面会重置，因此此时还是1，证明解析样式有错误
+        else
         {
-            std::cout << "pattern parse error: " << m_pattern << " - " << m_pattern.substr(i) << std::endl;
-            m_error = true;
-            vec.push_back(std::make_tuple("<<pattern_error>>", fmt, 0));
+            spec.append(conv.width, conv.widthLen);
         }
-    } // 这里已经是解析完成
-
-    if(!nstr.empty())   // 解析完成后，nstr有值，证明其是要打印的字符串，则以string的形式存到vector里面去
-    {
-        vec.push_back(std::make_tuple(nstr, "", 0));
-    }
-    static std::map<std::string, std::function<FormatItem::ptr(const std::string& str)> > s_format_items = {
-#define XX(str, C) \
-        {#str, [](const std::string& fmt) { return FormatItem::ptr(new C(fmt));}}
-
-        XX(m, MessageFormatItem),           // m:消息 
-        XX(p, LevelFormatItem),             // p:日志级别
-        XX(r, ElapseFormatItem),            // r:累计毫秒数
-        XX(c, NameFormatItem),              // c:日志名称
-        XX(t, ThreadIdFormatItem),          // t:线程id
-        XX(n, NewLineFormatItem),           // n:换行
-        XX(d, DateTimeFormatItem),          // d:时间
-        XX(f, FilenameFormatItem),          // f:文件名
-        XX(l, LineFormatItem),              // l:行号
-        XX(T, TabFormatItem),               // T:Tab
-        XX(F, FiberIdFormatItem),           // F:协程id
-        XX(N, ThreadNameFormatItem),        // N:线程名称
-#undef XX
-    };
-
-    for(auto& i : vec) 
-    {
-        if(std::get<2>(i) == 0)         // 也就是type为0，证明要打印的是字符串，并不是样式，因此解析为StringFormatItem，直接打印即可。
+        if(conv.precisionStar)
         {
-            m_items.push_back(FormatItem::ptr(new StringFormatItem(std::get<0>(i))));
-        } 
-        else 
+            int32_t precision = 0;
+            if(!TakeArg(data, end, precision))
+            {
+                return false;
+            }
+            if(precision >= 0)
+            {
+                spec.append(1, '.');
+                spec.append(std::to_string(precision));
+            }
+        }
+        else if(conv.hasPrecision)
         {
-            auto it = s_format_items.find(std::get<0>(i));  // 也就是xxx{yyy}中的xxx，这正式要解析的
-            if(it == s_format_items.end()) 
+            spec.append(1, '.');
+            spec.append(conv.precision, conv.precisionLen);
+        }
+
+        switch(conv.type)
+        {
+            case 'd':
+            case 'i':
             {
-                m_items.push_back(FormatItem::ptr(new StringFormatItem("<<error_format %" + std::get<0>(i) + ">>")));
-                m_error = true;
+                int64_t v = 0;
+                if(!TakeArg(data, end, v))
+                {
+                    return false;
+                }
+                spec.append("ll");
+                spec.append(1, conv.type);
+                AppendFormat(out, spec.c_str(), (long long)v);
+                break;
             }
-            else // 一般来说，fmt是空的，只有xxx{yyy}这种情况才不是空，fmt即yyy，比如时间，xxx就是d，用来new出DateTimeFormatItem，而yyy可能是hh::mm:ss这种。
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
             {
-                m_items.push_back(it->second(std::get<1>(i)));
+                uint64_t v = 0;
+                if(!TakeArg(data, end, v))
+                {
+                    return false;
+                }
+                spec.append("ll");
+                spec.append(1, conv.type);
+                AppendFormat(out, spec.c_str(), (unsigned long long)v);
+                break;
+            }
+            case 'c':
+            {
+                int32_t v = 0;
+                if(!TakeArg(data, end, v))
+                {
+                    return false;
+                }
+                spec.append(1, 'c');
+                AppendFormat(out, spec.c_str(), (int)v);
+                break;
+            }
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                if(conv.length == LogArgConversion::LD)
+                {
+                    long double v = 0;
+                    if(!TakeArg(data, end, v))
+                    {
+                        return false;
+                    }
+                    spec.append(1, 'L');
+                    spec.append(1, conv.type);
+                    AppendFormat(out, spec.c_str(), v);
+                }
+                else
+                {
+                    double v = 0;
+                    if(!TakeArg(data, end, v))
+                    {
+                        return false;
+                    }
+                    spec.append(1, conv.type);
+                    AppendFormat(out, spec.c_str(), v);
+                }
+                break;
+            case 's':
+            {
+                uint32_t n = 0;
+                if(!TakeArg(data, end, n) || (size_t)(end - data) < n)
+                {
+                    return false;
+                }
+                str.assign(data, n);
+                data += n;
+                spec.append(1, 's');
+                AppendFormat(out, spec.c_str(), str.c_str());
+                break;
+            }
+            case 'p':
+            {
+                uint64_t v = 0;
+                if(!TakeArg(data, end, v))
+                {
+                    return false;
+                }
+                spec.append(1, 'p');
+                AppendFormat(out, spec.c_str(), (void*)(uintptr_t)v);
+                break;
             }
+            default:
+                return false;
         }
     }
+    return true;
 }
 
-void LogAppender::setFormatter(LogFormatter::ptr val)
+static const std::string& TraceIdKey()
 {
-    MutexType::Lock lk(m_mutex);
-    m_formatter = val;
-    if(m_formatter = val)
-    {
-        m_hasFormatter = true;
-    }
-    else
-    {
-        m_hasFormatter = false;
-    }
+    static const std::string s_key("trace_id");
+    return s_key;
 }
 
-LogFormatter::ptr LogAppender::getFormatter()
+std::string GetTraceId()
 {
-    MutexType::Lock lk(m_mutex);
-    return m_formatter;
+    const std::string* v = Fiber::FindLocal(TraceIdKey());
+    return v ? *v : std::string();
 }
 
-void StdoutLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+void SetTraceId(const std::string& v)
 {
-    if(level >= m_level)
-    {
-        MutexType::Lock lk(m_mutex);
-        m_formatter->format(std::cout, logger, level, event);
-    }
+    Fiber::SetLocal(TraceIdKey(), v);
 }
 
-std::string StdoutLogAppender::toYamlString()
+LogEvent::ptr LogEvent::Create(std::shared_ptr<Logger> logger,
+        LogLevel::Level level,
+        const char* file,
+        int32_t line,
+        uint32_t elapse,
+        uint32_t threadId,
+        uint32_t fiberId,
+        uint64_t time,
+        const std::string& threadName)
+{
+    static thread_local LogEvent::ptr t_event;
+    if(t_event && t_event.use_count() == 1)
+    {
+        t_event->reset(logger, level, file, line, elapse, threadId, fiberId, time, threadName);
+        return t_event;
+    }
+    LogEvent::ptr event(new LogEvent(logger, level, file, line, elapse
+                , threadId, fiberId, time, threadName));
+    if(!t_event)
+    {
+        t_event = event;
+    }
+    return event;
+}
+
+LogEvent::LogEvent(std::shared_ptr<Logger> logger, 
+        LogLevel::Level level,
+        const char* file,
+        int32_t line,
+        uint32_t elapse,
+        uint32_t threadId,
+        uint32_t fiberId,
+        uint64_t time,
+        const std::string& threadName)
+    : m_logger(logger)
+    , m_level(level)
+    , m_file(file)
+    , m_line(line)
+    , m_elapse(elapse)
+    , m_threadId(threadId)
+    , m_fiberId(fiberId)
+    , m_time(time)
+    , m_threadName(threadName)
+    , m_ss(&m_buf)
+{
+    const std::string* trace_id = Fiber::FindLocal(TraceIdKey());
+    if(trace_id)
+    {
+        m_traceId = *trace_id;
+    }
+}
+
+void LogEvent::reset(std::shared_ptr<Logger> logger, LogLevel::Level level, const char* file
+                     , int32_t line, uint32_t elapse, uint32_t threadId, uint32_t fiberId
+                     , uint64_t time, const std::string& threadName)
+{
+    m_logger.swap(logger);
+    m_level = level;
+    m_file = file;
+    m_line = line;
+    m_elapse = elapse;
+    m_threadId = threadId;
+    m_fiberId = fiberId;
+    m_time = time;
+    m_threadName = threadName;
+    const std::string* trace_id = Fiber::FindLocal(TraceIdKey());
+    if(trace_id)
+    {
+        m_traceId = *trace_id;
+    }
+    else
+    {
+        m_traceId.clear();
+    }
+    m_buf.reset();
+    m_fmt = nullptr;
+    m_args.clear();
+    // 上一条日志可能改过std::hex、setprecision之类的状态
+    m_ss.clear();
+    m_ss.flags(std::ios_base::dec | std::ios_base::skipws);
+    m_ss.precision(6);
+    m_ss.width(0);
+    m_ss.fill(' ');
+}
+
+void LogEvent::format(const char* fmt, ...)
+{
+    va_list al;
+    va_start(al, fmt);
+    format(fmt, al);
+    va_end(al);
+}
+
+void LogEvent::format(const char* fmt, va_list al)
+{
+    if(!m_fmt && m_buf.size() == 0 && LogArgs::IsCaptureEnabled())
+    {
+        // 只保存原始参数，用到文本时再格式化
+        va_list ap;
+        va_copy(ap, al);
+        bool ok = LogArgs::Encode(fmt, ap, m_args);
+        va_end(ap);
+        if(ok)
+        {
+            m_fmt = fmt;
+            return;
+        }
+        m_args.clear();
+    }
+    materialize();
+
+    // 先格式化到栈上，放不下再分配
+    char tmp[512];
+    va_list ap;
+    va_copy(ap, al);
+    int len = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    if(len < 0)
+    {
+        return;
+    }
+    if((size_t)len < sizeof(tmp))
+    {
+        m_ss.write(tmp, len);
+        return;
+    }
+
+    char* buf = nullptr;
+    len = vasprintf(&buf, fmt, al);
+    if(len != -1)
+    {
+        m_ss.write(buf, len);
+        free(buf);
+    }
+}
+
+void LogEvent::decodeArgs()
+{
+    static thread_local std::string t_text;
+    t_text.clear();
+    const char* fmt = m_fmt;
+    m_fmt = nullptr;
+    LogArgs::Decode(fmt, m_args.data(), m_args.size(), t_text);
+    m_ss.write(t_text.c_str(), t_text.size());
+}
+
+LogEventWrap::LogEventWrap(LogEvent::ptr e)
+    : m_event(e)
+{
+
+}
+
+LogEventWrap::~LogEventWrap()
+{
+    m_event->getLogger()->log(m_event->getLevel(), m_event);
+}
+
+std::ostream& LogEventWrap::getSS()
+{
+    return m_event->getSS();
+}
+
+/**
+ * @brief   m:消息
+ */
+class  MessageFormatItem : public LogFormatter::FormatItem
+{
+public:
+    MessageFormatItem(const std::string& str = "") {}
+
+    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        os << event->getContent();
+    }
+};
+
+/**
+ * @brief   p:日志级别
+ */
+class LevelFormatItem : public LogFormatter::FormatItem
+{
+public:
+    LevelFormatItem(const std::string& str = "") {}
+
+    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        os << LogLevel::ToString(level);
+    }
+};
+
+/**
+ * @brief   r:累计毫秒数
+ */
+class ElapseFormatItem : public LogFormatter::FormatItem
+{
+public:
+    ElapseFormatItem(const std::string& str = "") {}
+
+    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        os << event->getElapse();
+    }
+};
+
+/**
+ * @brief   c:日志名称
+ */
+class NameFormatItem : public LogFormatter::FormatItem
+{
+public:
+    NameFormatItem(const std::string& str = "") {}
+
+    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        os << event->getLogger()->getName();
+    }
+};
+
+/**
+ * @brief   t:线程id
+ */
+class ThreadIdFormatItem : public LogFormatter::FormatItem
+{
+public:
+    ThreadIdFormatItem(const std::string& str = "") {}
+
+    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        os << event->getThreadId();
+    }
+};
+
+/**
+ * @brief   n:换行
+ */
+class NewLineFormatItem : public LogFormatter::FormatItem
+{
+public:
+    NewLineFormatItem(const std::string& str = "") {}
+
+    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        os << std::endl;
+    }
+};
+
+/**
+ * @brief   d:时间
+ */
+class DateTimeFormatItem : public LogFormatter::FormatItem
+{
+public:
+    DateTimeFormatItem(const std::string& format = "%Y-%m-%d %H:%M:%S")
+        : m_format(format)
+    {
+        if(m_format.empty())
+        {
+            m_format = "%Y-%m-%d %H:%M:%S";
+        }
+    }
+
+    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        struct tm tm;
+        time_t time = event->getTime();
+        localtime_r(&time, &tm);
+        char buf[64];
+        strftime(buf, sizeof(buf), m_format.c_str(), &tm);
+        os << buf;
+    }
+
+private:
+    std::string m_format;
+};
+
+/**
+ * @brief   f:文件名
+ */
+class FilenameFormatItem : public LogFormatter::FormatItem
+{
+public:
+    FilenameFormatItem(const std::string& str = "") {}
+
+    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        os << event->getFile();
+    }
+};
+
+/**
+ * @brief   l:行号
+ */
+class LineFormatItem : public LogFormatter::FormatItem
+{
+public:
+    LineFormatItem(const std::string& str = "") {}
+
+    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        os << event->getLine();
+    }
+};
+
+/**
+ * @brief   T:Tab
+ */
+class TabFormatItem : public LogFormatter::FormatItem
+{
+public:
+    TabFormatItem(const std::string& str = "") {}
+
+    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        os << "\t";
+    }
+};
+
+/**
+ * @brief   F:协程id
+ */
+class FiberIdFormatItem : public LogFormatter::FormatItem
+{
+public:
+    FiberIdFormatItem(const std::string& str = "") {}
+
+    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        os << event->getFiberId();
+    }
+};
+
+/**
+ * @brief   N:线程名称
+ */
+class ThreadNameFormatItem : public LogFormatter::FormatItem
+{
+public:
+    ThreadNameFormatItem(const std::string& str = "") {}
+
+    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        os << event->getThreadName();
+    }
+};
+
+/**
+ * @brief   R:trace id
+ */
+class TraceIdFormatItem : public LogFormatter::FormatItem
+{
+public:
+    TraceIdFormatItem(const std::string& str = "") {}
+
+    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        os << event->getTraceId();
+    }
+};
+
+/**
+ * @brief   直接打印字符串
+ */
+class StringFormatItem : public LogFormatter::FormatItem
+{
+public:
+    StringFormatItem(const std::string& str)
+        : m_string(str)
+    {}
+
+    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        os << m_string;
+    }
+
+private:
+    std::string m_string;
+};
+
+static std::atomic<uint64_t> s_log_formatter_id = {0};
+
+LogFormatter::LogFormatter(const std::string& pattern)
+    : m_pattern(pattern)
+    , m_id(++s_log_formatter_id)
+    , m_error(false)
+{
+    init();
+}
+
+std::string LogFormatter::format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+{
+    std::string out;
+    format(out, logger, level, event);
+    return out;
+}
+
+/**
+ * @brief   追加无符号整数
+ */
+static inline void AppendUInt(std::string& out, uint64_t v)
+{
+    char tmp[24];
+    char* end = tmp + sizeof(tmp);
+    char* p = end;
+    do
+    {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while(v);
+    out.append(p, end - p);
+}
+
+/**
+ * @brief   每个线程缓存几个格式化好的时间，key是(格式器id, 指令下标)
+ */
+struct LogTimeCache
+{
+    uint64_t key = 0;
+    time_t sec = -1;
+    size_t len = 0;
+    char buf[64];
+};
+
+static const size_t s_log_time_cache_size = 4;
+
+static void AppendTime(std::string& out, uint64_t key, const std::string& fmt, time_t sec)
+{
+    static thread_local LogTimeCache t_caches[s_log_time_cache_size];
+    static thread_local size_t t_next = 0;
+    LogTimeCache* cache = nullptr;
+    for(auto& i : t_caches)
+    {
+        if(i.key == key)
+        {
+            cache = &i;
+            break;
+        }
+    }
+    if(!cache)
+    {
+        cache = &t_caches[t_next++ % s_log_time_cache_size];
+        cache->key = key;
+        cache->sec = -1;
+    }
+    if(cache->sec != sec)
+    {
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        cache->len = strftime(cache->buf, sizeof(cache->buf), fmt.c_str(), &tm);
+        cache->sec = sec;
+    }
+    out.append(cache->buf, cache->len);
+}
+
+void LogFormatter::format(std::string& out, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event)
+{
+    for(size_t i = 0; i < m_ops.size(); ++i)
+    {
+        const Op& op = m_ops[i];
+        switch(op.type)
+        {
+            case Op::STRING:
+                out.append(m_strings[op.arg]);
+                break;
+            case Op::MESSAGE:
+                out.append(event->getContentData(), event->getContentSize());
+                break;
+            case Op::LEVEL:
+                out.append(LogLevel::ToString(level));
+                break;
+            case Op::ELAPSE:
+                AppendUInt(out, event->getElapse());
+                break;
+            case Op::NAME:
+                out.append(event->getLogger()->getName());
+                break;
+            case Op::THREAD_ID:
+                AppendUInt(out, event->getThreadId());
+                break;
+            case Op::NEWLINE:
+                out.append(1, '\n');
+                break;
+            case Op::DATETIME:
+                AppendTime(out, (m_id << 8) | (i & 0xff), m_strings[op.arg], event->getTime());
+                break;
+            case Op::FILENAME:
+                out.append(event->getFile());
+                break;
+            case Op::LINE:
+                AppendUInt(out, event->getLine());
+                break;
+            case Op::TAB:
+                out.append(1, '\t');
+                break;
+            case Op::FIBER_ID:
+                AppendUInt(out, event->getFiberId());
+                break;
+            case Op::THREAD_NAME:
+                out.append(event->getThreadName());
+                break;
+            case Op::TRACE_ID:
+                out.append(event->getTraceId());
+                break;
+        }
+    }
+}
+
+bool LogFormatter::compile(const std::string& str, const std::string& fmt)
+{
+    static const std::map<std::string, Op::Type> s_ops = {
+        {"m", Op::MESSAGE},
+        {"p", Op::LEVEL},
+        {"r", Op::ELAPSE},
+        {"c", Op::NAME},
+        {"t", Op::THREAD_ID},
+        {"n", Op::NEWLINE},
+        {"d", Op::DATETIME},
+        {"f", Op::FILENAME},
+        {"l", Op::LINE},
+        {"T", Op::TAB},
+        {"F", Op::FIBER_ID},
+        {"N", Op::THREAD_NAME},
+        {"R", Op::TRACE_ID},
+    };
+    auto it = s_ops.find(str);
+    if(it == s_ops.end())
+    {
+        return false;
+    }
+    Op op;
+    op.type = it->second;
+    op.arg = 0;
+    if(op.type == Op::DATETIME)
+    {
+        op.arg = m_strings.size();
+        m_strings.push_back(fmt.empty() ? "%Y-%m-%d %H:%M:%S" : fmt);
+    }
+    m_ops.push_back(op);
+    return true;
+}
+
+std::ostream& LogFormatter::format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+{
+    for(auto& i : m_items)
+    {
+        i->format(ofs, logger, level, event);
+    }
+    return ofs;
+}
+
+/**
+ * @brief   该日志器逻辑最复杂的函数：对日志样式进行解析。有如下四种格式：
+ *          %xxx        是对xxx进行解析
+ *          %xxx{yyy}   是对xxx进行解析，它是yyy这种格式的
+ *          %%          是对%进行转义
+ *          还有一种是直接要打印的字符串，比如[]这种。
+ */
+void LogFormatter::init()  //%xxx %xxx{xxx} %%
+{
+    //str, format, type
+    std::vector<std::tuple<std::string, std::string, int> > vec;    // 存放解析后的样式
+    std::string nstr;                                               // 存放实实在在的、并不是样式的字符串
+    for(size_t i = 0; i < m_pattern.size(); ++i)    // 循环解析每一个字符
+    {
+        if(m_pattern[i] != '%')         // 当前字符不是%，就把它缓存到nstr
+        {
+            nstr.append(1, m_pattern[i]);
+            continue;
+        }
+        // 下面是等于%的情况
+
+
+        // 第i个和第i+1个都是%，那么就是转义，压一个%进nstr 
+        if((i + 1) < m_pattern.size()) 
+        {
+            if(m_pattern[i + 1] == '%') 
+            {
+                nstr.append(1, '%');
+                continue;
+            }
+        }
+
+        size_t n = i + 1;               // 第i个是%，那么从i+1个字符开始解析
+        int fmt_status = 0;             // 解析方式：0是不需要解析格式，1是解析格式
+        size_t fmt_begin = 0;
+
+        std::string str;                // %xxx{yyy}中的xxx
+        std::string fmt;                // %xxx{yyy}中的yyy
+        while(n < m_pattern.size())     // 保证不越界
+        {
+            if(!fmt_status
+                    && (!isalpha(m_pattern[n])
+                        && m_pattern[n] != '{'
+                        && m_pattern[n] != '}'))    // 表示解析的就是%xxx格式，于是结束这一段样式的解析
+            {
+                str = m_pattern.substr(i + 1, n - i - 1);
+                break;
+            }
+
+            if(fmt_status == 0) 
+            {
+                if(m_pattern[n] == '{') // 需要解析格式
+                {
+                    str = m_pattern.substr(i + 1, n - i - 1);  // str即为xxx{yyy}中xxx
+                    fmt_status = 1;     // 解析格式
+                    fmt_begin = n;      // 记录需要解析格式的起始位置，即xxx{yyy}中的{的位置
+                    ++n;
+                    continue;
+                }
+            }
+            else if(fmt_status == 1)    // 需要解析格式
+            {
+                if(m_pattern[n] == '}') // 结束yyy的查找了
+                {
+                    fmt = m_pattern.substr(fmt_begin + 1, n - fmt_begin - 1);   // fmt即为yyy
+                    fmt_status = 0;     // 重置状态为不需要解析格式
+                    ++n;
+                    break;              // 结束这一段样式的解析了
+                }
+            }
+            ++n;
+            if(n == m_pattern.size())   // 已经到样式结尾了
+            {
+                if(str.empty())         // 如果样式为空的话，则样式即为第i+1个字符一直到结束，也就是只有一个样式或已经到了最后一个样式才有这种情况 
+                {
+                    str = m_pattern.substr(i + 1);
+                }
+            }
+        }
+
+        if(fmt_status == 0)
+        {
+            if(!nstr.empty())   // 如果nstr不为空，则证明是nstr是要打印的字符串，所以以string()的样式存到vector里面去
+            {
+                vec.push_back(std::make_tuple(nstr, std::string(), 0));
+                nstr.clear();
+            }
+            vec.push_back(std::make_tuple(str, fmt, 1));
+            i = n - 1;          // n-1再进入下一轮循环
+        }
+        else if(fmt_status == 1) // 因为上面会重置，因此此时还是1，证明解析样式有错误
+        {
+            std::cout << "pattern parse error: " << m_pattern << " - " << m_pattern.substr(i) << std::endl;
+            m_error = true;
+            vec.push_back(std::make_tuple("<<pattern_error>>", fmt, 0));
+        }
+    } // 这里已经是解析完成
+
+    if(!nstr.empty())   // 解析完成后，nstr有值，证明其是要打印的字符串，则以string的形式存到vector里面去
+    {
+        vec.push_back(std::make_tuple(nstr, "", 0));
+    }
+    static std::map<std::string, std::function<FormatItem::ptr(const std::string& str)> > s_format_items = {
+#define XX(str, C) \
+        {#str, [](const std::string& fmt) { return FormatItem::ptr(new C(fmt));}}
+
+        XX(m, MessageFormatItem),           // m:消息 
+        XX(p, LevelFormatItem),             // p:日志级别
+        XX(r, ElapseFormatItem),            // r:累计毫秒数
+        XX(c, NameFormatItem),              // c:日志名称
+        XX(t, ThreadIdFormatItem),          // t:线程id
+        XX(n, NewLineFormatItem),           // n:换行
+        XX(d, DateTimeFormatItem),          // d:时间
+        XX(f, FilenameFormatItem),          // f:文件名
+        XX(l, LineFormatItem),              // l:行号
+        XX(T, TabFormatItem),               // T:Tab
+        XX(F, FiberIdFormatItem),           // F:协程id
+        XX(N, ThreadNameFormatItem),        // N:线程名称
+        XX(R, TraceIdFormatItem),           // R:trace id
+#undef XX
+    };
+
+    for(auto& i : vec) 
+    {
+        std::string str;    // 编译成STRING指令的字符串
+        if(std::get<2>(i) == 0)         // 也就是type为0，证明要打印的是字符串，并不是样式，因此解析为StringFormatItem，直接打印即可。
+        {
+            m_items.push_back(FormatItem::ptr(new StringFormatItem(std::get<0>(i))));
+            str = std::get<0>(i);
+        } 
+        else 
+        {
+            auto it = s_format_items.find(std::get<0>(i));  // 也就是xxx{yyy}中的xxx，这正式要解析的
+            if(it == s_format_items.end()) 
+            {
+                m_items.push_back(FormatItem::ptr(new StringFormatItem("<<error_format %" + std::get<0>(i) + ">>")));
+                m_error = true;
+                str = "<<error_format %" + std::get<0>(i) + ">>";
+            }
+            else // 一般来说，fmt是空的，只有xxx{yyy}这种情况才不是空，fmt即yyy，比如时间，xxx就是d，用来new出DateTimeFormatItem，而yyy可能是hh::mm:ss这种。
+            {
+                m_items.push_back(it->second(std::get<1>(i)));
+                compile(std::get<0>(i), std::get<1>(i));
+                continue;
+            }
+        }
+
+        // 相邻的字符串合成一条指令
+        if(!m_ops.empty() && m_ops.back().type == Op::STRING)
+        {
+            m_strings[m_ops.back().arg].append(str);
+        }
+        else
+        {
+            Op op;
+            op.type = Op::STRING;
+            op.arg = m_strings.size();
+            m_strings.push_back(str);
+            m_ops.push_back(op);
+        }
+    }
+}
+
+void LogAppender::setFormatter(LogFormatter::ptr val)
+{
+    MutexType::Lock lk(m_mutex);
+    m_formatter = val;
+    if(m_formatter = val)
+    {
+        m_hasFormatter = true;
+    }
+    else
+    {
+        m_hasFormatter = false;
+    }
+}
+
+LogFormatter::ptr LogAppender::getFormatter()
+{
+    MutexType::Lock lk(m_mutex);
+    return m_formatter;
+}
+
+bool LogAppender::logAsync(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+{
+    if(!AsyncLogBackend::IsEnabled())
+    {
+        return false;
+    }
+    // 格式化用的缓冲每个线程一个，反复使用
+    static thread_local std::string t_buf;
+    t_buf.clear();
+    getFormatter()->format(t_buf, logger, level, event);
+    m_asyncUsed = true;
+    AsyncLogBackend* backend = AsyncLogBackend::GetInstance();
+    if(backend->push(this, level, t_buf.c_str(), t_buf.size()))
+    {
+        return true;
+    }
+    // 要同步写，先等缓冲里的写完，保持顺序
+    backend->flush();
+    return false;
+}
+
+void LogAppender::flushAsync()
+{
+    if(m_asyncUsed)
+    {
+        AsyncLogBackend::GetInstance()->flush();
+    }
+}
+
+StdoutLogAppender::~StdoutLogAppender()
+{
+    flushAsync();
+}
+
+void StdoutLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+{
+    if(level >= m_level)
+    {
+        if(logAsync(logger, level, event))
+        {
+            return;
+        }
+        static thread_local std::string t_buf;
+        t_buf.clear();
+        getFormatter()->format(t_buf, logger, level, event);
+        MutexType::Lock lk(m_mutex);
+        std::cout.write(t_buf.c_str(), t_buf.size());
+        std::cout.flush();
+    }
+}
+
+void StdoutLogAppender::writeBatch(const iovec* buffers, int count)
+{
+    MutexType::Lock lk(m_mutex);
+    std::cout.flush();
+    WriteFully(STDOUT_FILENO, buffers, count);
+}
+
+std::string StdoutLogAppender::toYamlString()
+{
+    MutexType::Lock lk(m_mutex);
+    YAML::Node node;
+    node["type"] = "StdoutLogAppender";
+    if(m_level != LogLevel::UNKNOW)
+    {
+        node["level"] = LogLevel::ToString(m_level);
+    }
+    if(m_hasFormatter && m_formatter)
+    {
+        node["formatter"] = m_formatter->getPattern();
+    }
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
+
+FileLogAppender::FileLogAppender(const std::string& filename)
+    : m_filename(filename)
+    , m_lastTime(0)
+{
+    reopen();
+}
+
+FileLogAppender::~FileLogAppender()
+{
+    flushAsync();
+    if(m_fd >= 0)
+    {
+        ::close(m_fd);
+    }
+}
+
+void FileLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+{
+    if(level >= m_level)
+    {
+        if(logAsync(logger, level, event))
+        {
+            return;
+        }
+        static thread_local std::string t_buf;
+        t_buf.clear();
+        getFormatter()->format(t_buf, logger, level, event);
+        iovec iov;
+        iov.iov_base = (void*)t_buf.c_str();
+        iov.iov_len = t_buf.size();
+        writeBatch(&iov, 1);
+    }
+}
+
+void FileLogAppender::writeBatch(const iovec* buffers, int count)
+{
+    size_t len = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        len += buffers[i].iov_len;
+    }
+    MutexType::Lock lk(m_mutex);
+    prepareWrite(time(0), len);
+    if(m_fd < 0)
+    {
+        std::cout << "error" << std::endl;
+        return;
+    }
+    WriteFully(m_fd, buffers, count);
+    m_fileSize += len;
+}
+
+void FileLogAppender::prepareWrite(uint64_t now, size_t len)
+{
+    if(now == m_lastTime)
+    {
+        return;
+    }
+    m_lastTime = now;
+    struct stat st;
+    if(m_fd < 0 || ::stat(m_filename.c_str(), &st) != 0
+            || st.st_ino != m_ino || st.st_dev != m_dev)
+    {
+        // 文件被移走或者删除了(比如外部的logrotate)，重新打开
+        openFile();
+    }
+}
+
+std::string FileLogAppender::toYamlString()
+{
+    MutexType::Lock lk(m_mutex);
+    YAML::Node node;
+    node["type"] = "FileLogAppender";
+    node["file"] = m_filename;
+    if(m_level != LogLevel::UNKNOW)
+    {
+        node["level"] = LogLevel::ToString(m_level);
+    }
+    if(m_hasFormatter && m_formatter)
+    {
+        node["formatter"] = m_formatter->getPattern();
+    }
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
+
+bool FileLogAppender::reopen()
+{
+    MutexType::Lock lk(m_mutex);
+    return openFile();
+}
+
+bool FileLogAppender::openFile()
+{
+    int fd = ::open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        FSUtil::Mkdir(FSUtil::Dirname(m_filename));
+        fd = ::open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+    if(m_fd >= 0)
+    {
+        ::close(m_fd);
+    }
+    m_fd = fd;
+    m_openTime = time(0);
+    m_fileSize = 0;
+    struct stat st;
+    if(m_fd >= 0 && fstat(m_fd, &st) == 0)
+    {
+        m_dev = st.st_dev;
+        m_ino = st.st_ino;
+        m_fileSize = st.st_size;
+    }
+    return m_fd >= 0;
+}
+
+namespace
+{
+
+/**
+ * @brief   切分出来的日志文件的后台处理：压缩、删除多余的旧文件
+ * @details 第一次切分时创建，不析构
+ */
+class LogRotateWorker
+{
+public:
+    struct Task
+    {
+        /// 切出来的文件
+        std::string file;
+        /// 日志文件名
+        std::string base;
+        uint32_t maxFiles;
+        bool compress;
+    };
+
+    static LogRotateWorker* GetInstance()
+    {
+        static LogRotateWorker* s_instance = new LogRotateWorker;
+        return s_instance;
+    }
+
+    void push(const Task& task)
+    {
+        {
+            Mutex::Lock lk(m_mutex);
+            m_tasks.push_back(task);
+        }
+        m_sem.notify();
+    }
+
+private:
+    LogRotateWorker()
+    {
+        m_thread.reset(new Thread(std::bind(&LogRotateWorker::run, this), "log_rotate"));
+    }
+
+    void run()
+    {
+        while(true)
+        {
+            m_sem.wait();
+            Task task;
+            {
+                Mutex::Lock lk(m_mutex);
+                task = m_tasks.front();
+                m_tasks.pop_front();
+            }
+            if(task.compress && !task.file.empty())
+            {
+                Gzip(task.file, task.file + ".gz");
+            }
+            if(task.maxFiles)
+            {
+                RemoveOldFiles(task.base, task.maxFiles);
+            }
+        }
+    }
+
+    /**
+     * @brief   压缩到dst.tmp，成功后改名为dst并删除src
+     */
+    static bool Gzip(const std::string& src, const std::string& dst)
+    {
+        int fd = ::open(src.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+        {
+            return false;
+        }
+        std::string tmp = dst + ".tmp";
+        gzFile gz = gzopen(tmp.c_str(), "wb6");
+        if(!gz)
+        {
+            ::close(fd);
+            return false;
+        }
+        bool ok = true;
+        char buf[64 * 1024];
+        ssize_t n = 0;
+        while((n = ::read(fd, buf, sizeof(buf))) > 0)
+        {
+            if(gzwrite(gz, buf, n) != n)
+            {
+                ok = false;
+                break;
+            }
+        }
+        ::close(fd);
+        if(gzclose(gz) != Z_OK || n < 0)
+        {
+            ok = false;
+        }
+        if(!ok || ::rename(tmp.c_str(), dst.c_str()) != 0)
+        {
+            std::cout << "compress rotated log " << src << " error" << std::endl;
+            ::unlink(tmp.c_str());
+            return false;
+        }
+        ::unlink(src.c_str());
+        return true;
+    }
+
+    /**
+     * @brief   切出来的文件(日志文件名.时间[.序号][.gz])只保留最新的max_files个
+     */
+    static void RemoveOldFiles(const std::string& base, uint32_t max_files)
+    {
+        std::string dir = FSUtil::Dirname(base);
+        size_t pos = base.rfind('/');
+        std::string prefix = (pos == std::string::npos ? base : base.substr(pos + 1)) + ".";
+
+        std::vector<std::string> all;
+        FSUtil::ListAllFile(all, dir, "");
+        std::vector<std::string> files;
+        for(auto& i : all)
+        {
+            if(FSUtil::Dirname(i) != dir)
+            {
+                continue;
+            }
+            std::string name = i.substr(i.rfind('/') + 1);
+            if(name.size() > prefix.size()
+                    && name.compare(0, prefix.size(), prefix) == 0
+                    && isdigit(name[prefix.size()])
+                    && !(name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0))
+            {
+                files.push_back(i);
+            }
+        }
+        if(files.size() <= max_files)
+        {
+            return;
+        }
+        // 按(时间, 同一秒里的序号)排，不管有没有压缩
+        auto key = [](const std::string& file){
+            std::string name = file;
+            if(name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0)
+            {
+                name.resize(name.size() - 3);
+            }
+            size_t pos = name.rfind('.');
+            size_t dash = name.rfind('-');
+            if(pos != std::string::npos && dash != std::string::npos && pos > dash)
+            {
+                return std::make_pair(name.substr(0, pos), atoi(name.c_str() + pos + 1));
+            }
+            return std::make_pair(name, 0);
+        };
+        std::sort(files.begin(), files.end(), [&key](const std::string& a, const std::string& b){
+            return key(a) < key(b);
+        });
+        for(size_t i = 0; i < files.size() - max_files; ++i)
+        {
+            ::unlink(files[i].c_str());
+        }
+    }
+
+private:
+    Mutex m_mutex;
+    std::deque<Task> m_tasks;
+    Semaphore m_sem;
+    Thread::ptr m_thread;
+};
+
+}
+
+RotatingFileLogAppender::RotatingFileLogAppender(const std::string& filename, uint64_t max_size
+                                                 , Rotate rotate, uint32_t max_files, bool compress)
+    : FileLogAppender(filename)
+    , m_maxSize(max_size)
+    , m_rotate(rotate)
+    , m_maxFiles(max_files)
+    , m_compress(compress)
+{
+    MutexType::Lock lk(m_mutex);
+    m_nextRotateTime = getNextRotateTime(m_openTime);
+}
+
+RotatingFileLogAppender::~RotatingFileLogAppender()
+{
+    // 后台线程写的时候会调用prepareWrite，要在子类部分析构之前写完，
+    // 等到~FileLogAppender就晚了
+    flushAsync();
+}
+
+void RotatingFileLogAppender::prepareWrite(uint64_t now, size_t len)
+{
+    FileLogAppender::prepareWrite(now, len);
+    if(m_fd < 0)
+    {
+        return;
+    }
+    if(m_rotate != NONE && now >= m_nextRotateTime)
+    {
+        if(m_fileSize > 0)
+        {
+            doRotate();
+        }
+        m_nextRotateTime = getNextRotateTime(now);
+    }
+    else if(m_maxSize && m_fileSize > 0 && m_fileSize + len > m_maxSize)
+    {
+        doRotate();
+    }
+}
+
+void RotatingFileLogAppender::rotate()
+{
+    MutexType::Lock lk(m_mutex);
+    doRotate();
+}
+
+void RotatingFileLogAppender::doRotate()
+{
+    char tm[32];
+    time_t open_time = m_openTime;
+    struct tm t;
+    localtime_r(&open_time, &t);
+    strftime(tm, sizeof(tm), "%Y%m%d-%H%M%S", &t);
+    std::string file = m_filename + "." + tm;
+    // 同一秒里切了好几次
+    for(int i = 1; access(file.c_str(), F_OK) == 0
+            || access((file + ".gz").c_str(), F_OK) == 0; ++i)
+    {
+        file = m_filename + "." + tm + "." + std::to_string(i);
+    }
+    if(::rename(m_filename.c_str(), file.c_str()) != 0)
+    {
+        std::cout << "rotate log " << m_filename << " to " << file << " error: "
+                  << strerror(errno) << std::endl;
+        file.clear();
+    }
+    openFile();
+
+    if(m_compress || m_maxFiles)
+    {
+        LogRotateWorker::GetInstance()->push({file, m_filename, m_maxFiles, m_compress});
+    }
+}
+
+uint64_t RotatingFileLogAppender::getNextRotateTime(uint64_t now) const
+{
+    time_t tt = now;
+    struct tm t;
+    localtime_r(&tt, &t);
+    t.tm_sec = 0;
+    t.tm_min = 0;
+    if(m_rotate == HOUR)
+    {
+        t.tm_hour += 1;
+    }
+    else if(m_rotate == DAY)
+    {
+        t.tm_hour = 0;
+        t.tm_mday += 1;
+    }
+    else
+    {
+        return 0;
+    }
+    t.tm_isdst = -1;
+    return mktime(&t);
+}
+
+std::string RotatingFileLogAppender::toYamlString()
 {
     MutexType::Lock lk(m_mutex);
     YAML::Node node;
-    node["type"] = "StdoutLogAppender";
+    node["type"] = "FileLogAppender";
+    node["file"] = m_filename;
     if(m_level != LogLevel::UNKNOW)
     {
         node["level"] = LogLevel::ToString(m_level);
@@ -517,246 +2075,1011 @@ std::string StdoutLogAppender::toYamlString()
     {
         node["formatter"] = m_formatter->getPattern();
     }
+    if(m_maxSize)
+    {
+        node["max_size"] = m_maxSize;
+    }
+    if(m_rotate != NONE)
+    {
+        node["rotate"] = RotateToString(m_rotate);
+    }
+    if(m_maxFiles)
+    {
+        node["max_files"] = m_maxFiles;
+    }
+    node["compress"] = m_compress;
     std::stringstream ss;
     ss << node;
     return ss.str();
 }
 
-FileLogAppender::FileLogAppender(const std::string& filename)
-    : m_filename(filename)
+RotatingFileLogAppender::Rotate RotatingFileLogAppender::RotateFromString(const std::string& str)
 {
-    reopen();
+    if(strcasecmp(str.c_str(), "hour") == 0)
+    {
+        return HOUR;
+    }
+    if(strcasecmp(str.c_str(), "day") == 0)
+    {
+        return DAY;
+    }
+    return NONE;
 }
 
-void FileLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+const char* RotatingFileLogAppender::RotateToString(Rotate rotate)
+{
+    switch(rotate)
+    {
+        case HOUR:
+            return "hour";
+        case DAY:
+            return "day";
+        default:
+            return "none";
+    }
+}
+
+Logger::Logger(const std::string& name)
+    : m_name(name)
+    , m_level(LogLevel::DEBUG) 
+    , m_appenders(std::make_shared<const AppenderList>())
+{
+    //m_formatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"));
+    m_formatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%m%n"));
+    // 可能复用了已释放的logger的地址，不能让调用点的缓存认错
+    LogCallSite::InvalidateAll();
+}
+    
+Logger::~Logger()
+{
+    m_budget.unregister();
+}
+
+void Logger::log(LogLevel::Level level, LogEvent::ptr event)
 {
     if(level >= m_level)
     {
-        /// 超过3ms就重新打开一次
-        uint64_t now = event->getTime();
-        if(now >= (m_lastTime + 3))
+        uint32_t rate = m_rateLimit.load(std::memory_order_relaxed);
+        if(rate && !m_budget.allow(shared_from_this(), nullptr, 0, rate
+                    , m_rateBurst.load(std::memory_order_relaxed)))
         {
-            reopen();
-            m_lastTime = now;
+            return;
         }
+        write(level, event);
+    }
+}
 
-        MutexType::Lock lk(m_mutex);
-        if(!m_formatter->format(m_filestream, logger, level, event))
+void Logger::write(LogLevel::Level level, LogEvent::ptr event)
+{
+    auto self = shared_from_this();
+    std::shared_ptr<const AppenderList> appenders = std::atomic_load(&m_appenders);
+    if(!appenders->empty())
+    {
+        for(auto& i : *appenders)
         {
-            std::cout << "error" << std::endl;
+            i->log(self, level, event);
         }
     }
+    else if(m_root)
+    {
+        m_root->log(level, event);
+    }
 }
 
-std::string FileLogAppender::toYamlString()
+void Logger::setRateLimit(uint32_t rate, uint32_t burst)
+{
+    m_rateBurst = burst ? burst : rate;
+    m_rateLimit = rate;
+}
+    
+void Logger::debug(LogEvent::ptr event)
+{
+    log(LogLevel::DEBUG, event);
+}
+
+void Logger::info(LogEvent::ptr event)
+{
+    log(LogLevel::INFO, event);
+}
+    
+void Logger::warn(LogEvent::ptr event)
+{
+    log(LogLevel::WARN, event);
+}
+
+void Logger::error(LogEvent::ptr event)
+{
+    log(LogLevel::ERROR, event);
+}
+    
+void Logger::fatal(LogEvent::ptr event)
+{
+    log(LogLevel::FATAL, event);
+}
+    
+void Logger::addAppender(LogAppender::ptr appender)
+{
+    MutexType::Lock lk(m_mutex);
+    if(!appender->getFormatter())
+    {
+        MutexType::Lock ll(appender->m_mutex);
+        appender->m_formatter = m_formatter;
+    }
+    std::shared_ptr<AppenderList> appenders(new AppenderList(*m_appenders));
+    appenders->push_back(appender);
+    std::atomic_store(&m_appenders, std::shared_ptr<const AppenderList>(appenders));
+}
+
+void Logger::delAppender(LogAppender::ptr appender)
+{
+    MutexType::Lock lk(m_mutex);
+    std::shared_ptr<AppenderList> appenders(new AppenderList(*m_appenders));
+    for(auto it = appenders->begin();
+            it != appenders->end();
+            ++it)
+    {
+        if(*it == appender)
+        {
+            appenders->erase(it);
+            std::atomic_store(&m_appenders, std::shared_ptr<const AppenderList>(appenders));
+            break;
+        }
+    }
+}
+
+void Logger::setLevel(LogLevel::Level val)
+{
+    m_level = val;
+    LogCallSite::InvalidateAll();
+}
+
+void Logger::clearAppenders()
+{
+    MutexType::Lock lk(m_mutex);
+    std::atomic_store(&m_appenders, std::make_shared<const AppenderList>());
+}
+
+void Logger::setFormatter(LogFormatter::ptr val)
+{
+    MutexType::Lock lk(m_mutex);
+    m_formatter = val;
+    for(auto& i : *m_appenders)
+    {
+        MutexType::Lock ll(i->m_mutex);
+        if(!i->m_hasFormatter)
+        {
+            i->m_formatter = m_formatter;
+        }
+    }
+}
+
+void Logger::setFormatter(const std::string& val)
+{
+    LogFormatter::ptr new_val(new LogFormatter(val));
+    if(new_val->isError())
+    {
+        std::cout << "Logger setFormatter name=" << m_name
+                  << " value=" << val 
+                  << " invalid formatter\n";
+        return;
+    }
+    setFormatter(new_val);
+}
+
+LogFormatter::ptr Logger::getFormatter()
+{
+    MutexType::Lock lk(m_mutex);
+    return m_formatter;
+}
+    
+std::string Logger::toYamlString()
 {
     MutexType::Lock lk(m_mutex);
     YAML::Node node;
-    node["type"] = "FileLogAppender";
-    node["file"] = m_filename;
+    node["name"] = m_name;
     if(m_level != LogLevel::UNKNOW)
     {
-        node["level"] = LogLevel::ToString(m_level);
+        node["level"] = LogLevel::ToString(m_level);
+    }
+    if(m_formatter)
+    {
+        node["formatter"] = m_formatter->getPattern();
+    }
+    if(m_rateLimit)
+    {
+        node["rate_limit"] = (uint32_t)m_rateLimit;
+        node["rate_burst"] = (uint32_t)m_rateBurst;
+    }
+    for(auto& i : *m_appenders)
+    {
+        node["appenders"].push_back(YAML::Load(i->toYamlString()));
+    }
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
+
+LoggerManager::LoggerManager()
+{
+    m_root.reset(new Logger);
+    m_root->addAppender(LogAppender::ptr(new StdoutLogAppender));
+    std::shared_ptr<LoggerMap> loggers(new LoggerMap);
+    (*loggers)[m_root->m_name] = m_root;
+    m_loggers = loggers;
+
+    init();
+}
+
+void LoggerManager::init()
+{
+}
+
+Logger::ptr LoggerManager::getLogger(const std::string& name)
+{
+    {
+        std::shared_ptr<const LoggerMap> loggers = std::atomic_load(&m_loggers);
+        auto it = loggers->find(name);
+        if(it != loggers->end())
+        {
+            return it->second;
+        }
+    }
+
+    MutexType::Lock lk(m_mutex);
+    // 加锁前可能已经被别的线程建好了
+    auto it = m_loggers->find(name);
+    if(it != m_loggers->end())
+    {
+        return it->second;
+    }
+
+    Logger::ptr logger(new Logger(name));
+    logger->m_root = m_root;
+    std::shared_ptr<LoggerMap> loggers(new LoggerMap(*m_loggers));
+    (*loggers)[name] = logger;
+    std::atomic_store(&m_loggers, std::shared_ptr<const LoggerMap>(loggers));
+    return logger;
+}
+
+std::string LoggerManager::toYamlString()
+{
+    std::shared_ptr<const LoggerMap> loggers = std::atomic_load(&m_loggers);
+    YAML::Node node;
+    for(auto& i : *loggers)
+    {
+        node.push_back(YAML::Load(i.second->toYamlString()));
+    }
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
+
+/**
+ * @brief   每个线程一个的环形缓冲，单生产者(所属线程)单消费者(后台线程)
+ * @details head/tail是一直递增的字节位置，取模容量得到下标。
+ *          每条日志是一个RecordHeader加上内容，按16字节对齐，不会跨过缓冲末尾，
+ *          末尾放不下时写一个appender为空的填充记录，从头开始写
+ */
+struct AsyncLogBackend::Ring
+{
+    struct RecordHeader
+    {
+        /// 日志内容长度
+        uint32_t len;
+        uint32_t level;
+        /// 为空表示是填充记录
+        LogAppender* appender;
+    };
+
+    Ring(size_t size)
+        : capacity(size)
+        , buffer((char*)malloc(size))
+    {
+    }
+
+    static size_t RecordSize(size_t len)
+    {
+        return (sizeof(RecordHeader) + len + 15) & ~(size_t)15;
+    }
+
+    RecordHeader* at(uint64_t pos) { return (RecordHeader*)(buffer + (pos & (capacity - 1))); }
+
+    /**
+     * @brief   生产者写一条日志，空间不够返回false
+     */
+    bool tryPush(LogAppender* appender, LogLevel::Level level, const char* data, size_t len)
+    {
+        size_t size = RecordSize(len);
+        uint64_t h = head.load(std::memory_order_relaxed);
+        uint64_t t = tail.load(std::memory_order_acquire);
+        size_t to_end = capacity - (h & (capacity - 1));
+        size_t need = size <= to_end ? size : to_end + size;
+        if(capacity - (h - t) < need)
+        {
+            return false;
+        }
+        if(size > to_end)
+        {
+            RecordHeader* pad = at(h);
+            pad->len = to_end - sizeof(RecordHeader);
+            pad->appender = nullptr;
+            h += to_end;
+        }
+        RecordHeader* rec = at(h);
+        rec->len = len;
+        rec->level = level;
+        rec->appender = appender;
+        memcpy(rec + 1, data, len);
+        head.store(h + size, std::memory_order_release);
+        return true;
+    }
+
+    const size_t capacity;
+    char* buffer;
+    /// 生产者写入位置
+    std::atomic<uint64_t> head = {0};
+    /// 消费者读取位置
+    std::atomic<uint64_t> tail = {0};
+    /// 所属线程已经退出，可以给新线程复用
+    std::atomic<bool> closed = {false};
+};
+
+/// 当前线程是不是后台线程
+static thread_local bool t_is_async_log_thread = false;
+
+AsyncLogBackend* AsyncLogBackend::GetInstance()
+{
+    // 不析构，退出时其他静态对象析构里打的日志也能安全调用
+    static AsyncLogBackend* s_backend = new AsyncLogBackend;
+    return s_backend;
+}
+
+bool AsyncLogBackend::IsEnabled()
+{
+    return s_log_async_enabled.load(std::memory_order_relaxed);
+}
+
+AsyncLogBackend::AsyncLogBackend()
+{
+    for(auto& i : m_dropped)
+    {
+        i = 0;
+    }
+    m_thread.reset(new Thread(std::bind(&AsyncLogBackend::run, this), "log_async"));
+    atexit([](){
+        AsyncLogBackend::GetInstance()->stop();
+    });
+}
+
+AsyncLogBackend::Ring* AsyncLogBackend::getRing()
+{
+    // 线程退出时把缓冲标记为可复用
+    struct RingHolder
+    {
+        ~RingHolder()
+        {
+            if(ring)
+            {
+                ring->closed.store(true, std::memory_order_release);
+            }
+        }
+        Ring* ring = nullptr;
+    };
+    static thread_local RingHolder t_holder;
+
+    if(t_holder.ring)
+    {
+        return t_holder.ring;
+    }
+    Ring* ring = nullptr;
+    {
+        Spinlock::Lock lk(m_mutex);
+        for(auto i : m_rings)
+        {
+            // 复用已退出线程的缓冲，需要等里面的日志写完
+            if(i->closed.load(std::memory_order_acquire)
+                    && i->tail.load(std::memory_order_acquire) == i->head.load(std::memory_order_relaxed))
+            {
+                i->closed = false;
+                ring = i;
+                break;
+            }
+        }
+        if(!ring)
+        {
+            size_t size = 4096;
+            while(size < m_bufferSize)
+            {
+                size <<= 1;
+            }
+            ring = new Ring(size);
+            m_rings.push_back(ring);
+        }
+    }
+    t_holder.ring = ring;
+    return ring;
+}
+
+bool AsyncLogBackend::push(LogAppender* appender, LogLevel::Level level, const char* data, size_t len)
+{
+    if(m_stopped || t_is_async_log_thread)
+    {
+        return false;
+    }
+    Ring* ring = getRing();
+    if(Ring::RecordSize(len) > ring->capacity / 2)
+    {
+        return false;
     }
-    if(m_hasFormatter && m_formatter)
+
+    while(!ring->tryPush(appender, level, data, len))
     {
-        node["formatter"] = m_formatter->getPattern();
+        int policy = m_policy.load(std::memory_order_relaxed);
+        if(policy == DROP || (policy == DROP_BELOW && level < m_dropLevel.load(std::memory_order_relaxed)))
+        {
+            ++m_dropped[level];
+            wakeup();
+            return true;
+        }
+        if(m_stopped)
+        {
+            return false;
+        }
+        wakeup();
+        sched_yield();
     }
-    std::stringstream ss;
-    ss << node;
-    return ss.str();
+    wakeup();
+    return true;
 }
 
-bool FileLogAppender::reopen()
+void AsyncLogBackend::wakeup()
 {
-    MutexType::Lock lk(m_mutex);
-    if(m_filestream)
+    // 和run里的 m_idle=true 再检查一遍缓冲 配对，保证不会漏掉唤醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_idle.load(std::memory_order_relaxed) && m_idle.exchange(false))
     {
-        m_filestream.close();
+        m_sem.notify();
     }
-    return FSUtil::OpenForWrite(m_filestream, m_filename, std::ios::app);
 }
 
-Logger::Logger(const std::string& name)
-    : m_name(name)
-    , m_level(LogLevel::DEBUG) 
-{
-    //m_formatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"));
-    m_formatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%m%n"));
-}
-    
-void Logger::log(LogLevel::Level level, LogEvent::ptr event)
+void AsyncLogBackend::flush()
 {
-    if(level >= m_level)
+    if(m_stopped || t_is_async_log_thread)
     {
-        auto self = shared_from_this();
-        MutexType::Lock lk(m_mutex);
-        if(!m_appenders.empty())
+        return;
+    }
+    std::vector<std::pair<Ring*, uint64_t> > targets;
+    {
+        Spinlock::Lock lk(m_mutex);
+        for(auto i : m_rings)
         {
-            for(auto& i : m_appenders)
-            {
-                i->log(self, level, event);
-            }
+            targets.push_back(std::make_pair(i, i->head.load(std::memory_order_acquire)));
         }
-        else if(m_root)
+    }
+    for(auto& i : targets)
+    {
+        while(i.first->tail.load(std::memory_order_acquire) < i.second && !m_stopped)
         {
-            m_root->log(level, event);
+            wakeup();
+            usleep(1000);
         }
     }
 }
-    
-void Logger::debug(LogEvent::ptr event)
-{
-    log(LogLevel::DEBUG, event);
-}
 
-void Logger::info(LogEvent::ptr event)
-{
-    log(LogLevel::INFO, event);
-}
-    
-void Logger::warn(LogEvent::ptr event)
+void AsyncLogBackend::stop()
 {
-    log(LogLevel::WARN, event);
+    if(m_stopping.exchange(true))
+    {
+        return;
+    }
+    if(m_idle.exchange(false))
+    {
+        m_sem.notify();
+    }
+    m_thread->join();
+    m_stopped = true;
 }
 
-void Logger::error(LogEvent::ptr event)
+void AsyncLogBackend::setOverflowPolicy(OverflowPolicy policy, LogLevel::Level drop_level)
 {
-    log(LogLevel::ERROR, event);
+    m_policy = policy;
+    m_dropLevel = drop_level;
 }
-    
-void Logger::fatal(LogEvent::ptr event)
+
+void AsyncLogBackend::setBufferSize(size_t size)
 {
-    log(LogLevel::FATAL, event);
+    m_bufferSize = size;
 }
-    
-void Logger::addAppender(LogAppender::ptr appender)
+
+uint64_t AsyncLogBackend::getDropped() const
 {
-    MutexType::Lock lk(m_mutex);
-    if(!appender->getFormatter())
+    uint64_t total = 0;
+    for(auto& i : m_dropped)
     {
-        MutexType::Lock ll(appender->m_mutex);
-        appender->m_formatter = m_formatter;
+        total += i;
     }
-    m_appenders.push_back(appender);
+    return total;
 }
 
-void Logger::delAppender(LogAppender::ptr appender)
+size_t AsyncLogBackend::drainAll()
 {
-    MutexType::Lock lk(m_mutex);
-    for(auto it = m_appenders.begin();
-            it != m_appenders.end();
-            ++it)
+    std::vector<Ring*> rings;
     {
-        if(*it == appender)
+        Spinlock::Lock lk(m_mutex);
+        rings = m_rings;
+    }
+
+    size_t records = 0;
+    iovec iovs[64 < IOV_MAX ? 64 : IOV_MAX];
+    for(auto ring : rings)
+    {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        // 连续的同一个appender的日志合成一次writev
+        LogAppender* cur = nullptr;
+        int count = 0;
+        while(tail < head)
         {
-            m_appenders.erase(it);
-            break;
+            Ring::RecordHeader* rec = ring->at(tail);
+            tail += Ring::RecordSize(rec->len);
+            if(!rec->appender)
+            {
+                continue;
+            }
+            if(count && (rec->appender != cur || count == (int)(sizeof(iovs) / sizeof(iovs[0]))))
+            {
+                cur->writeBatch(iovs, count);
+                count = 0;
+            }
+            cur = rec->appender;
+            iovs[count].iov_base = rec + 1;
+            iovs[count].iov_len = rec->len;
+            ++count;
+            ++records;
+        }
+        if(count)
+        {
+            cur->writeBatch(iovs, count);
         }
+        // 写完才能让生产者覆盖
+        ring->tail.store(tail, std::memory_order_release);
     }
-}
 
-void Logger::clearAppenders()
-{
-    MutexType::Lock lk(m_mutex);
-    m_appenders.clear();
+    // 有丢弃的日志，最多每秒报告一次
+    uint64_t dropped = getDropped();
+    if(dropped != m_lastReported)
+    {
+        uint64_t now = time(0);
+        if(now != m_lastReportTime)
+        {
+            std::string msg = "async log dropped " + std::to_string(dropped - m_lastReported)
+                + " records, total " + std::to_string(dropped) + "\n";
+            iovec iov;
+            iov.iov_base = (void*)msg.c_str();
+            iov.iov_len = msg.size();
+            WriteFully(STDERR_FILENO, &iov, 1);
+            m_lastReported = dropped;
+            m_lastReportTime = now;
+        }
+    }
+    return records;
 }
 
-void Logger::setFormatter(LogFormatter::ptr val)
+void AsyncLogBackend::run()
 {
-    MutexType::Lock lk(m_mutex);
-    m_formatter = val;
-    for(auto& i : m_appenders)
+    t_is_async_log_thread = true;
+    int idle_rounds = 0;
+    while(true)
     {
-        MutexType::Lock ll(i->m_mutex);
-        if(!i->m_hasFormatter)
+        if(drainAll())
         {
-            i->m_formatter = m_formatter;
+            idle_rounds = 0;
+            continue;
+        }
+        if(m_stopping)
+        {
+            // 停止前最后再写一遍
+            drainAll();
+            break;
+        }
+        // 先短暂休眠几轮再进入等待，日志频繁时生产者不用每条都唤醒后台线程
+        if(++idle_rounds < 10)
+        {
+            usleep(1000);
+            continue;
+        }
+        idle_rounds = 0;
+
+        m_idle = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(drainAll() || m_stopping)
+        {
+            // 已经被唤醒过的话要把信号量消耗掉
+            if(!m_idle.exchange(false))
+            {
+                m_sem.wait();
+            }
+            continue;
         }
+        m_sem.wait();
     }
 }
 
-void Logger::setFormatter(const std::string& val)
+namespace
 {
-    LogFormatter::ptr new_val(new LogFormatter(val));
-    if(new_val->isError())
+/**
+ * @brief   按配置设置缓冲满时的处理方式
+ */
+static void UpdateAsyncPolicy(const std::string& overflow, const std::string& drop_level)
+{
+    AsyncLogBackend::OverflowPolicy policy = AsyncLogBackend::BLOCK;
+    if(overflow == "drop")
     {
-        std::cout << "Logger setFormatter name=" << m_name
-                  << " value=" << val 
-                  << " invalid formatter\n";
-        return;
+        policy = AsyncLogBackend::DROP;
     }
-    setFormatter(new_val);
+    else if(overflow == "drop_below")
+    {
+        policy = AsyncLogBackend::DROP_BELOW;
+    }
+    LogLevel::Level level = LogLevel::FromString(drop_level);
+    AsyncLogBackend::GetInstance()->setOverflowPolicy(policy
+            , level == LogLevel::UNKNOW ? LogLevel::WARN : level);
 }
 
-LogFormatter::ptr Logger::getFormatter()
-{
-    MutexType::Lock lk(m_mutex);
-    return m_formatter;
-}
-    
-std::string Logger::toYamlString()
+struct LogAsyncIniter
 {
-    MutexType::Lock lk(m_mutex);
-    YAML::Node node;
-    node["name"] = m_name;
-    if(m_level != LogLevel::UNKNOW)
+    LogAsyncIniter()
     {
-        node["level"] = LogLevel::ToString(m_level);
+        g_log_async_enable->addListener([](const bool& ov, const bool& nv){
+            s_log_async_enabled = nv;
+        });
+        g_log_async_buffer_size->addListener([](const uint32_t& ov, const uint32_t& nv){
+            AsyncLogBackend::GetInstance()->setBufferSize(nv);
+        });
+        // 回调时getValue()还是旧值，变化的那个用nv
+        g_log_async_overflow->addListener([](const std::string& ov, const std::string& nv){
+            UpdateAsyncPolicy(nv, g_log_async_drop_level->getValue());
+        });
+        g_log_async_drop_level->addListener([](const std::string& ov, const std::string& nv){
+            UpdateAsyncPolicy(g_log_async_overflow->getValue(), nv);
+        });
     }
-    if(m_formatter)
+};
+
+static LogAsyncIniter __log_async_init;
+}
+
+struct LogAppenderDefine
+{
+    /// 1 File, 2 Stdout, 3 Binary
+    int type = 0;
+    LogLevel::Level level = LogLevel::UNKNOW;
+    std::string formatter;
+    std::string file;
+    /// 以下是FileLogAppender切分用的，max_size和rotate都没配置时不切分
+    uint64_t maxSize = 0;
+    std::string rotate;
+    uint32_t maxFiles = 0;
+    bool compress = true;
+
+    bool operator==(const LogAppenderDefine& oth) const
     {
-        node["formatter"] = m_formatter->getPattern();
+        return type == oth.type
+            && level == oth.level
+            && formatter == oth.formatter
+            && file == oth.file
+            && maxSize == oth.maxSize
+            && rotate == oth.rotate
+            && maxFiles == oth.maxFiles
+            && compress == oth.compress;
     }
-    for(auto& i : m_appenders)
+};
+
+/**
+ * @brief   解析"100M"这样的大小，支持K/M/G后缀
+ */
+static uint64_t ParseLogSize(const std::string& str)
+{
+    char* end = nullptr;
+    uint64_t v = strtoull(str.c_str(), &end, 10);
+    switch(toupper(*end))
     {
-        node["appenders"].push_back(YAML::Load(i->toYamlString()));
+        case 'K':
+            return v << 10;
+        case 'M':
+            return v << 20;
+        case 'G':
+            return v << 30;
+        default:
+            return v;
     }
-    std::stringstream ss;
-    ss << node;
-    return ss.str();
 }
 
-LoggerManager::LoggerManager()
+struct LogDefine
 {
-    m_root.reset(new Logger);
-    m_root->addAppender(LogAppender::ptr(new StdoutLogAppender));
-    m_loggers[m_root->m_name] = m_root;
+    std::string name;
+    LogLevel::Level level = LogLevel::UNKNOW;
+    std::string formatter;
+    /// 每秒最多输出多少条，0不限制
+    uint32_t rateLimit = 0;
+    uint32_t rateBurst = 0;
+    std::vector<LogAppenderDefine> appenders;
+
+    bool operator==(const LogDefine& oth) const
+    {
+        return name == oth.name
+            && level == oth.level
+            && formatter == oth.formatter
+            && rateLimit == oth.rateLimit
+            && rateBurst == oth.rateBurst
+            && appenders == oth.appenders;
+    }
 
-    init();
-}
+    bool operator<(const LogDefine& oth) const
+    {
+        return name < oth.name;
+    }
+};
 
-void LoggerManager::init()
+template<>
+class LexicalCast<std::string, LogDefine>
 {
-}
+public:
+    LogDefine operator()(const std::string& v)
+    {
+        YAML::Node n = YAML::Load(v);
+        LogDefine ld;
+        if(!n["name"].IsDefined())
+        {
+            std::cout << "log config error: name is null, " << n << std::endl;
+            throw std::logic_error("log config name is null");
+        }
+        ld.name = n["name"].as<std::string>();
+        ld.level = LogLevel::FromString(n["level"].IsDefined() ? n["level"].as<std::string>() : "");
+        if(n["formatter"].IsDefined())
+        {
+            ld.formatter = n["formatter"].as<std::string>();
+        }
+        if(n["rate_limit"].IsDefined())
+        {
+            ld.rateLimit = n["rate_limit"].as<uint32_t>();
+        }
+        if(n["rate_burst"].IsDefined())
+        {
+            ld.rateBurst = n["rate_burst"].as<uint32_t>();
+        }
 
-Logger::ptr LoggerManager::getLogger(const std::string& name)
+        if(n["appenders"].IsDefined())
+        {
+            for(size_t x = 0; x < n["appenders"].size(); ++x)
+            {
+                auto a = n["appenders"][x];
+                if(!a["type"].IsDefined())
+                {
+                    std::cout << "log config error: appender type is null, " << a << std::endl;
+                    continue;
+                }
+                std::string type = a["type"].as<std::string>();
+                LogAppenderDefine lad;
+                if(type == "FileLogAppender")
+                {
+                    lad.type = 1;
+                    if(!a["file"].IsDefined())
+                    {
+                        std::cout << "log config error: fileappender file is null, " << a << std::endl;
+                        continue;
+                    }
+                    lad.file = a["file"].as<std::string>();
+                    if(a["max_size"].IsDefined())
+                    {
+                        lad.maxSize = ParseLogSize(a["max_size"].as<std::string>());
+                    }
+                    if(a["rotate"].IsDefined())
+                    {
+                        lad.rotate = a["rotate"].as<std::string>();
+                    }
+                    if(a["max_files"].IsDefined())
+                    {
+                        lad.maxFiles = a["max_files"].as<uint32_t>();
+                    }
+                    if(a["compress"].IsDefined())
+                    {
+                        lad.compress = a["compress"].as<bool>();
+                    }
+                }
+                else if(type == "StdoutLogAppender")
+                {
+                    lad.type = 2;
+                }
+                else if(type == "BinaryLogAppender")
+                {
+                    lad.type = 3;
+                    if(!a["file"].IsDefined())
+                    {
+                        std::cout << "log config error: binaryappender file is null, " << a << std::endl;
+                        continue;
+                    }
+                    lad.file = a["file"].as<std::string>();
+                }
+                else
+                {
+                    std::cout << "log config error: appender type is invalid, " << a << std::endl;
+                    continue;
+                }
+                if(a["level"].IsDefined())
+                {
+                    lad.level = LogLevel::FromString(a["level"].as<std::string>());
+                }
+                if(a["formatter"].IsDefined())
+                {
+                    lad.formatter = a["formatter"].as<std::string>();
+                }
+                ld.appenders.push_back(lad);
+            }
+        }
+        return ld;
+    }
+};
+
+template<>
+class LexicalCast<LogDefine, std::string>
 {
-    MutexType::Lock lk(m_mutex);
-    auto it = m_loggers.find(name);
-    if(it != m_loggers.end())
+public:
+    std::string operator()(const LogDefine& i)
     {
-        return it->second;
+        YAML::Node n;
+        n["name"] = i.name;
+        if(i.level != LogLevel::UNKNOW)
+        {
+            n["level"] = LogLevel::ToString(i.level);
+        }
+        if(!i.formatter.empty())
+        {
+            n["formatter"] = i.formatter;
+        }
+        if(i.rateLimit)
+        {
+            n["rate_limit"] = i.rateLimit;
+        }
+        if(i.rateBurst)
+        {
+            n["rate_burst"] = i.rateBurst;
+        }
+
+        for(auto& a : i.appenders)
+        {
+            YAML::Node na;
+            if(a.type == 1)
+            {
+                na["type"] = "FileLogAppender";
+                na["file"] = a.file;
+                if(a.maxSize)
+                {
+                    na["max_size"] = a.maxSize;
+                }
+                if(!a.rotate.empty())
+                {
+                    na["rotate"] = a.rotate;
+                }
+                if(a.maxFiles)
+                {
+                    na["max_files"] = a.maxFiles;
+                }
+                if(!a.compress)
+                {
+                    na["compress"] = false;
+                }
+            }
+            else if(a.type == 2)
+            {
+                na["type"] = "StdoutLogAppender";
+            }
+            else if(a.type == 3)
+            {
+                na["type"] = "BinaryLogAppender";
+                na["file"] = a.file;
+            }
+            if(a.level != LogLevel::UNKNOW)
+            {
+                na["level"] = LogLevel::ToString(a.level);
+            }
+            if(!a.formatter.empty())
+            {
+                na["formatter"] = a.formatter;
+            }
+            n["appenders"].push_back(na);
+        }
+        std::stringstream ss;
+        ss << n;
+        return ss.str();
     }
+};
 
-    Logger::ptr logger(new Logger(name));
-    logger->m_root = m_root;
-    m_loggers[name] = logger;
-    return logger;
-}
+static ConfigVar<std::set<LogDefine> >::ptr g_log_defines =
+    Config::Lookup("logs", std::set<LogDefine>(), "logs config");
 
-std::string LoggerManager::toYamlString()
+struct LogIniter
 {
-    MutexType::Lock lk(m_mutex);
-    YAML::Node node;
-    for(auto& i : m_loggers)
+    LogIniter()
     {
-        node.push_back(YAML::Load(i.second->toYamlString()));
+        g_log_defines->addListener([](const std::set<LogDefine>& old_value,
+                    const std::set<LogDefine>& new_value){
+            for(auto& i : new_value)
+            {
+                auto it = old_value.find(i);
+                if(it != old_value.end() && i == *it)
+                {
+                    continue;
+                }
+
+                // 新增或者修改的logger，setLevel会让调用点的级别缓存失效
+                Logger::ptr logger = SYLAR_LOG_NAME(i.name);
+                logger->setLevel(i.level);
+                logger->setRateLimit(i.rateLimit, i.rateBurst);
+                if(!i.formatter.empty())
+                {
+                    logger->setFormatter(i.formatter);
+                }
+
+                logger->clearAppenders();
+                for(auto& a : i.appenders)
+                {
+                    LogAppender::ptr ap;
+                    if(a.type == 1)
+                    {
+                        RotatingFileLogAppender::Rotate rotate = RotatingFileLogAppender::RotateFromString(a.rotate);
+                        if(a.maxSize || rotate != RotatingFileLogAppender::NONE)
+                        {
+                            ap.reset(new RotatingFileLogAppender(a.file, a.maxSize, rotate
+                                        , a.maxFiles, a.compress));
+                        }
+                        else
+                        {
+                            ap.reset(new FileLogAppender(a.file));
+                        }
+                    }
+                    else if(a.type == 2)
+                    {
+                        ap.reset(new StdoutLogAppender);
+                    }
+                    else if(a.type == 3)
+                    {
+                        ap.reset(new BinaryLogAppender(a.file));
+                    }
+                    ap->setLevel(a.level);
+                    if(!a.formatter.empty())
+                    {
+                        LogFormatter::ptr fmt(new LogFormatter(a.formatter));
+                        if(!fmt->isError())
+                        {
+                            ap->setFormatter(fmt);
+                        }
+                        else
+                        {
+                            std::cout << "log.name=" << i.name << " appender type=" << a.type
+                                      << " formatter=" << a.formatter << " is invalid" << std::endl;
+                        }
+                    }
+                    logger->addAppender(ap);
+                }
+            }
+
+            for(auto& i : old_value)
+            {
+                auto it = new_value.find(i);
+                if(it == new_value.end())
+                {
+                    // 删除的logger，不直接删掉，关掉输出
+                    Logger::ptr logger = SYLAR_LOG_NAME(i.name);
+                    logger->setLevel((LogLevel::Level)100);
+                    logger->setRateLimit(0);
+                    logger->clearAppenders();
+                }
+            }
+        });
     }
-    std::stringstream ss;
-    ss << node;
-    return ss.str();
-}
+};
 
-}
+static LogIniter __log_init;
 
+}
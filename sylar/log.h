@@ -17,20 +17,43 @@
 #include <map>
 #include <stdarg.h>
 #include <iostream>
+#include <atomic>
+#include <sys/uio.h>
+#include <sys/stat.h>
 
 #include "mutex.h"
 #include "util.h"
 #include "singleton.h"
 #include "thread.h"
 
+/**
+ * @brief   编译期的最低日志级别，低于这个级别的日志语句整个被编译器去掉
+ * @details 取值同LogLevel::Level：0不限制，1 DEBUG，2 INFO，3 WARN，4 ERROR，5 FATAL，
+ *          例如 -DSYLAR_LOG_MIN_LEVEL=2 去掉所有DEBUG日志
+ */
+#ifndef SYLAR_LOG_MIN_LEVEL
+#define SYLAR_LOG_MIN_LEVEL 0
+#endif
+
+/**
+ * @brief   判断这个调用点的日志是否需要输出
+ * @details 每个调用点一个静态的LogCallSite，缓存"logger在这个级别不输出"，
+ *          命中时只有一次比较，不用再通过logger去取级别；日志级别变化时缓存失效
+ */
+#define SYLAR_LOG_ENABLED(logger, level) \
+    ((level) >= SYLAR_LOG_MIN_LEVEL && ({ \
+        static sylar::LogCallSite __sylar_log_site; \
+        __sylar_log_site.isEnabled(logger, level); }))
+
 /**
  * @brief   使用流式方式写日志
+ * @details 不输出时<<后面的参数都不会求值
  */
 #define SYLAR_LOG_LEVEL(logger, level) \
-    if(logger->getLevel() <= level) \
-        sylar::LogEventWrap(sylar::LogEvent::ptr(new sylar::LogEvent(logger, level, \
+    if(!SYLAR_LOG_ENABLED(logger, level)) {} \
+    else sylar::LogEventWrap(sylar::LogEvent::Create(logger, level, \
                         __FILE__, __LINE__, 0, sylar::GetThreadId(),\
-                sylar::GetFiberId(), time(0), sylar::Thread::GetName()))).getSS()
+                sylar::GetFiberId(), time(0), sylar::Thread::GetName())).getSS()
 
 #define SYLAR_LOG_DEBUG(logger) SYLAR_LOG_LEVEL(logger, sylar::LogLevel::DEBUG)
 #define SYLAR_LOG_INFO(logger) SYLAR_LOG_LEVEL(logger, sylar::LogLevel::INFO)
@@ -40,12 +63,13 @@
 
 /**
  * @brief   使用格式化方式写日志
+ * @details 不输出时格式化参数都不会求值
  */
 #define SYLAR_LOG_FMT_LEVEL(logger, level, fmt, ...) \
-    if(logger->getLevel() <= level) \
-        sylar::LogEventWrap(sylar::LogEvent::ptr(new sylar::LogEvent(logger, level, \
+    if(!SYLAR_LOG_ENABLED(logger, level)) {} \
+    else sylar::LogEventWrap(sylar::LogEvent::Create(logger, level, \
                         __FILE__, __LINE__, 0, sylar::GetThreadId(),\
-                sylar::GetFiberId(), time(0), sylar::Thread::GetName()))).getEvent()->format(fmt, __VA_ARGS__)
+                sylar::GetFiberId(), time(0), sylar::Thread::GetName())).getEvent()->format(fmt, __VA_ARGS__)
 
 #define SYLAR_LOG_FMT_DEBUG(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::DEBUG, fmt, __VA_ARGS__)
 #define SYLAR_LOG_FMT_INFO(logger, fmt, ...)  SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::INFO, fmt, __VA_ARGS__)
@@ -53,6 +77,41 @@
 #define SYLAR_LOG_FMT_ERROR(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::ERROR, fmt, __VA_ARGS__)
 #define SYLAR_LOG_FMT_FATAL(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::FATAL, fmt, __VA_ARGS__)
 
+/**
+ * @brief   限流写日志，这个调用点每秒最多输出rate条(令牌桶，最多攒rate条)
+ * @details 被限掉的条数定期汇总输出一条WARN，见LogRateLimiter
+ */
+#define SYLAR_LOG_LEVEL_LIMIT(logger, level, rate) \
+    if(!(SYLAR_LOG_ENABLED(logger, level) && ({ \
+            static sylar::LogRateLimiter __sylar_log_limiter; \
+            __sylar_log_limiter.allow(logger, __FILE__, __LINE__, rate, rate); }))) {} \
+    else sylar::LogEventWrap(sylar::LogEvent::Create(logger, level, \
+                        __FILE__, __LINE__, 0, sylar::GetThreadId(),\
+                sylar::GetFiberId(), time(0), sylar::Thread::GetName())).getSS()
+
+#define SYLAR_LOG_DEBUG_LIMIT(logger, rate) SYLAR_LOG_LEVEL_LIMIT(logger, sylar::LogLevel::DEBUG, rate)
+#define SYLAR_LOG_INFO_LIMIT(logger, rate) SYLAR_LOG_LEVEL_LIMIT(logger, sylar::LogLevel::INFO, rate)
+#define SYLAR_LOG_WARN_LIMIT(logger, rate) SYLAR_LOG_LEVEL_LIMIT(logger, sylar::LogLevel::WARN, rate)
+#define SYLAR_LOG_ERROR_LIMIT(logger, rate) SYLAR_LOG_LEVEL_LIMIT(logger, sylar::LogLevel::ERROR, rate)
+#define SYLAR_LOG_FATAL_LIMIT(logger, rate) SYLAR_LOG_LEVEL_LIMIT(logger, sylar::LogLevel::FATAL, rate)
+
+/**
+ * @brief   采样写日志，这个调用点每n条只输出第1条
+ */
+#define SYLAR_LOG_LEVEL_EVERY_N(logger, level, n) \
+    if(!(SYLAR_LOG_ENABLED(logger, level) && ({ \
+            static sylar::LogRateLimiter __sylar_log_limiter; \
+            __sylar_log_limiter.sample(logger, __FILE__, __LINE__, n); }))) {} \
+    else sylar::LogEventWrap(sylar::LogEvent::Create(logger, level, \
+                        __FILE__, __LINE__, 0, sylar::GetThreadId(),\
+                sylar::GetFiberId(), time(0), sylar::Thread::GetName())).getSS()
+
+#define SYLAR_LOG_DEBUG_EVERY_N(logger, n) SYLAR_LOG_LEVEL_EVERY_N(logger, sylar::LogLevel::DEBUG, n)
+#define SYLAR_LOG_INFO_EVERY_N(logger, n) SYLAR_LOG_LEVEL_EVERY_N(logger, sylar::LogLevel::INFO, n)
+#define SYLAR_LOG_WARN_EVERY_N(logger, n) SYLAR_LOG_LEVEL_EVERY_N(logger, sylar::LogLevel::WARN, n)
+#define SYLAR_LOG_ERROR_EVERY_N(logger, n) SYLAR_LOG_LEVEL_EVERY_N(logger, sylar::LogLevel::ERROR, n)
+#define SYLAR_LOG_FATAL_EVERY_N(logger, n) SYLAR_LOG_LEVEL_EVERY_N(logger, sylar::LogLevel::FATAL, n)
+
 
 /**
  * @brief   获取主日志器
@@ -90,6 +149,187 @@ public:
     static LogLevel::Level FromString(const std::string& str);
 };
 
+/**
+ * @brief   日志调用点的级别缓存，由SYLAR_LOG_ENABLED在每个调用点定义一个静态对象
+ * @details 记住上一次判断为"不输出"的logger，同一个logger再来时直接返回false；
+ *          第一次判断时把自己登记到全局列表里，Logger::setLevel(包括log.yml变化)
+ *          会清空所有调用点的缓存，下次重新判断
+ */
+class LogCallSite
+{
+public:
+    constexpr LogCallSite()
+        : m_disabled(nullptr)
+        , m_registered(false)
+    {}
+
+    bool isEnabled(const std::shared_ptr<Logger>& logger, LogLevel::Level level)
+    {
+        if(__builtin_expect(m_disabled.load(std::memory_order_relaxed) == logger.get(), 1))
+        {
+            return false;
+        }
+        return update(logger.get(), level);
+    }
+
+    /**
+     * @brief   清空所有调用点的缓存，日志级别变化时调用
+     */
+    static void InvalidateAll();
+
+private:
+    /**
+     * @brief   缓存没命中时重新判断，不输出的话把logger记到缓存里
+     */
+    bool update(const Logger* logger, LogLevel::Level level);
+
+private:
+    /// 在这个调用点不输出的logger
+    std::atomic<const Logger*> m_disabled;
+    /// 是否已经登记到全局列表
+    std::atomic<bool> m_registered;
+};
+
+/**
+ * @brief   日志内容的缓冲，写满了翻倍扩容
+ * @details 跟着LogEvent一起在线程内复用，扩容过的空间不会释放
+ */
+class LogStreamBuf : public std::streambuf
+{
+public:
+    LogStreamBuf();
+
+    /**
+     * @brief   清空内容，保留空间
+     */
+    void reset();
+
+    const char* data() const { return pbase(); }
+    size_t size() const { return pptr() - pbase(); }
+
+protected:
+    virtual int_type overflow(int_type c) override;
+    virtual std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+private:
+    /**
+     * @brief   保证还能写入n个字节
+     */
+    void reserve(size_t n);
+
+private:
+    std::string m_buf;
+};
+
+/**
+ * @brief   日志限流/采样的状态，每个限流的调用点一个静态对象，每个logger的总预算一个
+ * @details 限流用GCRA(等价于令牌桶)：只有一个原子的"理论到达时间"，CAS更新，不加锁。
+ *          某段时间里第一次被限掉时把自己登记到全局列表，并在当前线程的IOManager上
+ *          加一个定时器(log.limit.summary_interval毫秒)；定时器到了把每个调用点
+ *          被限掉的条数用对应的logger输出一条WARN，然后清零。
+ *          不在IOManager线程里被限掉的条数，会在下一次定时汇总时一起输出。
+ */
+class LogRateLimiter
+{
+public:
+    constexpr LogRateLimiter()
+        : m_tat(0)
+        , m_count(0)
+        , m_suppressed(0)
+    {}
+
+    /**
+     * @brief   限流，每秒rate条，最多攒burst条
+     *
+     * @return  这一条是否可以输出
+     */
+    bool allow(const std::shared_ptr<Logger>& logger, const char* file, int32_t line
+               , uint32_t rate, uint32_t burst);
+
+    /**
+     * @brief   采样，每n条输出第1条
+     */
+    bool sample(const std::shared_ptr<Logger>& logger, const char* file, int32_t line, uint32_t n)
+    {
+        if(m_count.fetch_add(1, std::memory_order_relaxed) % (n ? n : 1) == 0)
+        {
+            return true;
+        }
+        suppress(logger, file, line);
+        return false;
+    }
+
+    /**
+     * @brief   还没汇总的被限掉的条数
+     */
+    uint64_t getSuppressed() const { return m_suppressed; }
+
+    /**
+     * @brief   从全局列表里去掉，对象销毁前调用(logger的总预算)
+     */
+    void unregister();
+
+    /**
+     * @brief   马上输出所有被限掉的条数的汇总(定时器里调用)
+     */
+    static void ReportSuppressed();
+
+private:
+    /**
+     * @brief   被限掉一条，这段时间里的第一条时登记并安排汇总
+     */
+    void suppress(const std::shared_ptr<Logger>& logger, const char* file, int32_t line);
+
+private:
+    /// GCRA理论到达时间(单调时钟纳秒)
+    std::atomic<uint64_t> m_tat;
+    /// 采样计数
+    std::atomic<uint64_t> m_count;
+    /// 上次汇总以后被限掉的条数
+    std::atomic<uint64_t> m_suppressed;
+};
+
+/**
+ * @brief   printf风格日志参数的二进制编解码
+ * @details 有二进制appender时，SYLAR_LOG_FMT_*只保存格式串和编码后的原始参数，
+ *          不做文本格式化；需要文本时(文本appender、sylar_logcat)再按格式串还原
+ */
+class LogArgs
+{
+public:
+    /**
+     * @brief   按格式串把参数编码后追加到out
+     *
+     * @return  格式串里有不支持的转换(%n、宽字符等)时返回false
+     */
+    static bool Encode(const char* fmt, va_list al, std::string& out);
+
+    /**
+     * @brief   按格式串把编码过的参数还原成文本，追加到out
+     *
+     * @return  数据和格式串对不上时返回false
+     */
+    static bool Decode(const char* fmt, const char* data, size_t len, std::string& out);
+
+    /**
+     * @brief   二进制appender创建/销毁时调用，有二进制appender时才保存原始参数
+     */
+    static void EnableCapture();
+    static void DisableCapture();
+    static bool IsCaptureEnabled();
+};
+
+/**
+ * @brief   当前协程的trace id，保存在协程局部变量trace_id里，会被子协程继承
+ * @details 日志格式用%R输出；HttpServer按请求头设置，HttpConnection发请求时带上
+ */
+std::string GetTraceId();
+
+/**
+ * @brief   设置当前协程的trace id，空字符串表示清除
+ */
+void SetTraceId(const std::string& v);
+
 /**
  * @brief  日志事件类 
  */
@@ -98,6 +338,22 @@ class LogEvent
 public:
     typedef std::shared_ptr<LogEvent> ptr;
 
+    /**
+     * @brief   取一个日志事件，宏里用这个
+     * @details 每个线程缓存一个LogEvent(连同内容缓冲)，没有被占用时直接复用，
+     *          不需要每条日志都new对象、构造stringstream；
+     *          写日志的过程中又写日志(嵌套)时缓存被占用，才new一个新的
+     */
+    static LogEvent::ptr Create(std::shared_ptr<Logger> logger,
+                                LogLevel::Level level,
+                                const char* file,
+                                int32_t line,
+                                uint32_t elapse,
+                                uint32_t threadId,
+                                uint32_t fiberId,
+                                uint64_t time,
+                                const std::string& threadName);
+
     LogEvent(std::shared_ptr<Logger> logger, 
              LogLevel::Level level,
              const char* file,
@@ -122,18 +378,60 @@ public:
 
     const std::string& getThreadName() const { return m_threadName; }
 
-    std::string getContent() const { return m_ss.str(); }
+    /**
+     * @brief   创建日志事件时所在协程的trace id
+     */
+    const std::string& getTraceId() const { return m_traceId; }
+    void setTraceId(const std::string& v) { m_traceId = v; }
+
+    std::string getContent() { materialize(); return std::string(m_buf.data(), m_buf.size()); }
+
+    /**
+     * @brief   日志内容，不复制
+     */
+    const char* getContentData() { materialize(); return m_buf.data(); }
+    size_t getContentSize() { materialize(); return m_buf.size(); }
+
+    /**
+     * @brief   保存了原始参数时返回格式串，否则返回nullptr
+     */
+    const char* getFormat() const { return m_fmt; }
+
+    /**
+     * @brief   LogArgs编码后的原始参数
+     */
+    const std::string& getArgs() const { return m_args; }
 
     std::shared_ptr<Logger> getLogger() const { return m_logger; }
 
     LogLevel::Level getLevel() const { return m_level; }
 
-    std::stringstream& getSS() { return m_ss; }
+    std::ostream& getSS() { return m_ss; }
 
     void format(const char* fmt, ...);
 
     void format(const char* fmt, va_list al);
 
+private:
+    /**
+     * @brief   保存的是原始参数时，还原成文本写到内容缓冲里
+     */
+    void materialize()
+    {
+        if(m_fmt)
+        {
+            decodeArgs();
+        }
+    }
+    void decodeArgs();
+
+    /**
+     * @brief   复用前重新设置各个字段，清空内容和流的格式状态
+     */
+    void reset(std::shared_ptr<Logger> logger, LogLevel::Level level, const char* file
+               , int32_t line, uint32_t elapse, uint32_t threadId, uint32_t fiberId
+               , uint64_t time, const std::string& threadName);
+
 private:
     /// 日志器
     std::shared_ptr<Logger> m_logger;
@@ -153,8 +451,16 @@ private:
     uint64_t m_time = 0;
     /// 线程名称
     std::string m_threadName;
+    /// trace id
+    std::string m_traceId;
+    /// 日志内容缓冲
+    LogStreamBuf m_buf;
     /// 日志内容流
-    std::stringstream m_ss;
+    std::ostream m_ss;
+    /// 保存原始参数时的格式串
+    const char* m_fmt = nullptr;
+    /// 编码后的原始参数
+    std::string m_args;
 };
 
 /**
@@ -167,9 +473,9 @@ public:
 
     ~LogEventWrap();
 
-    LogEvent::ptr getEvent() const { return m_event; }
+    const LogEvent::ptr& getEvent() const { return m_event; }
 
-    std::stringstream& getSS();
+    std::ostream& getSS();
 
 private:
     LogEvent::ptr m_event;
@@ -189,6 +495,13 @@ public:
 
 std::ostream& format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
 
+    /**
+     * @brief   格式化后追加到out后面
+     * @details 不经过ostream和FormatItem，按init时编译好的指令直接写字符，
+     *          %d的时间每个线程按秒缓存，同一秒内不再调用localtime_r/strftime
+     */
+    void format(std::string& out, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event);
+
 public:
     /**
     * @brief   日志内容格式化项
@@ -209,9 +522,48 @@ public:
 
     const std::string getPattern() const { return m_pattern; }
 
+private:
+    /**
+     * @brief   编译好的格式化指令
+     */
+    struct Op
+    {
+        enum Type
+        {
+            STRING,
+            MESSAGE,
+            LEVEL,
+            ELAPSE,
+            NAME,
+            THREAD_ID,
+            NEWLINE,
+            DATETIME,
+            FILENAME,
+            LINE,
+            TAB,
+            FIBER_ID,
+            THREAD_NAME,
+            TRACE_ID
+        };
+        Type type;
+        /// STRING是要打印的字符串，DATETIME是时间格式，在m_strings中的下标
+        uint32_t arg;
+    };
+
+    /**
+     * @brief   把%xxx{yyy}编译成一条指令
+     *
+     * @return  不认识的xxx返回false
+     */
+    bool compile(const std::string& str, const std::string& fmt);
+
 private:
     std::string m_pattern;
     std::vector<FormatItem::ptr> m_items;
+    std::vector<Op> m_ops;
+    std::vector<std::string> m_strings;
+    /// 唯一id，做时间缓存的key
+    uint64_t m_id;
     bool m_error;
 };
 
@@ -231,15 +583,37 @@ public:
     virtual void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
     virtual std::string toYamlString() = 0;
 
+    /**
+     * @brief   把一批格式化好的日志写出去，异步模式下由后台线程调用
+     */
+    virtual void writeBatch(const iovec* buffers, int count) {}
+
     void setFormatter(LogFormatter::ptr val);
     LogFormatter::ptr getFormatter();
     LogLevel::Level getLevel() const { return m_level; }
     void setLevel(LogLevel::Level val) { m_level = val; }
 
+protected:
+    /**
+     * @brief   异步模式下格式化日志并交给后台线程，由writeBatch写出
+     *
+     * @return  没开启异步模式或者需要同步写时返回false，由调用者自己写
+     */
+    bool logAsync(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+
+    /**
+     * @brief   等后台线程把这个appender的日志写完
+     * @details 后台线程会调用虚函数，每个具体的子类都要在自己的析构函数里调用，
+     *          不能只靠父类的析构函数
+     */
+    void flushAsync();
+
 protected:
     LogLevel::Level m_level = LogLevel::DEBUG;
     /// 是否有自己的日志格式器
     bool m_hasFormatter = false;
+    /// 是否有日志交给了后台线程
+    std::atomic<bool> m_asyncUsed = {false};
     MutexType m_mutex;
     LogFormatter::ptr m_formatter;
 };
@@ -252,8 +626,11 @@ class StdoutLogAppender : public LogAppender
 public:
     typedef std::shared_ptr<StdoutLogAppender> ptr;
 
+    ~StdoutLogAppender();
+
     void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
     std::string toYamlString() override;
+    void writeBatch(const iovec* buffers, int count) override;
 };
 
 /**
@@ -265,17 +642,107 @@ public:
     typedef std::shared_ptr<FileLogAppender> ptr;
 
     FileLogAppender(const std::string& filename);
+    ~FileLogAppender();
 
     void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
     std::string toYamlString() override;
+    void writeBatch(const iovec* buffers, int count) override;
 
     bool reopen();
 
-private:
+protected:
+    /**
+     * @brief   写之前调用(已加锁)，每秒检查一次文件是否被移走或删除(inode变了)，是的话重新打开
+     *
+     * @param   now     当前时间(秒)
+     * @param   len     这次要写的字节数
+     */
+    virtual void prepareWrite(uint64_t now, size_t len);
+
+    /**
+     * @brief   打开m_filename，关掉旧的，记录inode和大小(已加锁)
+     */
+    bool openFile();
+
+protected:
     std::string m_filename;
-    std::ofstream m_filestream;
-    /// 上次重新打开的时间
+    /// 文件描述符，O_APPEND打开
+    int m_fd = -1;
+    /// 上次检查文件的时间
     uint64_t m_lastTime;
+    /// 打开的文件的设备号和inode
+    dev_t m_dev = 0;
+    ino_t m_ino = 0;
+    /// 文件大小(打开时的大小加上写入的字节数)
+    uint64_t m_fileSize = 0;
+    /// 打开文件的时间
+    uint64_t m_openTime = 0;
+};
+
+/**
+ * @brief   按大小/时间切分的文件输出
+ * @details 文件超过max_size字节，或者过了整点/零点(rotate为HOUR/DAY)时，把当前文件改名为
+ *          文件名.打开时间(年月日-时分秒)，再打开一个新文件；只保留最近max_files个切出来的文件。
+ *          切出来的文件在后台线程里用gzip压缩(文件名加.gz)，清理旧文件也在后台线程做。
+ *          切分发生在写的线程里(异步模式下是日志后台线程)。
+ */
+class RotatingFileLogAppender : public FileLogAppender
+{
+public:
+    typedef std::shared_ptr<RotatingFileLogAppender> ptr;
+
+    enum Rotate
+    {
+        /// 不按时间切分
+        NONE = 0,
+        HOUR = 1,
+        DAY = 2,
+    };
+
+    /**
+     * @brief   构造函数
+     *
+     * @param   filename    文件名
+     * @param   max_size    文件最大字节数，0表示不按大小切分
+     * @param   rotate      按时间切分的周期
+     * @param   max_files   保留几个切出来的文件，0表示不删除
+     * @param   compress    是否压缩切出来的文件
+     */
+    RotatingFileLogAppender(const std::string& filename, uint64_t max_size
+                            , Rotate rotate = NONE, uint32_t max_files = 0, bool compress = true);
+    ~RotatingFileLogAppender();
+
+    std::string toYamlString() override;
+
+    /**
+     * @brief   立即切分一次
+     */
+    void rotate();
+
+    static Rotate RotateFromString(const std::string& str);
+    static const char* RotateToString(Rotate rotate);
+
+protected:
+    void prepareWrite(uint64_t now, size_t len) override;
+
+private:
+    /**
+     * @brief   改名、打开新文件，把压缩和清理交给后台线程(已加锁)
+     */
+    void doRotate();
+
+    /**
+     * @brief   计算下一次按时间切分的时间
+     */
+    uint64_t getNextRotateTime(uint64_t now) const;
+
+private:
+    uint64_t m_maxSize;
+    Rotate m_rotate;
+    uint32_t m_maxFiles;
+    bool m_compress;
+    /// 下一次按时间切分的时间
+    uint64_t m_nextRotateTime = 0;
 };
 
 /**
@@ -289,6 +756,7 @@ public:
     typedef Spinlock MutexType;
 
     Logger(const std::string& name = "root"); 
+    ~Logger();
     
     void log(LogLevel::Level level, LogEvent::ptr event); 
     void debug(LogEvent::ptr event); 
@@ -301,22 +769,45 @@ public:
     void delAppender(LogAppender::ptr appender);
     void clearAppenders();
 
-    void setLevel(LogLevel::Level val) { m_level = val; }
+    /**
+     * @brief   设置日志级别，会让所有日志调用点的缓存失效
+     */
+    void setLevel(LogLevel::Level val);
     LogLevel::Level getLevel() const { return m_level; }
     void setFormatter(LogFormatter::ptr val);
     void setFormatter(const std::string& val);
     LogFormatter::ptr getFormatter();
     const std::string& getName() const { return m_name; }
+
+    /**
+     * @brief   设置这个logger的总预算：每秒最多输出rate条，最多攒burst条，rate为0不限制
+     */
+    void setRateLimit(uint32_t rate, uint32_t burst = 0);
+    uint32_t getRateLimit() const { return m_rateLimit; }
+
+    /**
+     * @brief   直接交给appender输出，不检查级别和预算
+     */
+    void write(LogLevel::Level level, LogEvent::ptr event);
     
     std::string toYamlString();
 
+private:
+    typedef std::vector<LogAppender::ptr> AppenderList;
+
 private:
     std::string m_name;
     LogLevel::Level m_level;
+    /// 修改appender列表、格式器时加锁，写日志不加锁
     MutexType m_mutex;
-    std::list<LogAppender::ptr> m_appenders;
+    /// appender列表，写时复制：修改时复制一份再原子地替换，log()原子地取一份快照来遍历
+    std::shared_ptr<const AppenderList> m_appenders;
     LogFormatter::ptr m_formatter;
     Logger::ptr m_root;
+    /// 每秒最多输出多少条，0不限制
+    std::atomic<uint32_t> m_rateLimit = {0};
+    std::atomic<uint32_t> m_rateBurst = {0};
+    LogRateLimiter m_budget;
 };
 
 /**
@@ -337,13 +828,123 @@ public:
     std::string toYamlString();
 
 private:
+    typedef std::map<std::string, Logger::ptr> LoggerMap;
+
+private:
+    /// 新建logger时加锁，查找不加锁
     MutexType m_mutex;
-    std::map<std::string, Logger::ptr> m_loggers;
+    /// 所有logger，写时复制，getLogger原子地取一份快照来查找
+    std::shared_ptr<const LoggerMap> m_loggers;
     Logger::ptr m_root;
 };
 
 typedef sylar::Singleton<LoggerManager> LoggerMgr;
 
+/**
+ * @brief   异步日志后台
+ * @details 开启log.async.enable后，appender在调用线程上格式化日志，
+ *          写进本线程的无锁环形缓冲(单生产者单消费者)，由后台线程批量取出后writev写出。
+ *          同一个线程的日志保持顺序，不同线程之间不保证顺序。
+ *          缓冲满时按log.async.overflow处理：
+ *          - block         等后台线程腾出空间
+ *          - drop          丢弃并计数
+ *          - drop_below    低于log.async.drop_level的丢弃，其余等待
+ *          对象创建后不会析构，进程退出时(atexit)把缓冲里剩下的日志写完再停止后台线程
+ */
+class AsyncLogBackend : Noncopyable
+{
+public:
+    enum OverflowPolicy
+    {
+        BLOCK = 0,
+        DROP = 1,
+        DROP_BELOW = 2
+    };
+
+    static AsyncLogBackend* GetInstance();
+
+    /**
+     * @brief   是否开启了异步模式
+     */
+    static bool IsEnabled();
+
+    /**
+     * @brief   把一条格式化好的日志放进当前线程的缓冲
+     *
+     * @return  返回false表示需要调用者同步写(后台已停止、日志太长、在后台线程上调用)
+     *          被丢弃时也返回true
+     */
+    bool push(LogAppender* appender, LogLevel::Level level, const char* data, size_t len);
+
+    /**
+     * @brief   等待调用之前放进缓冲的日志全部写出
+     */
+    void flush();
+
+    /**
+     * @brief   写完剩下的日志并停止后台线程，之后的日志都同步写
+     */
+    void stop();
+
+    void setOverflowPolicy(OverflowPolicy policy, LogLevel::Level drop_level);
+
+    /**
+     * @brief   设置每个线程的缓冲大小，只对之后新建的缓冲生效
+     */
+    void setBufferSize(size_t size);
+
+    /**
+     * @brief   丢弃的日志总数
+     */
+    uint64_t getDropped() const;
+
+    /**
+     * @brief   某个级别丢弃的日志数
+     */
+    uint64_t getDropped(LogLevel::Level level) const { return m_dropped[level]; }
+
+private:
+    struct Ring;
+
+    AsyncLogBackend();
+
+    /**
+     * @brief   当前线程的缓冲，第一次调用时创建(或复用已退出线程的缓冲)
+     */
+    Ring* getRing();
+
+    /**
+     * @brief   后台线程是空闲的就唤醒它
+     */
+    void wakeup();
+
+    /**
+     * @brief   把所有缓冲里的日志写出去
+     *
+     * @return  写出的日志条数
+     */
+    size_t drainAll();
+
+    void run();
+
+private:
+    Spinlock m_mutex;
+    std::vector<Ring*> m_rings;
+    Thread::ptr m_thread;
+    Semaphore m_sem;
+    /// 后台线程是否在等待唤醒
+    std::atomic<bool> m_idle = {false};
+    std::atomic<bool> m_stopping = {false};
+    std::atomic<bool> m_stopped = {false};
+    std::atomic<int> m_policy = {BLOCK};
+    std::atomic<int> m_dropLevel = {LogLevel::WARN};
+    std::atomic<size_t> m_bufferSize = {256 * 1024};
+    std::atomic<uint64_t> m_dropped[LogLevel::FATAL + 1];
+    /// 上次报告丢弃数时的总数
+    uint64_t m_lastReported = 0;
+    uint64_t m_lastReportTime = 0;
+};
+
 };
 
 #endif
@@ -0,0 +1,467 @@
+#include "log_binary.h"
+#include "config.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+
+namespace sylar
+{
+
+static ConfigVar<uint32_t>::ptr g_log_binary_segment_size =
+    Config::Lookup("log.binary.segment_size", (uint32_t)(64 * 1024 * 1024), "binary log segment file size");
+
+const char BinaryLogFormat::MAGIC[8] = {'S', 'Y', 'L', 'O', 'G', 'S', 'E', 'G'};
+
+/// 记录头：uint32总长度 + uint8类型
+static const size_t s_record_header_size = 5;
+
+/// 日志记录除了内容以外的长度
+static const size_t s_event_fixed_size = s_record_header_size + 4 + 1 + 4 + 4 + 8 + 4 + 4 + 4;
+
+template<class T>
+static void Put(char*& p, const T& v)
+{
+    memcpy(p, &v, sizeof(v));
+    p += sizeof(v);
+}
+
+static void PutBytes(char*& p, const void* data, size_t len)
+{
+    memcpy(p, data, len);
+    p += len;
+}
+
+template<class T>
+static bool Take(const char*& p, const char* end, T& v)
+{
+    if((size_t)(end - p) < sizeof(v))
+    {
+        return false;
+    }
+    memcpy(&v, p, sizeof(v));
+    p += sizeof(v);
+    return true;
+}
+
+/**
+ * @brief   写记录头，总长度最后写，写到一半崩溃时读的一方看到的是0(段结束)
+ */
+static void FinishRecord(char* begin, char* end, uint8_t type)
+{
+    begin[4] = type;
+    uint32_t len = end - begin;
+    memcpy(begin, &len, sizeof(len));
+}
+
+BinaryLogAppender::BinaryLogAppender(const std::string& prefix, uint32_t segment_size)
+    : m_prefix(prefix)
+    , m_segmentSize(segment_size ? segment_size : g_log_binary_segment_size->getValue())
+{
+    LogArgs::EnableCapture();
+}
+
+BinaryLogAppender::~BinaryLogAppender()
+{
+    MutexType::Lock lk(m_mutex);
+    closeSegment();
+    LogArgs::DisableCapture();
+}
+
+bool BinaryLogAppender::openSegment()
+{
+    char tm[32];
+    time_t now = time(0);
+    struct tm t;
+    localtime_r(&now, &t);
+    strftime(tm, sizeof(tm), "%Y%m%d-%H%M%S", &t);
+    // 序号补齐位数，按文件名排序就是写入顺序
+    char seq[16];
+    snprintf(seq, sizeof(seq), "%06u", m_segmentCount++);
+    m_segmentName = m_prefix + "." + tm + "." + std::to_string(getpid())
+                  + "." + seq + ".slog";
+
+    int fd = ::open(m_segmentName.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        FSUtil::Mkdir(FSUtil::Dirname(m_segmentName));
+        fd = ::open(m_segmentName.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if(fd < 0)
+    {
+        std::cout << "open binary log segment " << m_segmentName << " error: "
+                  << strerror(errno) << std::endl;
+        return false;
+    }
+    if(ftruncate(fd, m_segmentSize) != 0)
+    {
+        std::cout << "ftruncate binary log segment " << m_segmentName << " error: "
+                  << strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, m_segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(data == MAP_FAILED)
+    {
+        std::cout << "mmap binary log segment " << m_segmentName << " error: "
+                  << strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+    m_fd = fd;
+    m_data = (char*)data;
+    m_sites.clear();
+    m_names.clear();
+    m_nextId = 0;
+
+    std::string pattern = m_formatter ? m_formatter->getPattern() : "";
+    char* p = m_data;
+    PutBytes(p, BinaryLogFormat::MAGIC, sizeof(BinaryLogFormat::MAGIC));
+    Put(p, (uint32_t)BinaryLogFormat::VERSION);
+    Put(p, (uint32_t)pattern.size());
+    PutBytes(p, pattern.c_str(), pattern.size());
+    m_used = p - m_data;
+    return true;
+}
+
+void BinaryLogAppender::closeSegment()
+{
+    if(!m_data)
+    {
+        return;
+    }
+    munmap(m_data, m_segmentSize);
+    // 没写满的部分截掉，读的时候到文件末尾就结束
+    if(ftruncate(m_fd, m_used) != 0)
+    {
+        std::cout << "ftruncate binary log segment " << m_segmentName << " error: "
+                  << strerror(errno) << std::endl;
+    }
+    ::close(m_fd);
+    m_fd = -1;
+    m_data = nullptr;
+    m_used = 0;
+}
+
+bool BinaryLogAppender::reserve(size_t size)
+{
+    if(m_data && m_used + size <= m_segmentSize)
+    {
+        return true;
+    }
+    closeSegment();
+    return openSegment() && m_used + size <= m_segmentSize;
+}
+
+uint32_t BinaryLogAppender::getSiteId(LogEvent::ptr event)
+{
+    SiteKey key = {event->getFile(), event->getLine(), event->getFormat()};
+    auto it = m_sites.find(key);
+    if(it != m_sites.end() && (!key.fmt || it->second.fmt == key.fmt))
+    {
+        return it->second.id;
+    }
+
+    Site& site = m_sites[key];
+    site.id = m_nextId++;
+    site.fmt = key.fmt ? key.fmt : "";
+
+    uint16_t file_len = key.file ? strnlen(key.file, UINT16_MAX) : 0;
+    char* begin = m_data + m_used;
+    char* p = begin + s_record_header_size;
+    Put(p, site.id);
+    Put(p, key.line);
+    Put(p, file_len);
+    PutBytes(p, key.file, file_len);
+    Put(p, (uint32_t)site.fmt.size());
+    PutBytes(p, site.fmt.c_str(), site.fmt.size());
+    FinishRecord(begin, p, BinaryLogFormat::SITE);
+    m_used = p - m_data;
+    return site.id;
+}
+
+uint32_t BinaryLogAppender::getNameId(const std::string& name)
+{
+    auto it = m_names.find(name);
+    if(it != m_names.end())
+    {
+        return it->second;
+    }
+
+    uint32_t id = m_nextId++;
+    m_names[name] = id;
+    uint16_t len = std::min(name.size(), (size_t)UINT16_MAX);
+    char* begin = m_data + m_used;
+    char* p = begin + s_record_header_size;
+    Put(p, id);
+    Put(p, len);
+    PutBytes(p, name.c_str(), len);
+    FinishRecord(begin, p, BinaryLogFormat::NAME);
+    m_used = p - m_data;
+    return id;
+}
+
+void BinaryLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+{
+    if(level < m_level)
+    {
+        return;
+    }
+
+    const char* fmt = event->getFormat();
+    const char* file = event->getFile();
+    const std::string& logger_name = logger->getName();
+    const std::string& thread_name = event->getThreadName();
+    // trace id每个请求都不一样，不放进名字表，直接写在日志记录里
+    const std::string& trace_id = event->getTraceId();
+    uint16_t trace_len = std::min(trace_id.size(), (size_t)UINT16_MAX);
+    // 最坏情况下调用点和两个名字都要写定义记录
+    size_t defs = s_record_header_size * 3 + 4 + 4 + 2 + (file ? strlen(file) : 0) + 4 + (fmt ? strlen(fmt) : 0)
+                + 4 + 2 + logger_name.size() + 4 + 2 + thread_name.size() + 2 + trace_len;
+    size_t payload = fmt ? event->getArgs().size() : event->getContentSize();
+
+    MutexType::Lock lk(m_mutex);
+    size_t segment_header = sizeof(BinaryLogFormat::MAGIC) + 8
+                          + (m_formatter ? m_formatter->getPattern().size() : 0);
+    if(segment_header + defs + s_event_fixed_size + payload > m_segmentSize)
+    {
+        // 一个段都放不下，只能保存截断后的文本
+        if(segment_header + defs + s_event_fixed_size >= m_segmentSize)
+        {
+            return;
+        }
+        // 参数放不进一个段，没法按fmt+参数保存：先按参数把文本格式化出来，
+        // 再丢掉fmt，下面按文本记录，放不下的部分截掉
+        size_t content_size = event->getContentSize();
+        fmt = nullptr;
+        payload = std::min(content_size, m_segmentSize - segment_header - defs - s_event_fixed_size);
+    }
+    if(!reserve(defs + s_event_fixed_size + payload))
+    {
+        return;
+    }
+
+    uint32_t site_id = getSiteId(event);
+    uint32_t logger_id = getNameId(logger_name);
+    uint32_t thread_id = getNameId(thread_name);
+
+    char* begin = m_data + m_used;
+    char* p = begin + s_record_header_size;
+    Put(p, site_id);
+    Put(p, (uint8_t)level);
+    Put(p, logger_id);
+    Put(p, thread_id);
+    Put(p, event->getTime());
+    Put(p, event->getElapse());
+    Put(p, event->getThreadId());
+    Put(p, event->getFiberId());
+    Put(p, trace_len);
+    PutBytes(p, trace_id.data(), trace_len);
+    if(fmt)
+    {
+        PutBytes(p, event->getArgs().data(), payload);
+    }
+    else
+    {
+        PutBytes(p, event->getContentData(), std::min(payload, event->getContentSize()));
+    }
+    FinishRecord(begin, p, BinaryLogFormat::EVENT);
+    m_used = p - m_data;
+}
+
+void BinaryLogAppender::sync()
+{
+    MutexType::Lock lk(m_mutex);
+    if(m_data)
+    {
+        msync(m_data, m_used, MS_SYNC);
+    }
+}
+
+std::string BinaryLogAppender::getSegmentName()
+{
+    MutexType::Lock lk(m_mutex);
+    return m_segmentName;
+}
+
+std::string BinaryLogAppender::toYamlString()
+{
+    MutexType::Lock lk(m_mutex);
+    YAML::Node node;
+    node["type"] = "BinaryLogAppender";
+    node["file"] = m_prefix;
+    if(m_level != LogLevel::UNKNOW)
+    {
+        node["level"] = LogLevel::ToString(m_level);
+    }
+    if(m_hasFormatter && m_formatter)
+    {
+        node["formatter"] = m_formatter->getPattern();
+    }
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
+
+BinaryLogReader::BinaryLogReader(const std::string& filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        return;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED)
+    {
+        return;
+    }
+
+    const char* p = (const char*)data;
+    const char* end = p + st.st_size;
+    char magic[sizeof(BinaryLogFormat::MAGIC)];
+    uint32_t version = 0;
+    uint32_t pattern_len = 0;
+    if(!Take(p, end, magic)
+            || memcmp(magic, BinaryLogFormat::MAGIC, sizeof(magic)) != 0
+            || !Take(p, end, version)
+            || version != BinaryLogFormat::VERSION
+            || !Take(p, end, pattern_len)
+            || (size_t)(end - p) < pattern_len)
+    {
+        munmap(data, st.st_size);
+        return;
+    }
+    m_pattern.assign(p, pattern_len);
+    p += pattern_len;
+
+    m_data = (const char*)data;
+    m_size = st.st_size;
+    m_pos = p - m_data;
+}
+
+BinaryLogReader::~BinaryLogReader()
+{
+    if(m_data)
+    {
+        munmap((void*)m_data, m_size);
+    }
+}
+
+Logger::ptr BinaryLogReader::getLogger(uint32_t id)
+{
+    auto it = m_loggers.find(id);
+    if(it != m_loggers.end())
+    {
+        return it->second;
+    }
+    Logger::ptr logger(new Logger(m_names[id]));
+    m_loggers[id] = logger;
+    return logger;
+}
+
+LogEvent::ptr BinaryLogReader::next()
+{
+    while(m_data && m_pos + s_record_header_size <= m_size)
+    {
+        const char* begin = m_data + m_pos;
+        uint32_t len = 0;
+        memcpy(&len, begin, sizeof(len));
+        if(len < s_record_header_size || m_pos + len > m_size)
+        {
+            // 0是段结束，其它是写到一半的记录
+            return nullptr;
+        }
+        m_pos += len;
+        uint8_t type = begin[4];
+        const char* p = begin + s_record_header_size;
+        const char* end = begin + len;
+
+        if(type == BinaryLogFormat::SITE)
+        {
+            uint32_t id = 0;
+            int32_t line = 0;
+            uint16_t file_len = 0;
+            uint32_t fmt_len = 0;
+            if(!Take(p, end, id) || !Take(p, end, line) || !Take(p, end, file_len)
+                    || (size_t)(end - p) < file_len)
+            {
+                return nullptr;
+            }
+            Site& site = m_sites[id];
+            site.line = line;
+            site.file.assign(p, file_len);
+            p += file_len;
+            if(!Take(p, end, fmt_len) || (size_t)(end - p) < fmt_len)
+            {
+                return nullptr;
+            }
+            site.fmt.assign(p, fmt_len);
+        }
+        else if(type == BinaryLogFormat::NAME)
+        {
+            uint32_t id = 0;
+            uint16_t name_len = 0;
+            if(!Take(p, end, id) || !Take(p, end, name_len) || (size_t)(end - p) < name_len)
+            {
+                return nullptr;
+            }
+            m_names[id].assign(p, name_len);
+            m_loggers.erase(id);
+        }
+        else if(type == BinaryLogFormat::EVENT)
+        {
+            uint32_t site_id = 0;
+            uint8_t level = 0;
+            uint32_t logger_id = 0;
+            uint32_t thread_name_id = 0;
+            uint64_t time = 0;
+            uint32_t elapse = 0;
+            uint32_t thread_id = 0;
+            uint32_t fiber_id = 0;
+            uint16_t trace_len = 0;
+            if(!Take(p, end, site_id) || !Take(p, end, level) || !Take(p, end, logger_id)
+                    || !Take(p, end, thread_name_id) || !Take(p, end, time) || !Take(p, end, elapse)
+                    || !Take(p, end, thread_id) || !Take(p, end, fiber_id)
+                    || !Take(p, end, trace_len) || (size_t)(end - p) < trace_len)
+            {
+                return nullptr;
+            }
+            auto it = m_sites.find(site_id);
+            if(it == m_sites.end())
+            {
+                return nullptr;
+            }
+            const Site& site = it->second;
+            LogEvent::ptr event(new LogEvent(getLogger(logger_id), (LogLevel::Level)level
+                        , site.file.c_str(), site.line, elapse, thread_id, fiber_id, time
+                        , m_names[thread_name_id]));
+            event->setTraceId(std::string(p, trace_len));
+            p += trace_len;
+            if(site.fmt.empty())
+            {
+                event->getSS().write(p, end - p);
+            }
+            else
+            {
+                std::string text;
+                if(!LogArgs::Decode(site.fmt.c_str(), p, end - p, text))
+                {
+                    text = "<bad args: " + site.fmt + ">";
+                }
+                event->getSS() << text;
+            }
+            return event;
+        }
+    }
+    return nullptr;
+}
+
+}
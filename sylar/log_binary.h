@@ -0,0 +1,212 @@
+/**
+ * @filename    log_binary.h
+ * @brief   二进制日志(写入内存映射的段文件，离线解码)
+ * @author  L-ge
+ * @version 0.1
+ * @modify  2022-08-06
+ */
+#ifndef __SYLAR_LOG_BINARY_H__
+#define __SYLAR_LOG_BINARY_H__
+
+#include <string>
+#include <unordered_map>
+#include "log.h"
+
+namespace sylar
+{
+
+/**
+ * @brief   二进制日志段文件的格式
+ * @details 文件开头是段头：8字节魔数"SYLOGSEG"、uint32版本号、uint32格式串长度、
+ *          写入时appender的日志格式(sylar_logcat默认用它还原)；
+ *          后面是一条条记录，每条记录是uint32总长度(含自己)、uint8类型、内容，
+ *          总长度为0表示段结束。数值都是本机字节序。
+ *          调用点和名字(logger名、线程名)在每个段里第一次用到时先写一条定义记录，
+ *          日志记录里只写它们的id，所以每个段都能单独解码。
+ */
+struct BinaryLogFormat
+{
+    static const char MAGIC[8];
+    static const uint32_t VERSION = 2;
+
+    enum RecordType
+    {
+        /// 调用点定义：uint32 id、int32 行号、uint16 文件名长度、文件名、uint32 格式串长度、格式串
+        SITE = 1,
+        /// 名字定义：uint32 id、uint16 长度、名字
+        NAME = 2,
+        /// 日志：uint32 调用点id、uint8 级别、uint32 logger名id、uint32 线程名id、uint64 时间、
+        ///       uint32 运行毫秒数、uint32 线程id、uint32 协程id、uint16 trace id长度、trace id，
+        ///       后面是原始参数(调用点有格式串)或者日志文本
+        EVENT = 3,
+    };
+};
+
+/**
+ * @brief   二进制日志输出
+ * @details 不格式化文本：SYLAR_LOG_FMT_*只写格式串id和原始参数，流式日志写日志文本，
+ *          加上时间、线程、协程等字段；写入mmap的段文件只是内存拷贝，不需要系统调用，
+ *          所以不走异步日志的后台线程。段写满后换下一个，文件名是
+ *          前缀.年月日-时分秒.进程号.序号.slog(序号6位补0)，用sylar_logcat还原成文本。
+ */
+class BinaryLogAppender : public LogAppender
+{
+public:
+    typedef std::shared_ptr<BinaryLogAppender> ptr;
+
+    /**
+     * @brief   构造函数
+     *
+     * @param   prefix          段文件名前缀(可以带目录)
+     * @param   segment_size    每个段文件的大小，0表示使用配置 log.binary.segment_size
+     */
+    BinaryLogAppender(const std::string& prefix, uint32_t segment_size = 0);
+    ~BinaryLogAppender();
+
+    void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
+    std::string toYamlString() override;
+
+    /**
+     * @brief   把当前段刷到磁盘(msync)
+     */
+    void sync();
+
+    /**
+     * @brief   当前段的文件名
+     */
+    std::string getSegmentName();
+
+private:
+    struct SiteKey
+    {
+        const char* file;
+        int32_t line;
+        const char* fmt;
+
+        bool operator==(const SiteKey& oth) const
+        {
+            return file == oth.file && line == oth.line && fmt == oth.fmt;
+        }
+    };
+
+    struct SiteKeyHash
+    {
+        size_t operator()(const SiteKey& k) const
+        {
+            return std::hash<const void*>()(k.file) ^ (k.line * 31) ^ std::hash<const void*>()(k.fmt);
+        }
+    };
+
+    struct Site
+    {
+        uint32_t id;
+        /// 格式串的内容，同一个地址可能放过不同的格式串(非字面量)
+        std::string fmt;
+    };
+
+    /**
+     * @brief   打开一个新段，写段头
+     */
+    bool openSegment();
+
+    /**
+     * @brief   截掉没用到的部分，关闭当前段
+     */
+    void closeSegment();
+
+    /**
+     * @brief   保证当前段还能写size字节，不够就换一个新段
+     */
+    bool reserve(size_t size);
+
+    /**
+     * @brief   取调用点的id，这个段里第一次用到时写定义记录
+     */
+    uint32_t getSiteId(LogEvent::ptr event);
+
+    /**
+     * @brief   取名字的id，这个段里第一次用到时写定义记录
+     */
+    uint32_t getNameId(const std::string& name);
+
+private:
+    /// 段文件名前缀
+    std::string m_prefix;
+    /// 段文件大小
+    uint32_t m_segmentSize;
+    /// 当前段的文件名
+    std::string m_segmentName;
+    /// 当前段的文件描述符
+    int m_fd = -1;
+    /// 当前段的映射地址
+    char* m_data = nullptr;
+    /// 当前段已经写了多少字节
+    size_t m_used = 0;
+    /// 打开过几个段
+    uint32_t m_segmentCount = 0;
+    /// 当前段里定义过的调用点
+    std::unordered_map<SiteKey, Site, SiteKeyHash> m_sites;
+    /// 当前段里定义过的名字
+    std::unordered_map<std::string, uint32_t> m_names;
+    /// 下一个id
+    uint32_t m_nextId = 0;
+};
+
+/**
+ * @brief   读二进制日志段文件，还原成LogEvent
+ */
+class BinaryLogReader
+{
+public:
+    typedef std::shared_ptr<BinaryLogReader> ptr;
+
+    BinaryLogReader(const std::string& filename);
+    ~BinaryLogReader();
+
+    /**
+     * @brief   是否成功打开并且段头正确
+     */
+    bool isValid() const { return m_data != nullptr; }
+
+    /**
+     * @brief   写入时appender的日志格式
+     */
+    const std::string& getPattern() const { return m_pattern; }
+
+    /**
+     * @brief   读下一条日志，内容已经还原成文本
+     *
+     * @return  读完了或者数据损坏返回nullptr
+     */
+    LogEvent::ptr next();
+
+private:
+    struct Site
+    {
+        std::string file;
+        int32_t line;
+        std::string fmt;
+    };
+
+    /**
+     * @brief   取名字对应的Logger，只是用来给LogFormatter取名字
+     */
+    Logger::ptr getLogger(uint32_t id);
+
+private:
+    /// 文件映射地址
+    const char* m_data = nullptr;
+    /// 文件大小
+    size_t m_size = 0;
+    /// 读到的位置
+    size_t m_pos = 0;
+    std::string m_pattern;
+    /// 用unordered_map，LogEvent里保存的文件名指针不会因为扩容失效
+    std::unordered_map<uint32_t, Site> m_sites;
+    std::unordered_map<uint32_t, std::string> m_names;
+    std::unordered_map<uint32_t, Logger::ptr> m_loggers;
+};
+
+}
+
+#endif
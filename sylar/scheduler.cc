@@ -275,6 +275,7 @@ void Scheduler::run()
             {
                 cb_fiber.reset(new Fiber(ft.cb));
             }
+            cb_fiber->setLocals(ft.locals);
             ft.reset();
             cb_fiber->swapIn();
             --m_activeThreadCount;
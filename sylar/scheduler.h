@@ -120,6 +120,8 @@ private:
     {
         Fiber::ptr fiber;
         std::function<void()> cb;
+        /// cb任务在执行时继承的协程局部变量，即调用schedule时所在协程的
+        Fiber::LocalMapPtr locals;
         int thread;
 
         FiberAndThread(Fiber::ptr f, int thr)
@@ -135,11 +137,13 @@ private:
 
         FiberAndThread(std::function<void()> f, int thr)
             : cb(f)
+            , locals(Fiber::GetLocals())
             , thread(thr)
         {}
 
         FiberAndThread(std::function<void()>* f, int thr)
-            : thread(thr)
+            : locals(Fiber::GetLocals())
+            , thread(thr)
         {
             cb.swap(*f);        
         }
@@ -152,6 +156,7 @@ private:
         {
             fiber = nullptr;
             cb = nullptr;
+            locals = nullptr;
             thread = -1;
         }
     };
@@ -5,6 +5,7 @@
 #include "hook.h"
 #include "macro.h"
 #include "util.h"
+#include <poll.h>
 
 namespace sylar
 {
@@ -154,6 +155,65 @@ Socket::ptr Socket::accept()
     return nullptr;
 }
 
+int Socket::acceptBatch(std::vector<Socket::ptr>& socks, size_t max_count
+                      , uint64_t recv_timeout)
+{
+    // 监听socket可能是在没开hook的线程创建的，这里确保它是非阻塞的，
+    // 否则取完已有的连接后accept4会阻塞住，这一批就发不出去
+    FdMgr::GetInstance()->get(m_sock, true);
+
+    size_t count = 0;
+    while(count < max_count)
+    {
+        sockaddr_storage addr;
+        socklen_t addrlen = sizeof(addr);
+        // accept4没有被hook，这里是直接的系统调用，不会让出协程
+        int newsock = ::accept4(m_sock, (sockaddr*)&addr, &addrlen
+                            , SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(newsock == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            if(errno == EAGAIN && count == 0)
+            {
+                // 一个连接都没有，等监听socket可读再来
+                IOManager* iom = IOManager::GetThis();
+                if(!iom)
+                {
+                    pollfd pfd = {m_sock, POLLIN, 0};
+                    ::poll(&pfd, 1, -1);
+                    continue;
+                }
+                if(iom->addEvent(m_sock, IOManager::READ))
+                {
+                    int err = errno;
+                    SYLAR_LOG_ERROR(g_logger) << "accept(" << m_sock
+                        << ") addEvent error";
+                    errno = err;
+                    return -1;
+                }
+                Fiber::YieldToHold();
+                continue;
+            }
+            if(errno == EAGAIN)
+            {
+                break;
+            }
+            // 不在这里打日志：fd用光时每次都会失败，由调用方限流打印errno
+            return count ? (int)count : -1;
+        }
+
+        FdMgr::GetInstance()->addSocket(newsock, recv_timeout);
+        Socket::ptr sock(new Socket(m_family, m_type, m_protocol));
+        sock->initAccepted(newsock, Address::Create((sockaddr*)&addr, addrlen));
+        socks.push_back(sock);
+        ++count;
+    }
+    return count;
+}
+
 bool Socket::bind(const Address::ptr addr)
 {
     if(!isValid())
@@ -568,6 +628,20 @@ bool Socket::init(int sock)
     }
     return false;
 }
+
+bool Socket::initAccepted(int sock, Address::ptr remote)
+{
+    m_sock = sock;
+    m_isConnected = true;
+    m_remoteAddress = remote;
+    // 接收到的连接不需要SO_REUSEADDR，本地地址用到时再取
+    if(m_type == SOCK_STREAM)
+    {
+        int val = 1;
+        setOption(IPPROTO_TCP, TCP_NODELAY, val);
+    }
+    return true;
+}
 /*
 namespace
 {
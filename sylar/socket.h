@@ -9,6 +9,7 @@
 #define __SYLAR_SOCKET_H__
 
 #include <memory>
+#include <vector>
 #include <netinet/tcp.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -90,6 +91,21 @@ public:
     }
 
     virtual Socket::ptr accept();
+
+    /**
+     * @brief   批量接收连接
+     * @details 用accept4(SOCK_NONBLOCK|SOCK_CLOEXEC)一直取到EAGAIN或者取满max_count，
+     *          新连接的FdCtx直接按非阻塞socket登记，远端地址取自accept4的返回，
+     *          省掉每个连接的fstat/fcntl/getpeername。一个都没有时挂起等可读。
+     *
+     * @param   socks           接收到的连接追加到这里
+     * @param   max_count       这一批最多接收多少个
+     * @param   recv_timeout    新连接的读超时时间(毫秒)
+     *
+     * @return  返回接收到的连接数，出错(包括监听socket被关闭)返回-1，errno是出错原因，不打日志
+     */
+    virtual int acceptBatch(std::vector<Socket::ptr>& socks, size_t max_count
+                          , uint64_t recv_timeout = -1);
     virtual bool bind(const Address::ptr addr);
     virtual bool connect(const Address::ptr addr, uint64_t timeout_ms = -1);
     virtual bool reconnet(uint64_t timeout_ms = -1);
@@ -147,6 +163,11 @@ protected:
     void newSock();
     virtual bool init(int sock);
 
+    /**
+     * @brief   初始化accept4得到的连接，远端地址已知
+     */
+    bool initAccepted(int sock, Address::ptr remote);
+
 protected:
     /// socket句柄
     int m_sock;
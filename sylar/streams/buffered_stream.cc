@@ -0,0 +1,234 @@
+#include "buffered_stream.h"
+#include "sylar/config.h"
+#include <string.h>
+
+namespace sylar
+{
+
+static sylar::ConfigVar<uint32_t>::ptr g_buffered_stream_read_size =
+    sylar::Config::Lookup("stream.buffered.read_size", (uint32_t)(16 * 1024)
+            , "buffered stream read-ahead buffer size");
+
+static sylar::ConfigVar<uint32_t>::ptr g_buffered_stream_write_size =
+    sylar::Config::Lookup("stream.buffered.write_size", (uint32_t)(16 * 1024)
+            , "buffered stream write buffer flush threshold");
+
+BufferedStream::BufferedStream(Stream::ptr stream, size_t read_size, size_t write_size)
+    : m_stream(stream)
+    , m_rpos(0)
+    , m_rend(0)
+    , m_wbuf(new ByteArray)
+    , m_writeSize(write_size ? write_size : g_buffered_stream_write_size->getValue())
+{
+    m_rbuf.resize(read_size ? read_size : g_buffered_stream_read_size->getValue());
+}
+
+BufferedStream::~BufferedStream()
+{
+    flush();
+}
+
+int BufferedStream::fill()
+{
+    if(m_rpos == m_rend)
+    {
+        m_rpos = m_rend = 0;
+    }
+    else if(m_rend == m_rbuf.size())
+    {
+        // 后面没空间了，把未读的数据挪到开头
+        memmove(&m_rbuf[0], &m_rbuf[m_rpos], m_rend - m_rpos);
+        m_rend -= m_rpos;
+        m_rpos = 0;
+    }
+    if(m_rend == m_rbuf.size())
+    {
+        // 缓冲满了都是未读数据，扩大一倍
+        m_rbuf.resize(m_rbuf.size() * 2);
+    }
+
+    int rt = m_stream->read(&m_rbuf[m_rend], m_rbuf.size() - m_rend);
+    if(rt > 0)
+    {
+        m_rend += rt;
+    }
+    return rt;
+}
+
+int BufferedStream::read(void* buffer, size_t length)
+{
+    if(length == 0)
+    {
+        return 0;
+    }
+    if(m_rpos == m_rend)
+    {
+        // 缓冲是空的，要的比缓冲还大就直接读，省一次拷贝
+        if(length >= m_rbuf.size())
+        {
+            return m_stream->read(buffer, length);
+        }
+        int rt = fill();
+        if(rt <= 0)
+        {
+            return rt;
+        }
+    }
+
+    size_t len = std::min(length, m_rend - m_rpos);
+    memcpy(buffer, &m_rbuf[m_rpos], len);
+    m_rpos += len;
+    return len;
+}
+
+int BufferedStream::read(ByteArray::ptr ba, size_t length)
+{
+    if(length == 0)
+    {
+        return 0;
+    }
+    if(m_rpos == m_rend)
+    {
+        if(length >= m_rbuf.size())
+        {
+            return m_stream->read(ba, length);
+        }
+        int rt = fill();
+        if(rt <= 0)
+        {
+            return rt;
+        }
+    }
+
+    size_t len = std::min(length, m_rend - m_rpos);
+    ba->write(&m_rbuf[m_rpos], len);
+    m_rpos += len;
+    return len;
+}
+
+int BufferedStream::readLine(std::string& line, size_t max_len)
+{
+    size_t scanned = m_rpos;
+    while(true)
+    {
+        const char* begin = &m_rbuf[0] + scanned;
+        const char* nl = (const char*)memchr(begin, '\n', m_rend - scanned);
+        if(nl)
+        {
+            size_t end = nl - &m_rbuf[0];
+            size_t consumed = end + 1 - m_rpos;
+            if(consumed > max_len)
+            {
+                return -2;
+            }
+            if(end > m_rpos && m_rbuf[end - 1] == '\r')
+            {
+                --end;
+            }
+            line.assign(&m_rbuf[m_rpos], end - m_rpos);
+            m_rpos += consumed;
+            return consumed;
+        }
+        if(m_rend - m_rpos >= max_len)
+        {
+            // 这些数据加上行尾已经超过max_len了
+            return -2;
+        }
+
+        // 下次只需要扫描新读到的数据，fill可能会挪动数据，记相对位置
+        size_t offset = m_rend - m_rpos;
+        int rt = fill();
+        if(rt <= 0)
+        {
+            return rt;
+        }
+        scanned = m_rpos + offset;
+    }
+}
+
+int BufferedStream::peek(void* buffer, size_t length)
+{
+    while(m_rend - m_rpos < length)
+    {
+        if(m_rbuf.size() - m_rpos < length && m_rbuf.size() < length)
+        {
+            m_rbuf.resize(length);
+        }
+        int rt = fill();
+        if(rt < 0)
+        {
+            return rt;
+        }
+        if(rt == 0)
+        {
+            break;
+        }
+    }
+    size_t len = std::min(length, m_rend - m_rpos);
+    memcpy(buffer, &m_rbuf[m_rpos], len);
+    return len;
+}
+
+int BufferedStream::write(const void* buffer, size_t length)
+{
+    m_wbuf->write(buffer, length);
+    if(m_wbuf->getSize() >= m_writeSize)
+    {
+        int rt = flush();
+        if(rt < 0)
+        {
+            return rt;
+        }
+    }
+    return length;
+}
+
+int BufferedStream::write(ByteArray::ptr ba, size_t length)
+{
+    length = std::min(length, ba->getReadSize());
+    // 共享ba的内存块，不复制
+    m_wbuf->append(*ba->slice(ba->getPosition(), length));
+    ba->setPosition(ba->getPosition() + length);
+    if(m_wbuf->getSize() >= m_writeSize)
+    {
+        int rt = flush();
+        if(rt < 0)
+        {
+            return rt;
+        }
+    }
+    return length;
+}
+
+int BufferedStream::flush()
+{
+    size_t size = m_wbuf->getSize();
+    if(size == 0)
+    {
+        return 0;
+    }
+    // 写缓冲整个作为一组iovec写出去
+    m_wbuf->setPosition(0);
+    int rt = m_stream->wirteFixSize(m_wbuf, size);
+    if(rt <= 0)
+    {
+        // 出错时保留没写出去的部分(共享内存块，不复制)，位置放到末尾接着写
+        size_t sent = m_wbuf->getPosition();
+        if(sent > 0)
+        {
+            m_wbuf = m_wbuf->slice(sent, size - sent);
+        }
+        m_wbuf->setPosition(m_wbuf->getSize());
+        return rt;
+    }
+    m_wbuf->clear();
+    return rt;
+}
+
+void BufferedStream::close()
+{
+    flush();
+    m_stream->close();
+}
+
+}
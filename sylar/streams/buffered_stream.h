@@ -0,0 +1,125 @@
+/**
+ * @filename    buffered_stream.h
+ * @brief   带缓冲的流(装饰器)
+ * @author  L-ge
+ * @version 0.1
+ * @modify  2022-07-30
+ */
+#ifndef __SYLAR_STREAMS_BUFFERED_STREAM_H__
+#define __SYLAR_STREAMS_BUFFERED_STREAM_H__
+
+#include <vector>
+#include <string>
+#include "sylar/stream.h"
+#include "sylar/bytearray.h"
+
+namespace sylar
+{
+
+/**
+ * @brief   给任意Stream加上读缓冲和写缓冲
+ * @details 读：每次从底层流尽量读满预读缓冲，小的read直接从缓冲里拿，
+ *              提供readLine/peek给协议解码用；大于缓冲的read在缓冲空时直接读底层流。
+ *          写：小的写先攒在输出缓冲里，超过阈值或者调用flush时一次writev发出去；
+ *              write(ByteArray)是共享内存块追加，不复制数据。
+ *          写缓冲里的数据在flush、close或者析构时发出去；析构时的flush没法返回错误，
+ *          需要知道是否发送成功的要自己调用flush。
+ */
+class BufferedStream : public Stream
+{
+public:
+    typedef std::shared_ptr<BufferedStream> ptr;
+
+    /**
+     * @brief   构造函数
+     *
+     * @param   stream      底层流
+     * @param   read_size   预读缓冲大小，0表示使用配置 stream.buffered.read_size
+     * @param   write_size  写缓冲达到多少字节自动flush，0表示使用配置 stream.buffered.write_size
+     */
+    BufferedStream(Stream::ptr stream, size_t read_size = 0, size_t write_size = 0);
+
+    /**
+     * @brief   析构时把写缓冲里剩下的数据flush出去，不关闭底层流
+     */
+    ~BufferedStream();
+
+    virtual int read(void* buffer, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+
+    /**
+     * @brief   写数据，先写入写缓冲，返回length
+     */
+    virtual int write(const void* buffer, size_t length) override;
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+
+    /**
+     * @brief   先flush再关闭底层流
+     */
+    virtual void close() override;
+
+    /**
+     * @brief   把写缓冲里的数据全部写到底层流
+     *
+     * @return  成功返回写出的字节数，出错返回底层流的返回值(<=0)，
+     *          没写出去的数据留在写缓冲里
+     */
+    int flush();
+
+    /**
+     * @brief   读一行，行尾的"\n"或"\r\n"不放进line
+     *
+     * @param   line    读到的行
+     * @param   max_len 一行(含行尾)的最大长度，超过认为出错
+     *
+     * @return  返回这一行消耗的字节数(含行尾)
+     *      @retval =0  被关闭(没读到完整的一行)
+     *      @retval <0  出现流错误，-2表示超过max_len
+     */
+    int readLine(std::string& line, size_t max_len = 64 * 1024);
+
+    /**
+     * @brief   查看后面length字节的数据但不消耗，不够时会从底层流读
+     *
+     * @return  返回拷贝到buffer的字节数，被关闭时可能小于length，出错返回<0
+     */
+    int peek(void* buffer, size_t length);
+
+    /**
+     * @brief   读缓冲里还有多少字节没读
+     */
+    size_t getReadBuffered() const { return m_rend - m_rpos; }
+
+    /**
+     * @brief   写缓冲里还有多少字节没写出去
+     */
+    size_t getWriteBuffered() const { return m_wbuf->getSize(); }
+
+    Stream::ptr getStream() const { return m_stream; }
+
+private:
+    /**
+     * @brief   从底层流读一次，追加到读缓冲末尾
+     *
+     * @return  返回底层流read的返回值
+     */
+    int fill();
+
+private:
+    /// 底层流
+    Stream::ptr m_stream;
+    /// 读缓冲
+    std::vector<char> m_rbuf;
+    /// 读缓冲中未读数据的开始位置
+    size_t m_rpos;
+    /// 读缓冲中数据的结束位置
+    size_t m_rend;
+    /// 写缓冲
+    ByteArray::ptr m_wbuf;
+    /// 写缓冲自动flush的阈值
+    size_t m_writeSize;
+};
+
+}
+
+#endif
@@ -1,8 +1,12 @@
 #include "socket_stream.h"
+#include <limits.h>
 
 namespace sylar
 {
 
+/// 单次收发用的iovec个数，放在栈上避免每次调用都分配内存。超出的部分由readFixSize/writeFixSize下一轮再处理
+static const size_t s_stream_iov_count = 64 < IOV_MAX ? 64 : IOV_MAX;
+
 SocketStream::SocketStream(Socket::ptr sock, bool owner)
     : m_socket(sock)
     , m_owner(owner)
@@ -33,9 +37,29 @@ int SocketStream::read(ByteArray::ptr ba, size_t length)
         return -1;
     }
     
-    std::vector<iovec> iovs;
-    ba->getWriteBuffers(iovs, length);      // 拿到iovec写缓存
-    int rt = m_socket->recv(&iovs[0], iovs.size());
+    iovec iovs[s_stream_iov_count];
+    size_t count = s_stream_iov_count;
+    if(ba->isConsumeMode())
+    {
+        // 作为输入缓存时，收到的数据追加到末尾，当前位置是解码的读位置
+        ba->getAppendBuffers(iovs, count, length);
+        if(count == 0)
+        {
+            return 0;
+        }
+        int rt = m_socket->recv(iovs, count);
+        if(rt > 0)
+        {
+            ba->commitAppend(rt);
+        }
+        return rt;
+    }
+    ba->getWriteBuffers(iovs, count, length);      // 拿到iovec写缓存
+    if(count == 0)
+    {
+        return 0;
+    }
+    int rt = m_socket->recv(iovs, count);
     if(rt > 0)
     {
         ba->setPosition(ba->getPosition() + rt);    // 更新当前操作位置
@@ -59,9 +83,14 @@ int SocketStream::write(ByteArray::ptr ba, size_t length)
         return -1;
     }
 
-    std::vector<iovec> iovs;
-    ba->getReadBuffers(iovs, length);       // 拿到iovec读缓存
-    int rt = m_socket->send(&iovs[0], iovs.size());
+    iovec iovs[s_stream_iov_count];
+    size_t count = s_stream_iov_count;
+    ba->getReadBuffers(iovs, count, length, ba->getPosition());     // 拿到iovec读缓存
+    if(count == 0)
+    {
+        return 0;
+    }
+    int rt = m_socket->send(iovs, count);
     if(rt > 0)
     {
         ba->setPosition(ba->getPosition() + rt);    // 更新当前操作位置
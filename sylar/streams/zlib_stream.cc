@@ -1,9 +1,16 @@
 #include "zlib_stream.h"
 #include "sylar/macro.h"
+#include <unordered_map>
+#ifdef SYLAR_HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
 
 namespace sylar 
 {
 
+/// 输出缓存块的最大大小，块大小从buff_size开始每次翻倍直到这个值
+static const uint32_t s_max_buff_size = 256 * 1024;
+
 ZlibStream::ptr ZlibStream::CreateGzip(bool encode, uint32_t buff_size) 
 {
     return Create(encode, buff_size, GZIP);
@@ -30,10 +37,122 @@ ZlibStream::ptr ZlibStream::Create(bool encode, uint32_t buff_size,
     return nullptr;
 }
 
+#ifdef SYLAR_HAVE_LIBDEFLATE
+namespace
+{
+/**
+ * @brief   每个线程每个压缩等级一个libdeflate压缩器
+ */
+struct DeflateCompressors
+{
+    libdeflate_compressor* compressors[10] = {nullptr};
+
+    ~DeflateCompressors()
+    {
+        for(auto i : compressors)
+        {
+            if(i)
+            {
+                libdeflate_free_compressor(i);
+            }
+        }
+    }
+};
+}
+
+int ZlibStream::Compress(const void* data, size_t len, std::string& out
+                         , Type type, int level)
+{
+    if(level == DEFAULT_COMPRESSION)
+    {
+        level = 6;
+    }
+    if(level < 0 || level > 9)
+    {
+        return Z_STREAM_ERROR;
+    }
+    static thread_local DeflateCompressors t_compressors;
+    libdeflate_compressor*& c = t_compressors.compressors[level];
+    if(!c)
+    {
+        c = libdeflate_alloc_compressor(level);
+        if(!c)
+        {
+            return Z_MEM_ERROR;
+        }
+    }
+
+    size_t rt = 0;
+    switch(type)
+    {
+        case GZIP:
+            out.resize(libdeflate_gzip_compress_bound(c, len));
+            rt = libdeflate_gzip_compress(c, data, len, &out[0], out.size());
+            break;
+        case ZLIB:
+            out.resize(libdeflate_zlib_compress_bound(c, len));
+            rt = libdeflate_zlib_compress(c, data, len, &out[0], out.size());
+            break;
+        case DEFLATE:
+        default:
+            out.resize(libdeflate_deflate_compress_bound(c, len));
+            rt = libdeflate_deflate_compress(c, data, len, &out[0], out.size());
+            break;
+    }
+    out.resize(rt);
+    return rt ? Z_OK : Z_BUF_ERROR;
+}
+#else
+int ZlibStream::Compress(const void* data, size_t len, std::string& out
+                         , Type type, int level)
+{
+    if(len > UINT32_MAX)
+    {
+        return Z_BUF_ERROR;
+    }
+    // 每个线程按(格式, 等级)缓存一个压缩流，用完deflateReset
+    static thread_local std::unordered_map<int, ZlibStream::ptr> t_streams;
+    int key = (int)type * 16 + level + 1;
+    ZlibStream::ptr& stream = t_streams[key];
+    if(!stream)
+    {
+        stream = Create(true, 4096, type, level);
+        if(!stream)
+        {
+            t_streams.erase(key);
+            return Z_STREAM_ERROR;
+        }
+    }
+
+    // 按上限一次分配输出，一次deflate(Z_FINISH)压完
+    z_stream& zs = stream->m_zstream;
+    out.resize(deflateBound(&zs, len));
+    zs.next_in = (Bytef*)data;
+    zs.avail_in = len;
+    zs.next_out = (Bytef*)&out[0];
+    zs.avail_out = out.size();
+    int rt = deflate(&zs, Z_FINISH);
+    out.resize(out.size() - zs.avail_out);
+    if(deflateReset(&zs) != Z_OK)
+    {
+        t_streams.erase(key);
+    }
+    if(rt != Z_STREAM_END)
+    {
+        out.clear();
+        return rt == Z_OK ? Z_BUF_ERROR : rt;
+    }
+    return Z_OK;
+}
+#endif
+
 ZlibStream::ZlibStream(bool encode, uint32_t buff_size)
     : m_buffSize(buff_size)
+    , m_lastBuffSize(0)
+    , m_type(DEFLATE)
     , m_encode(encode)
     , m_free(true) 
+    , m_inited(false)
 {
 }
 
@@ -47,6 +166,10 @@ ZlibStream::~ZlibStream()
         }
     }
 
+    if(!m_inited)
+    {
+        return;
+    }
     if(m_encode)
     {
         deflateEnd(&m_zstream);
@@ -127,15 +250,94 @@ int ZlibStream::init(Type type, int level, int window_bits
             break;
     }
 
+    m_type = type;
+    int rt = 0;
     if(m_encode)
     {
-        return deflateInit2(&m_zstream, level, Z_DEFLATED
+        rt = deflateInit2(&m_zstream, level, Z_DEFLATED
                 ,window_bits, memlevel, (int)strategy);
     } 
     else
     {
-        return inflateInit2(&m_zstream, window_bits);
+        rt = inflateInit2(&m_zstream, window_bits);
+    }
+    m_inited = (rt == Z_OK);
+    if(m_inited)
+    {
+        rt = applyDictionary();
+    }
+    return rt;
+}
+
+int ZlibStream::setDictionary(const std::string& dict)
+{
+    if(m_type == GZIP)
+    {
+        return Z_STREAM_ERROR;
     }
+    m_dict = dict;
+    if(!m_inited)
+    {
+        return Z_OK;
+    }
+    return applyDictionary();
+}
+
+int ZlibStream::applyDictionary()
+{
+    if(m_dict.empty())
+    {
+        return Z_OK;
+    }
+    if(m_encode)
+    {
+        return deflateSetDictionary(&m_zstream, (const Bytef*)m_dict.c_str(), m_dict.size());
+    }
+    // zlib格式要等inflate返回Z_NEED_DICT再设置；raw deflate没有数据头，直接设置
+    if(m_type == DEFLATE)
+    {
+        return inflateSetDictionary(&m_zstream, (const Bytef*)m_dict.c_str(), m_dict.size());
+    }
+    return Z_OK;
+}
+
+iovec* ZlibStream::getOutBuffer()
+{
+    if(!m_buffs.empty() && m_buffs.back().iov_len != m_lastBuffSize)
+    {
+        return &m_buffs.back();
+    }
+    uint32_t size = m_buffSize;
+    if(!m_buffs.empty())
+    {
+        size = std::max(m_buffSize, std::min(m_lastBuffSize * 2, s_max_buff_size));
+    }
+    iovec vc;
+    vc.iov_base = malloc(size);
+    vc.iov_len = 0;
+    m_buffs.push_back(vc);
+    m_lastBuffSize = size;
+    return &m_buffs.back();
+}
+
+int ZlibStream::reset()
+{
+    if(m_free)
+    {
+        for(auto& i : m_buffs) 
+        {
+            free(i.iov_base);
+        }
+    }
+    m_buffs.clear();
+    m_lastBuffSize = 0;
+    m_free = true;
+    int rt = m_encode ? deflateReset(&m_zstream) : inflateReset(&m_zstream);
+    if(rt == Z_OK)
+    {
+        rt = applyDictionary();
+    }
+    return rt;
 }
 
 int ZlibStream::encode(const iovec* v, const uint64_t& size, bool finish) 
@@ -152,20 +354,8 @@ int ZlibStream::encode(const iovec* v, const uint64_t& size, bool finish)
         iovec* ivc = nullptr;
         do
         {
-            if(!m_buffs.empty() && m_buffs.back().iov_len != m_buffSize) 
-            {
-                ivc = &m_buffs.back();
-            }
-            else
-            {
-                iovec vc;
-                vc.iov_base = malloc(m_buffSize);
-                vc.iov_len = 0;
-                m_buffs.push_back(vc);
-                ivc = &m_buffs.back();
-            }
-
-            m_zstream.avail_out = m_buffSize - ivc->iov_len;
+            ivc = getOutBuffer();
+            m_zstream.avail_out = m_lastBuffSize - ivc->iov_len;
             m_zstream.next_out = (Bytef*)ivc->iov_base + ivc->iov_len;
 
             ret = deflate(&m_zstream, flush);
@@ -173,13 +363,10 @@ int ZlibStream::encode(const iovec* v, const uint64_t& size, bool finish)
             {
                 return ret;
             }
-            ivc->iov_len = m_buffSize - m_zstream.avail_out;
+            ivc->iov_len = m_lastBuffSize - m_zstream.avail_out;
         } while(m_zstream.avail_out == 0);
     }
-    if(flush == Z_FINISH) 
-    {
-        deflateEnd(&m_zstream);
-    }
+    // Z_FINISH之后不做deflateEnd，留给析构或reset()复用
     return Z_OK;
 }
 
@@ -195,22 +382,11 @@ int ZlibStream::decode(const iovec* v, const uint64_t& size, bool finish)
         flush = finish ? (i == size - 1 ? Z_FINISH : Z_NO_FLUSH) : Z_NO_FLUSH;
 
         iovec* ivc = nullptr;
+        bool again = false;
         do 
         {
-            if(!m_buffs.empty() && m_buffs.back().iov_len != m_buffSize)
-            {
-                ivc = &m_buffs.back();
-            }
-            else
-            {
-                iovec vc;
-                vc.iov_base = malloc(m_buffSize);
-                vc.iov_len = 0;
-                m_buffs.push_back(vc);
-                ivc = &m_buffs.back();
-            }
-
-            m_zstream.avail_out = m_buffSize - ivc->iov_len;
+            ivc = getOutBuffer();
+            m_zstream.avail_out = m_lastBuffSize - ivc->iov_len;
             m_zstream.next_out = (Bytef*)ivc->iov_base + ivc->iov_len;
 
             ret = inflate(&m_zstream, flush);
@@ -218,14 +394,26 @@ int ZlibStream::decode(const iovec* v, const uint64_t& size, bool finish)
             {
                 return ret;
             }
-            ivc->iov_len = m_buffSize - m_zstream.avail_out;
-        } while(m_zstream.avail_out == 0);
-    }
+            ivc->iov_len = m_lastBuffSize - m_zstream.avail_out;
 
-    if(flush == Z_FINISH)
-    {
-        inflateEnd(&m_zstream);
+            // zlib格式的数据头里带了字典的adler32，读到这里才能设置字典，然后继续解压剩下的输入
+            again = false;
+            if(ret == Z_NEED_DICT)
+            {
+                if(m_dict.empty())
+                {
+                    return ret;
+                }
+                ret = inflateSetDictionary(&m_zstream, (const Bytef*)m_dict.c_str(), m_dict.size());
+                if(ret != Z_OK)
+                {
+                    return ret;
+                }
+                again = true;
+            }
+        } while(again || m_zstream.avail_out == 0);
     }
+
     return Z_OK;
 }
 
@@ -266,5 +454,72 @@ sylar::ByteArray::ptr ZlibStream::getByteArray()
     return ba;
 }
 
+ZlibStreamPool::ZlibStreamPool(bool encode, ZlibStream::Type type
+                               , int level, uint32_t max_idle, uint32_t buff_size
+                               , const std::string& dict)
+    : m_encode(encode)
+    , m_type(type)
+    , m_level(level)
+    , m_maxIdle(max_idle)
+    , m_buffSize(buff_size)
+    , m_dict(dict)
+{
+}
+
+ZlibStreamPool::~ZlibStreamPool()
+{
+    MutexType::Lock lk(m_mutex);
+    for(auto i : m_streams)
+    {
+        delete i;
+    }
+    m_streams.clear();
+}
+
+ZlibStream::ptr ZlibStreamPool::get()
+{
+    ZlibStream* ptr = nullptr;
+    {
+        MutexType::Lock lk(m_mutex);
+        if(!m_streams.empty())
+        {
+            ptr = m_streams.front();
+            m_streams.pop_front();
+        }
+    }
+    if(!ptr)
+    {
+        ptr = new ZlibStream(m_encode, m_buffSize);
+        if(ptr->init(m_type, m_level) != Z_OK
+                || (!m_dict.empty() && ptr->setDictionary(m_dict) != Z_OK))
+        {
+            delete ptr;
+            return nullptr;
+        }
+    }
+    // 持有池的智能指针，池被替换掉时已经借出的对象也能安全归还
+    ZlibStreamPool::ptr self = shared_from_this();
+    return ZlibStream::ptr(ptr, [self](ZlibStream* p) {
+                self->release(p);
+            });
+}
+
+void ZlibStreamPool::release(ZlibStream* ptr)
+{
+    if(ptr->reset() != Z_OK)
+    {
+        delete ptr;
+        return;
+    }
+    {
+        MutexType::Lock lk(m_mutex);
+        if(m_streams.size() < m_maxIdle)
+        {
+            m_streams.push_back(ptr);
+            return;
+        }
+    }
+    delete ptr;
 }
 
+}
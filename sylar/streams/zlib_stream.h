@@ -8,11 +8,16 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <list>
+#include "sylar/mutex.h"
 
 namespace sylar {
 
+class ZlibStreamPool;
+
 class ZlibStream : public Stream
 {
+friend class ZlibStreamPool;
 public:
     typedef std::shared_ptr<ZlibStream> ptr;
 
@@ -47,6 +52,22 @@ public:
             Type type = DEFLATE, int level = DEFAULT_COMPRESSION, int window_bits = 15
             ,int memlevel = 8, Strategy strategy = DEFAULT);
 
+    /**
+     * @brief   一次性压缩整块数据，给事先就拿到完整消息体的场景用
+     * @details 输出按压缩上限一次分配好，不经过分块的输出缓存；
+     *          编译时打开SYLAR_HAVE_LIBDEFLATE则用libdeflate，否则用线程内复用的z_stream
+     *
+     * @param   data    待压缩数据
+     * @param   len     数据长度
+     * @param   out     压缩结果
+     * @param   type    压缩格式
+     * @param   level   压缩等级
+     *
+     * @return  成功返回Z_OK
+     */
+    static int Compress(const void* data, size_t len, std::string& out
+                        , Type type = GZIP, int level = DEFAULT_COMPRESSION);
+
     ZlibStream(bool encode, uint32_t buff_size = 4096);
     ~ZlibStream();
 
@@ -58,6 +79,22 @@ public:
 
     int flush();
 
+    /**
+     * @brief   重置z_stream状态并释放输出缓存，可以开始压缩/解压下一段数据
+     * @details 用deflateReset/inflateReset，不需要重新分配z_stream的内部状态
+     */
+    int reset();
+
+    /**
+     * @brief   设置预置字典，压缩和解压双方要用同一份字典
+     * @details 对内容重复度高的短消息(比如结构固定的json)压缩率提升明显。
+     *          字典会保存下来，reset()之后自动重新设置。GZIP格式不支持字典
+     *
+     * @return  成功返回Z_OK
+     */
+    int setDictionary(const std::string& dict);
+    const std::string& getDictionary() const { return m_dict; }
+
     bool isFree() const { return m_free; }
     void setFree(bool v) { m_free = v; }
 
@@ -75,12 +112,83 @@ private:
     int encode(const iovec* v, const uint64_t& size, bool finish);
     int decode(const iovec* v, const uint64_t& size, bool finish);
 
+    /**
+     * @brief   把字典设置到z_stream上(压缩或者raw deflate解压)
+     */
+    int applyDictionary();
+
+    /**
+     * @brief   取一块还有空间的输出缓存，没有就新分配一块
+     * @details 新分配的块比上一块大一倍，最大到s_max_buff_size，大消息体不会分成几百块
+     */
+    iovec* getOutBuffer();
+
 private:
     z_stream m_zstream;
     uint32_t m_buffSize;
+    /// m_buffs最后一块的容量
+    uint32_t m_lastBuffSize;
+    Type m_type;
     bool m_encode;
     bool m_free;
+    /// z_stream是否已经初始化(需要End)
+    bool m_inited;
     std::vector<iovec> m_buffs;
+    /// 预置字典
+    std::string m_dict;
+};
+
+/**
+ * @brief   ZlibStream对象池
+ * @details 同一个池中的ZlibStream参数(类型、压缩等级)相同，
+ *          用完放回池中时调用reset()，下次直接复用z_stream的状态，省掉deflateInit/deflateEnd
+ */
+class ZlibStreamPool : public std::enable_shared_from_this<ZlibStreamPool>
+{
+public:
+    typedef std::shared_ptr<ZlibStreamPool> ptr;
+    typedef Mutex MutexType;
+
+    /**
+     * @brief   构造函数
+     *
+     * @param   encode      压缩还是解压
+     * @param   type        压缩格式
+     * @param   level       压缩等级
+     * @param   max_idle    池中最多保留的空闲对象数
+     * @param   buff_size   输出缓存块的初始大小
+     * @param   dict        预置字典，空表示不用
+     */
+    ZlibStreamPool(bool encode, ZlibStream::Type type
+                   , int level = ZlibStream::DEFAULT_COMPRESSION
+                   , uint32_t max_idle = 64, uint32_t buff_size = 4096
+                   , const std::string& dict = "");
+    ~ZlibStreamPool();
+
+    /**
+     * @brief   取一个ZlibStream，智能指针释放时自动放回池中
+     */
+    ZlibStream::ptr get();
+
+    ZlibStream::Type getType() const { return m_type; }
+    int getLevel() const { return m_level; }
+
+private:
+    /**
+     * @brief   放回池中
+     */
+    void release(ZlibStream* ptr);
+
+private:
+    bool m_encode;
+    ZlibStream::Type m_type;
+    int m_level;
+    uint32_t m_maxIdle;
+    uint32_t m_buffSize;
+    std::string m_dict;
+
+    MutexType m_mutex;
+    std::list<ZlibStream*> m_streams;
 };
 
 }
@@ -19,6 +19,7 @@
 #include "http/servlet.h"
 #include "iomanager.h"
 #include "log.h"
+#include "log_binary.h"
 #include "macro.h"
 #include "mutex.h"
 #include "noncopyable.h"
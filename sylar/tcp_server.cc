@@ -7,6 +7,18 @@ static sylar::ConfigVar<uint64_t>::ptr g_tcp_server_read_timeout =
     sylar::Config::Lookup("tcp_server.read_timeout", (uint64_t)(60 * 1000 * 2),
             "tcp server read timeout");
 
+static sylar::ConfigVar<uint32_t>::ptr g_tcp_server_accept_batch = 
+    sylar::Config::Lookup("tcp_server.accept_batch", (uint32_t)64,
+            "tcp server max connections accepted per batch");
+
+static sylar::ConfigVar<uint32_t>::ptr g_tcp_server_accept_retry_interval = 
+    sylar::Config::Lookup("tcp_server.accept_retry_interval", (uint32_t)100,
+            "tcp server accept retry interval(ms) after an accept error");
+
+static sylar::ConfigVar<std::string>::ptr g_tcp_server_dispatch = 
+    sylar::Config::Lookup("tcp_server.dispatch", std::string("round_robin"),
+            "tcp server io worker dispatch policy: round_robin, least_conn");
+
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
 TcpServer::TcpServer(sylar::IOManager* worker
@@ -15,10 +27,18 @@ TcpServer::TcpServer(sylar::IOManager* worker
     : m_worker(worker)
     , m_ioWorker(io_worker)
     , m_acceptWorker(accept_worker)
+    , m_dispatchPolicy(g_tcp_server_dispatch->getValue() == "least_conn"
+                        ? LEAST_CONN : ROUND_ROBIN)
+    , m_acceptBatch(g_tcp_server_accept_batch->getValue())
     , m_recvTimeout(g_tcp_server_read_timeout->getValue())
     , m_name("sylar/1.0.0")
     , m_isStop(true)
 {
+    if(m_acceptBatch == 0)
+    {
+        m_acceptBatch = 1;
+    }
+    setIOWorkers({io_worker});
 }
 
 TcpServer::~TcpServer()
@@ -129,6 +149,24 @@ void TcpServer::stop()
     });
 }
 
+void TcpServer::setIOWorkers(const std::vector<IOManager*>& workers)
+{
+    m_ioWorkers.clear();
+    for(auto& i : workers)
+    {
+        if(i)
+        {
+            std::shared_ptr<IOWorker> w = std::make_shared<IOWorker>();
+            w->iom = i;
+            m_ioWorkers.push_back(w);
+        }
+    }
+    if(!m_ioWorkers.empty())
+    {
+        m_ioWorker = m_ioWorkers[0]->iom;
+    }
+}
+
 void TcpServer::setConf(const TcpServerConf& v)
 {
     m_conf.reset(new TcpServerConf(v));
@@ -141,6 +179,8 @@ std::string TcpServer::toString(const std::string& prefix)
        << " name=" << m_name << " ssl=" << m_ssl
        << " worker=" << (m_worker ? m_worker->getName() : "")
        << " accept=" << (m_acceptWorker ? m_acceptWorker->getName() : "")
+       << " io_workers=" << m_ioWorkers.size()
+       << " accept_batch=" << m_acceptBatch
        << " recv_timeout=" << m_recvTimeout << "]" << std::endl;
     std::string pfx = prefix.empty() ? "    " : prefix;
     for(auto& i : m_socks)
@@ -157,19 +197,77 @@ void TcpServer::handleClient(Socket::ptr client)
 
 void TcpServer::startAccept(Socket::ptr sock)
 {
+    std::vector<Socket::ptr> clients;
     while(!m_isStop)
     {
-        Socket::ptr client = sock->accept();
-        if(client)
+        clients.clear();
+        int rt = sock->acceptBatch(clients, m_acceptBatch, m_recvTimeout);
+        if(rt > 0)
+        {
+            dispatchClients(clients);
+        }
+        else if(rt < 0 && !m_isStop)
+        {
+            // 比如fd用光了会一直失败，限流，被限掉的条数定时汇总；
+            // errno先保存下来，打日志的过程中可能被改掉
+            int err = errno;
+            SYLAR_LOG_ERROR_LIMIT(g_logger, 10) << "accept errno=" << err
+                << " errstr=" << strerror(err);
+            // 立刻重试大概率还是失败，协程会空转占满CPU，歇一会儿(hook的usleep，只让出协程)
+            usleep(g_tcp_server_accept_retry_interval->getValue() * 1000);
+        }
+    }
+}
+
+size_t TcpServer::selectIOWorker()
+{
+    if(m_ioWorkers.size() == 1)
+    {
+        return 0;
+    }
+    if(m_dispatchPolicy == LEAST_CONN)
+    {
+        size_t idx = 0;
+        int64_t min = m_ioWorkers[0]->conns;
+        for(size_t i = 1; i < m_ioWorkers.size(); ++i)
         {
-            client->setRecvTimeout(m_recvTimeout);
-            m_ioWorker->schedule(std::bind(&TcpServer::handleClient,
-                        shared_from_this(), client));
+            int64_t conns = m_ioWorkers[i]->conns;
+            if(conns < min)
+            {
+                min = conns;
+                idx = i;
+            }
         }
-        else
+        return idx;
+    }
+    return m_ioWorkerIdx++ % m_ioWorkers.size();
+}
+
+void TcpServer::dispatchClients(const std::vector<Socket::ptr>& clients)
+{
+    auto self = shared_from_this();
+    std::vector<std::vector<std::function<void()> > > cbs(m_ioWorkers.size());
+    for(auto& client : clients)
+    {
+        size_t idx = selectIOWorker();
+        std::shared_ptr<IOWorker> worker = m_ioWorkers[idx];
+        // 先记上连接数，同一批里least_conn才不会全分到一个调度器
+        ++worker->conns;
+        cbs[idx].push_back([self, worker, client]() {
+            // handleClient抛异常也要把连接数减回去
+            struct ConnGuard
+            {
+                std::atomic<int64_t>& conns;
+                ~ConnGuard() { --conns; }
+            } guard{worker->conns};
+            self->handleClient(client);
+        });
+    }
+    for(size_t i = 0; i < cbs.size(); ++i)
+    {
+        if(!cbs[i].empty())
         {
-            SYLAR_LOG_ERROR(g_logger) << "accept errno=" << errno
-                << " errstr=" << strerror(errno);
+            m_ioWorkers[i]->iom->schedule(cbs[i].begin(), cbs[i].end());
         }
     }
 }
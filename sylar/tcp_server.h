@@ -10,6 +10,7 @@
 
 #include <memory>
 #include <functional>
+#include <atomic>
 #include "address.h"
 #include "iomanager.h"
 #include "socket.h"
@@ -136,6 +137,17 @@ class TcpServer : public std::enable_shared_from_this<TcpServer>
 public:
     typedef std::shared_ptr<TcpServer> ptr;
 
+    /**
+     * @brief   新连接分发到io调度器的策略
+     */
+    enum DispatchPolicy
+    {
+        /// 轮询
+        ROUND_ROBIN = 0,
+        /// 当前连接数最少的
+        LEAST_CONN = 1
+    };
+
     /**
      * @brief   
      *
@@ -168,6 +180,20 @@ public:
     uint64_t getRecvTimeout() const { return m_recvTimeout; }
     void setRecvTimeout(uint64_t v) { m_recvTimeout = v; }
 
+    /**
+     * @brief   设置处理连接的io调度器组，新连接按分发策略分到其中一个，需在start之前调用
+     */
+    void setIOWorkers(const std::vector<IOManager*>& workers);
+
+    DispatchPolicy getDispatchPolicy() const { return m_dispatchPolicy; }
+    void setDispatchPolicy(DispatchPolicy v) { m_dispatchPolicy = v; }
+
+    /**
+     * @brief   每次最多连续接收多少个连接再分发
+     */
+    uint32_t getAcceptBatch() const { return m_acceptBatch; }
+    void setAcceptBatch(uint32_t v) { m_acceptBatch = v ? v : 1; }
+
     /**
      * @brief  返回服务器名称 
      */
@@ -194,7 +220,26 @@ protected:
      */
     virtual void startAccept(Socket::ptr sock);
 
+    /**
+     * @brief   把一批新连接分发到io调度器，每个调度器只加一次锁
+     */
+    void dispatchClients(const std::vector<Socket::ptr>& clients);
+
+    /**
+     * @brief   按分发策略选一个io调度器，返回下标
+     */
+    size_t selectIOWorker();
+
 protected:
+    /**
+     * @brief   io调度器以及分到它上面还没处理完的连接数
+     */
+    struct IOWorker
+    {
+        IOManager* iom;
+        std::atomic<int64_t> conns = {0};
+    };
+
     /// 监听Socket数组
     std::vector<Socket::ptr> m_socks;
     /// 不知道有什么用
@@ -203,6 +248,14 @@ protected:
     IOManager* m_ioWorker;
     /// 服务器Socket接收连接的调度器
     IOManager* m_acceptWorker;
+    /// 新连接的Socket工作的调度器组(至少包含m_ioWorker)
+    std::vector<std::shared_ptr<IOWorker> > m_ioWorkers;
+    /// 轮询的下一个位置
+    std::atomic<uint32_t> m_ioWorkerIdx = {0};
+    /// 分发策略
+    DispatchPolicy m_dispatchPolicy;
+    /// 每批最多接收的连接数
+    uint32_t m_acceptBatch;
     /// 接收超时时间（毫秒）
     uint64_t m_recvTimeout;
     /// 服务器名称
@@ -0,0 +1,77 @@
+/**
+ * @filename    logcat.cc
+ * @brief   把BinaryLogAppender写的段文件还原成文本日志
+ * @details 用法：sylar_logcat [-p 日志格式] [-l 最低级别] 段文件...
+ *          不指定-p时用段文件里记录的、写入时appender的日志格式
+ */
+#include "sylar/log_binary.h"
+#include <unistd.h>
+#include <iostream>
+
+static void usage(const char* name)
+{
+    std::cerr << "usage: " << name << " [-p pattern] [-l level] segment..." << std::endl
+              << "  -p pattern  LogFormatter pattern, default is the one recorded in the segment" << std::endl
+              << "  -l level    skip records below level (debug/info/warn/error/fatal)" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::string pattern;
+    sylar::LogLevel::Level min_level = sylar::LogLevel::UNKNOW;
+    int opt;
+    while((opt = getopt(argc, argv, "p:l:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'p':
+                pattern = optarg;
+                break;
+            case 'l':
+                min_level = sylar::LogLevel::FromString(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if(optind >= argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int rt = 0;
+    std::string out;
+    for(int i = optind; i < argc; ++i)
+    {
+        sylar::BinaryLogReader reader(argv[i]);
+        if(!reader.isValid())
+        {
+            std::cerr << argv[i] << ": not a binary log segment" << std::endl;
+            rt = 1;
+            continue;
+        }
+        const std::string& p = pattern.empty() ? reader.getPattern() : pattern;
+        sylar::LogFormatter::ptr formatter(new sylar::LogFormatter(
+                    p.empty() ? "%d{%Y-%m-%d %H:%M:%S}%T%m%n" : p));
+        if(formatter->isError())
+        {
+            std::cerr << "invalid pattern: " << p << std::endl;
+            return 1;
+        }
+
+        while(sylar::LogEvent::ptr event = reader.next())
+        {
+            if(event->getLevel() < min_level)
+            {
+                continue;
+            }
+            out.clear();
+            formatter->format(out, event->getLogger(), event->getLevel(), event);
+            std::cout.write(out.c_str(), out.size());
+        }
+    }
+    std::cout.flush();
+    return rt;
+}
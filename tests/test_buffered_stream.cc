@@ -0,0 +1,182 @@
+#include "sylar/streams/buffered_stream.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include <deque>
+#include <string.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief   读的时候按给定的分段返回数据，写的时候记录每次write
+ */
+class MockStream : public sylar::Stream {
+public:
+    typedef std::shared_ptr<MockStream> ptr;
+
+    MockStream(const std::deque<std::string>& chunks = {})
+        : chunks(chunks) {
+    }
+
+    int read(void* buffer, size_t length) override {
+        if(chunks.empty()) {
+            return 0;
+        }
+        std::string& c = chunks.front();
+        size_t len = std::min(length, c.size());
+        memcpy(buffer, c.c_str(), len);
+        c.erase(0, len);
+        if(c.empty()) {
+            chunks.pop_front();
+        }
+        ++reads;
+        return len;
+    }
+
+    int read(sylar::ByteArray::ptr ba, size_t length) override {
+        std::string tmp(length, 0);
+        int rt = read(&tmp[0], length);
+        if(rt > 0) {
+            ba->write(tmp.c_str(), rt);
+        }
+        return rt;
+    }
+
+    int write(const void* buffer, size_t length) override {
+        return write(std::string((const char*)buffer, length));
+    }
+
+    int write(sylar::ByteArray::ptr ba, size_t length) override {
+        std::string tmp(length, 0);
+        ba->read(&tmp[0], length);
+        int rt = write(tmp);
+        // 模拟只写出去一部分：把没写出去的位置退回去
+        ba->setPosition(ba->getPosition() - length + (rt > 0 ? rt : 0));
+        return rt;
+    }
+
+    void close() override {
+        closed = true;
+    }
+
+    int write(const std::string& data) {
+        if(write_limit == 0) {
+            return -1;
+        }
+        size_t len = std::min(data.size(), write_limit);
+        write_limit -= len;
+        writes.push_back(data.substr(0, len));
+        return len;
+    }
+
+    std::string written() const {
+        std::string s;
+        for(auto& i : writes) {
+            s += i;
+        }
+        return s;
+    }
+
+    std::deque<std::string> chunks;
+    std::vector<std::string> writes;
+    size_t write_limit = ~0ull;
+    int reads = 0;
+    bool closed = false;
+};
+
+void test_readline() {
+    // 行尾是\r\n和\n都可以，返回值包括行尾
+    MockStream::ptr ms(new MockStream({"GET / HTTP/1.1\r\nHost: a\r\n\nlast"}));
+    sylar::BufferedStream bs(ms, 64);
+    std::string line;
+    SYLAR_ASSERT(bs.readLine(line) == 16 && line == "GET / HTTP/1.1");
+    SYLAR_ASSERT(bs.readLine(line) == 9 && line == "Host: a");
+    SYLAR_ASSERT(bs.readLine(line) == 1 && line == "");
+    SYLAR_ASSERT(bs.readLine(line) == 0);
+    SYLAR_ASSERT(bs.getReadBuffered() == 4);
+
+    // 一行分在好几次读里，\r和\n也被分开，缓冲比一行还小
+    ms.reset(new MockStream({"abc", "def\r", "\nghijklmnopqrst", "uvw\nxyz\n"}));
+    sylar::BufferedStream bs2(ms, 8);
+    SYLAR_ASSERT(bs2.readLine(line) == 8 && line == "abcdef");
+    SYLAR_ASSERT(bs2.readLine(line) == 18 && line == "ghijklmnopqrstuvw");
+    SYLAR_ASSERT(bs2.readLine(line) == 4 && line == "xyz");
+
+    // 超过max_len：没读到行尾的和一次就读到整行的都要返回-2
+    ms.reset(new MockStream({"abcd", "efgh", "ijkl\n"}));
+    sylar::BufferedStream bs3(ms, 64);
+    SYLAR_ASSERT(bs3.readLine(line, 6) == -2);
+    ms.reset(new MockStream({"abcdefgh\n"}));
+    sylar::BufferedStream bs4(ms, 64);
+    SYLAR_ASSERT(bs4.readLine(line, 4) == -2);
+    ms.reset(new MockStream({"abc\r\n"}));
+    sylar::BufferedStream bs5(ms, 64);
+    SYLAR_ASSERT(bs5.readLine(line, 5) == 5 && line == "abc");
+    SYLAR_LOG_INFO(g_logger) << "readLine ok";
+}
+
+void test_peek() {
+    // peek的长度比缓冲大，缓冲要扩大，数据不被消耗
+    MockStream::ptr ms(new MockStream({"0123456789", "abcdefghij"}));
+    sylar::BufferedStream bs(ms, 8);
+    char buf[32] = {0};
+    SYLAR_ASSERT(bs.peek(buf, 15) == 15);
+    SYLAR_ASSERT(std::string(buf, 15) == "0123456789abcde");
+    SYLAR_ASSERT(bs.getReadBuffered() >= 15);
+    // 比剩下的数据还长时返回能拿到的
+    SYLAR_ASSERT(bs.peek(buf, 30) == 20);
+
+    std::string all;
+    int rt;
+    while((rt = bs.read(buf, sizeof(buf))) > 0) {
+        all.append(buf, rt);
+    }
+    SYLAR_ASSERT(all == "0123456789abcdefghij");
+    SYLAR_LOG_INFO(g_logger) << "peek ok";
+}
+
+void test_write() {
+    // 小的写攒到write_size才写一次
+    MockStream::ptr ms(new MockStream);
+    std::string expect;
+    {
+        sylar::BufferedStream bs(ms, 0, 64);
+        for(int i = 0; i < 6; ++i) {
+            std::string s(10, 'a' + i);
+            SYLAR_ASSERT(bs.write(s.c_str(), s.size()) == 10);
+            expect += s;
+        }
+        SYLAR_ASSERT(ms->writes.empty() && bs.getWriteBuffered() == 60);
+        SYLAR_ASSERT(bs.write("0123456789", 10) == 10);
+        expect += "0123456789";
+        SYLAR_ASSERT(ms->writes.size() == 1 && ms->writes[0] == expect);
+        SYLAR_ASSERT(bs.getWriteBuffered() == 0);
+
+        // 析构时把剩下的flush出去
+        bs.write("tail", 4);
+        expect += "tail";
+    }
+    SYLAR_ASSERT(ms->writes.size() == 2 && ms->written() == expect);
+    SYLAR_ASSERT(!ms->closed);
+
+    // 写出错时没写出去的数据留在缓冲里，下次flush接着写
+    ms.reset(new MockStream);
+    sylar::BufferedStream bs(ms, 0, 1024);
+    bs.write("hello world", 11);
+    ms->write_limit = 3;
+    SYLAR_ASSERT(bs.flush() < 0);
+    SYLAR_ASSERT(ms->written() == "hel" && bs.getWriteBuffered() == 8);
+    bs.write("!", 1);
+    ms->write_limit = ~0ull;
+    SYLAR_ASSERT(bs.flush() == 9);
+    SYLAR_ASSERT(ms->written() == "hello world!" && bs.getWriteBuffered() == 0);
+    bs.close();
+    SYLAR_ASSERT(ms->closed);
+    SYLAR_LOG_INFO(g_logger) << "write ok";
+}
+
+int main(int argc, char** argv) {
+    test_readline();
+    test_peek();
+    test_write();
+    return 0;
+}
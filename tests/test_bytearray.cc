@@ -85,8 +85,284 @@ void test() {
 #undef XX
 }
 
+void test_pool() {
+    for(int i = 0; i < 1000; ++i) {
+        sylar::ByteArray::ptr ba(new sylar::ByteArray(4096));
+        std::string data(4096 * 4, 'a' + i % 26);
+        ba->write(data.c_str(), data.size());
+        ba->setPosition(0);
+        SYLAR_ASSERT(ba->toString() == data);
+    }
+    sylar::ByteArray::PoolStats stats = sylar::ByteArray::GetPoolStats();
+    SYLAR_ASSERT(stats.hits > 0);
+    SYLAR_LOG_INFO(g_logger) << "pool allocs=" << stats.allocs
+                    << " hits=" << stats.hits
+                    << " hit_rate=" << stats.hitRate()
+                    << " retained_bytes=" << stats.retained_bytes;
+}
+
+void test_seek() {
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(16));
+    std::string data;
+    for(int i = 0; i < 10000; ++i) {
+        data.append(1, (char)rand());
+    }
+    ba->write(data.c_str(), data.size());
+    for(int i = 0; i < 1000; ++i) {
+        size_t pos = rand() % data.size();
+        size_t len = rand() % (data.size() - pos);
+        std::string tmp(len, '\0');
+        ba->read(&tmp[0], len, pos);
+        SYLAR_ASSERT(tmp == data.substr(pos, len));
+
+        ba->setPosition(pos);
+        SYLAR_ASSERT(ba->readFuint8() == (uint8_t)data[pos]);
+    }
+    SYLAR_LOG_INFO(g_logger) << "seek ok size=" << ba->getSize();
+}
+
+void test_consume() {
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(64));
+    ba->setConsumeMode(true);
+    uint32_t next_write = 0;
+    uint32_t next_read = 0;
+    for(int i = 0; i < 1000; ++i) {
+        std::vector<iovec> iovs;
+        ba->getAppendBuffers(iovs, 100);
+        std::string tmp;
+        for(int j = 0; j < 25; ++j) {
+            uint32_t v = next_write++;
+            tmp.append((const char*)&v, sizeof(v));
+        }
+        size_t off = 0;
+        for(auto& iov : iovs) {
+            memcpy(iov.iov_base, tmp.c_str() + off, iov.iov_len);
+            off += iov.iov_len;
+        }
+        ba->commitAppend(tmp.size());
+
+        size_t count = (rand() % 25) + 1;
+        while(count-- && ba->getReadSize() >= sizeof(uint32_t)) {
+            uint32_t v;
+            ba->read(&v, sizeof(v));
+            SYLAR_ASSERT(v == next_read++);
+        }
+    }
+    SYLAR_ASSERT(ba->getReadSize() == (next_write - next_read) * sizeof(uint32_t));
+    SYLAR_ASSERT(ba->getSize() < ba->getReadSize() + ba->getBaseSize());
+    ba->compact();
+    SYLAR_ASSERT(ba->getPosition() == 0);
+    SYLAR_ASSERT(ba->getSize() == ba->getReadSize());
+    SYLAR_LOG_INFO(g_logger) << "consume ok unread=" << ba->getReadSize();
+}
+
+void test_slice() {
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(64));
+    std::string data;
+    for(int i = 0; i < 1000; ++i) {
+        data.append(1, (char)rand());
+    }
+    ba->write(data.c_str(), data.size());
+
+    for(int i = 0; i < 100; ++i) {
+        size_t pos = rand() % data.size();
+        size_t len = rand() % (data.size() - pos);
+        sylar::ByteArray::ptr s = ba->slice(pos, len);
+        SYLAR_ASSERT(s->toString() == data.substr(pos, len));
+
+        sylar::ByteArray::ptr out(new sylar::ByteArray(64));
+        out->writeFuint32(len);
+        out->append(*s);
+        out->writeStringWithoutLength("end");
+        out->setPosition(0);
+        SYLAR_ASSERT(out->readFuint32() == len);
+        std::string tmp(len, '\0');
+        out->read(&tmp[0], len);
+        SYLAR_ASSERT(tmp == data.substr(pos, len));
+
+        // 写共享的内存块不影响原来的
+        s->setPosition(0);
+        s->writeStringWithoutLength(std::string(len, 'x'));
+        out->setPosition(4);
+        SYLAR_ASSERT(out->toString() == data.substr(pos, len) + "end");
+    }
+    ba->setPosition(0);
+    SYLAR_ASSERT(ba->toString() == data);
+    SYLAR_LOG_INFO(g_logger) << "slice ok";
+}
+
+void test_array() {
+#define XX(type, len, base_len, little) { \
+    std::vector<type> vec; \
+    for(int i = 0; i < len; ++i) { \
+        vec.push_back((type)rand() / (type)3); \
+    } \
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(base_len)); \
+    ba->setIsLittleEndian(little); \
+    ba->writeArray(&vec[0], vec.size()); \
+    ba->setPosition(0); \
+    std::vector<type> out(vec.size()); \
+    ba->readArray(&out[0], 3); \
+    ba->readArray(&out[3], out.size() - 3); \
+    SYLAR_ASSERT(out == vec); \
+    SYLAR_ASSERT(ba->getReadSize() == 0); \
+}
+    XX(uint16_t, 1001, 7, false);
+    XX(int32_t, 1001, 7, false);
+    XX(uint64_t, 1001, 7, false);
+    XX(double, 1001, 7, false);
+    XX(float, 1001, 4096, true);
+    XX(int64_t, 1001, 4096, true);
+#undef XX
+
+    std::vector<int64_t> vec;
+    for(int i = 0; i < 1000; ++i) {
+        vec.push_back((int64_t)rand() - RAND_MAX / 2);
+    }
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(7));
+    ba->writeVarintArray(&vec[0], vec.size());
+    ba->setPosition(0);
+    std::vector<int64_t> out(vec.size());
+    ba->readVarintArray(&out[0], out.size());
+    SYLAR_ASSERT(out == vec);
+    SYLAR_LOG_INFO(g_logger) << "array ok";
+}
+
+void test_mmap() {
+    std::string data;
+    for(int i = 0; i < 100000; ++i) {
+        data.append(1, (char)rand());
+    }
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(4096));
+    ba->write(data.c_str(), data.size());
+    ba->setPosition(0);
+    SYLAR_ASSERT(ba->writeToFile("/tmp/test_bytearray_mmap.dat"));
+
+    // 只读映射，写入不影响文件
+    sylar::ByteArray::ptr ro(new sylar::ByteArray(4096));
+    SYLAR_ASSERT(ro->mapFile("/tmp/test_bytearray_mmap.dat"));
+    SYLAR_ASSERT(ro->isMapped());
+    SYLAR_ASSERT(ro->toString() == data);
+    ro->setPosition(5000);
+    ro->writeStringWithoutLength("hello");
+    ro->setPosition(0);
+    SYLAR_ASSERT(ro->toString() == data.substr(0, 5000) + "hello" + data.substr(5005));
+    ro.reset();
+    sylar::ByteArray::ptr check(new sylar::ByteArray(4096));
+    SYLAR_ASSERT(check->readFromFile("/tmp/test_bytearray_mmap.dat"));
+    check->setPosition(0);
+    SYLAR_ASSERT(check->toString() == data);
+
+    // 读写映射，按小的映射段扩展文件
+    sylar::Config::Lookup<uint64_t>("bytearray.mmap.segment_bytes")->setValue(8192);
+    unlink("/tmp/test_bytearray_mmap_rw.dat");
+    sylar::ByteArray::ptr rw(new sylar::ByteArray(4096));
+    SYLAR_ASSERT(rw->mapFile("/tmp/test_bytearray_mmap_rw.dat", true));
+    rw->write(data.c_str(), data.size());
+    rw->writeStringWithoutLength("tail");
+    rw->unmapFile();
+    SYLAR_ASSERT(!rw->isMapped() && rw->getSize() == 0);
+    check.reset(new sylar::ByteArray(4096));
+    SYLAR_ASSERT(check->readFromFile("/tmp/test_bytearray_mmap_rw.dat"));
+    check->setPosition(0);
+    SYLAR_ASSERT(check->toString() == data + "tail");
+
+    // 读写映射被slice共享后，双方的写入都先复制，互不影响，也不会写到文件里
+    unlink("/tmp/test_bytearray_mmap_rw.dat");
+    rw.reset(new sylar::ByteArray(4096));
+    SYLAR_ASSERT(rw->mapFile("/tmp/test_bytearray_mmap_rw.dat", true));
+    rw->write(data.c_str(), data.size());
+    sylar::ByteArray::ptr slice = rw->slice(0, 8192);
+    slice->setPosition(100);
+    slice->writeStringWithoutLength("SLICE");
+    rw->setPosition(5000);
+    rw->writeStringWithoutLength("OWNER");
+    // 没被共享的内存块照样写到文件里
+    rw->setPosition(50000);
+    rw->writeStringWithoutLength("FILE!");
+    std::string expect = data.substr(0, 5000) + "OWNER" + data.substr(5005, 50000 - 5005)
+                       + "FILE!" + data.substr(50005);
+    rw->setPosition(0);
+    SYLAR_ASSERT(rw->toString() == expect);
+    slice->setPosition(0);
+    SYLAR_ASSERT(slice->toString() == data.substr(0, 100) + "SLICE" + data.substr(105, 8192 - 105));
+    check.reset(new sylar::ByteArray(4096));
+    SYLAR_ASSERT(check->readFromFile("/tmp/test_bytearray_mmap_rw.dat"));
+    check->setPosition(0);
+    std::string file = check->toString();
+    SYLAR_ASSERT(file.size() >= data.size());
+    SYLAR_ASSERT(file.substr(0, data.size()) == data.substr(0, 50000) + "FILE!" + data.substr(50005));
+    slice.reset();
+    rw->unmapFile();
+
+    // slice比所有者活得久：所有者析构时文件已经截断，slice的写入不能落到映射上
+    unlink("/tmp/test_bytearray_mmap_rw.dat");
+    rw.reset(new sylar::ByteArray(8192));
+    SYLAR_ASSERT(rw->mapFile("/tmp/test_bytearray_mmap_rw.dat", true));
+    rw->writeStringWithoutLength("hello");
+    slice = rw->slice(0, 5);
+    rw.reset();
+    slice->setPosition(0);
+    slice->writeStringWithoutLength("HELLO");
+    std::string big(6000, 'x');
+    slice->write(big.c_str(), big.size());
+    slice->setPosition(0);
+    SYLAR_ASSERT(slice->toString() == "HELLO" + big);
+    check.reset(new sylar::ByteArray(4096));
+    SYLAR_ASSERT(check->readFromFile("/tmp/test_bytearray_mmap_rw.dat"));
+    check->setPosition(0);
+    SYLAR_ASSERT(check->toString() == "hello");
+    SYLAR_LOG_INFO(g_logger) << "mmap ok";
+}
+
+void test_iov() {
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(16));
+    std::string data;
+    for(int i = 0; i < 1000; ++i) {
+        data.append(1, (char)('a' + i % 26));
+    }
+
+    // 写缓存：数组只有4个iovec，一次最多准备4块
+    size_t off = 0;
+    while(off < data.size()) {
+        iovec iovs[4];
+        size_t count = 4;
+        uint64_t len = ba->getWriteBuffers(iovs, count, data.size() - off);
+        SYLAR_ASSERT(count <= 4 && len <= 4 * 16);
+        for(size_t i = 0; i < count; ++i) {
+            memcpy(iovs[i].iov_base, data.c_str() + off, iovs[i].iov_len);
+            off += iovs[i].iov_len;
+        }
+        ba->setPosition(ba->getPosition() + len);
+    }
+
+    // 读缓存：和vector版本描述的是同一段数据
+    std::vector<iovec> all;
+    SYLAR_ASSERT(ba->getReadBuffers(all, 100, 7) == 100);
+    iovec iovs[16];
+    size_t count = 16;
+    SYLAR_ASSERT(ba->getReadBuffers(iovs, count, 100, 7) == 100);
+    SYLAR_ASSERT(count == all.size());
+    for(size_t i = 0; i < count; ++i) {
+        SYLAR_ASSERT(iovs[i].iov_base == all[i].iov_base && iovs[i].iov_len == all[i].iov_len);
+    }
+    count = 2;
+    SYLAR_ASSERT(ba->getReadBuffers(iovs, count, 100, 7) == 16 - 7 + 16);
+
+    ba->setPosition(0);
+    SYLAR_ASSERT(ba->toString() == data);
+    SYLAR_LOG_INFO(g_logger) << "iov ok";
+}
+
 int main(int argc, char** argv) {
     test();
+    test_pool();
+    test_seek();
+    test_consume();
+    test_slice();
+    test_array();
+    test_mmap();
+    test_iov();
     return 0;
 }
 
@@ -0,0 +1,95 @@
+#include "sylar/bytearray.h"
+#include "sylar/sylar.h"
+#include "sylar/macro.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * 原来的实现：先编码到临时数组再write，读的时候一个字节一个字节readFuint8
+ */
+static void write_varint_bytewise(sylar::ByteArray::ptr ba, uint64_t value) {
+    uint8_t tmp[10];
+    uint8_t i = 0;
+    while(value >= 0x80) {
+        tmp[i++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    tmp[i++] = value;
+    ba->write(tmp, i);
+}
+
+static uint64_t read_varint_bytewise(sylar::ByteArray::ptr ba) {
+    uint64_t result = 0;
+    for(int i = 0; i < 64; i += 7) {
+        uint8_t b = 0;
+        ba->read(&b, 1);
+        result |= ((uint64_t)(b & 0x7f)) << i;
+        if(b < 0x80) {
+            break;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    size_t count = 10 * 1000 * 1000;
+    if(argc > 1) {
+        count = atoi(argv[1]);
+    }
+
+    // 各种长度混在一起：1字节、2-3字节、4-5字节、8字节以上
+    std::vector<uint64_t> values;
+    values.reserve(count);
+    for(size_t i = 0; i < count; ++i) {
+        switch(rand() % 4) {
+            case 0: values.push_back(rand() % 128); break;
+            case 1: values.push_back(rand() % 100000); break;
+            case 2: values.push_back((uint32_t)rand() * 2); break;
+            default: values.push_back(((uint64_t)rand() << 32) | rand()); break;
+        }
+    }
+
+#define XX(name, write_stmt, read_stmt) { \
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(4096)); \
+    uint64_t begin = sylar::GetCurrentUS(); \
+    for(auto& v : values) { \
+        write_stmt; \
+    } \
+    uint64_t mid = sylar::GetCurrentUS(); \
+    ba->setPosition(0); \
+    uint64_t sum = 0; \
+    for(size_t i = 0; i < values.size(); ++i) { \
+        uint64_t v = read_stmt; \
+        SYLAR_ASSERT(v == values[i]); \
+        sum += v; \
+    } \
+    uint64_t end = sylar::GetCurrentUS(); \
+    SYLAR_LOG_INFO(g_logger) << name << " count=" << values.size() \
+        << " bytes=" << ba->getSize() \
+        << " encode=" << (mid - begin) / 1000.0 << "ms" \
+        << " decode=" << (end - mid) / 1000.0 << "ms" \
+        << " sum=" << sum; \
+}
+
+    XX("bytewise", write_varint_bytewise(ba, v), read_varint_bytewise(ba));
+    XX("fast", ba->writeUint64(v), ba->readUint64());
+#undef XX
+
+    {
+        sylar::ByteArray::ptr ba(new sylar::ByteArray(4096));
+        uint64_t begin = sylar::GetCurrentUS();
+        for(auto& v : values) {
+            ba->writeFuint64(v);
+        }
+        uint64_t mid = sylar::GetCurrentUS();
+        ba->setPosition(0);
+        for(size_t i = 0; i < values.size(); ++i) {
+            SYLAR_ASSERT(ba->readFuint64() == values[i]);
+        }
+        uint64_t end = sylar::GetCurrentUS();
+        SYLAR_LOG_INFO(g_logger) << "fixed64 count=" << values.size()
+            << " encode=" << (mid - begin) / 1000.0 << "ms"
+            << " decode=" << (end - mid) / 1000.0 << "ms";
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include "sylar/http/http_server.h"
+#include "sylar/http/http_connection.h"
+#include "sylar/http/servlets/cache_servlet.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static int s_backend_calls = 0;
+
+void test_trace_id() {
+    sylar::http::HttpServer::ptr server(new sylar::http::HttpServer(true));
+    sylar::Address::ptr addr = sylar::Address::LookupAnyIPAddress("127.0.0.1:0");
+    SYLAR_ASSERT(server->bind(addr));
+
+    auto backend = std::make_shared<sylar::http::FunctionServlet>([](sylar::http::HttpRequest::ptr req
+                , sylar::http::HttpResponse::ptr rsp
+                , sylar::http::HttpSession::ptr session) {
+            ++s_backend_calls;
+            rsp->setHeader("Content-Type", "text/plain");
+            rsp->setBody("cached body");
+            return 0;
+    });
+    server->getServletDispatch()->addServlet("/cached"
+            , std::make_shared<sylar::http::CachingServlet>(backend, 60 * 1000));
+    server->start();
+
+    std::string url = "http://" + server->getSocks()[0]->getLocalAddress()->toString() + "/cached";
+    const std::string& trace_header = sylar::http::GetTraceHeader();
+    // 第一个请求回源并写入缓存，后面的命中缓存，每个响应都要带回自己的trace id
+    for(auto& id : {"trace-a", "trace-b", "trace-c"}) {
+        auto r = sylar::http::HttpConnection::DoGet(url, 1000, {{trace_header, id}});
+        SYLAR_ASSERT(r->result == 0 && r->response);
+        SYLAR_LOG_INFO(g_logger) << "request " << id << " response "
+            << trace_header << "=" << r->response->getHeader(trace_header);
+        SYLAR_ASSERT(r->response->getHeader(trace_header) == id);
+        SYLAR_ASSERT(r->response->getBody() == "cached body");
+    }
+    SYLAR_ASSERT(s_backend_calls == 1);
+    server->stop();
+}
+
+int main(int argc, char** argv) {
+    sylar::IOManager iom(1, true, "main");
+    iom.schedule(test_trace_id);
+    return 0;
+}
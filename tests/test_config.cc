@@ -2,6 +2,10 @@
 #include "sylar/log.h"
 #include <yaml-cpp/yaml.h>
 #include "sylar/env.h"
+#include "sylar/macro.h"
+#include "sylar/thread.h"
+#include "sylar/iomanager.h"
+#include <fstream>
 #include <iostream>
 
 #if 1
@@ -219,6 +223,105 @@ void test_log() {
     SYLAR_LOG_INFO(system_log) << "hello system" << std::endl;
 }
 
+sylar::ConfigVar<std::vector<int> >::ptr g_snapshot_vec =
+    sylar::Config::Lookup("snapshot.vec", std::vector<int>{0, 0, 0}, "snapshot vec");
+
+void test_snapshot() {
+    // 写线程一直整体替换值，读线程用getRef读，每次读到的都必须是完整的某一个版本
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> reads(0);
+    std::vector<sylar::Thread::ptr> thrs;
+    for(int i = 0; i < 4; ++i) {
+        thrs.push_back(std::make_shared<sylar::Thread>([&stop, &reads](){
+            uint64_t n = 0;
+            int last = 0;
+            while(!stop) {
+                const std::vector<int>& v = g_snapshot_vec->getRef();
+                SYLAR_ASSERT(v.size() == 3 && v[0] == v[1] && v[1] == v[2]);
+                SYLAR_ASSERT(v[0] >= last);
+                last = v[0];
+                ++n;
+            }
+            reads += n;
+        }, "snapshot_" + std::to_string(i)));
+    }
+
+    auto old = g_snapshot_vec->snapshot();
+    uint64_t ts = sylar::GetCurrentMS();
+    for(int i = 1; i <= 10000; ++i) {
+        g_snapshot_vec->setValue(std::vector<int>{i, i, i});
+    }
+    stop = true;
+    for(auto& i : thrs) {
+        i->join();
+    }
+    SYLAR_ASSERT((*old)[0] == 0);
+    SYLAR_ASSERT(g_snapshot_vec->getRef()[0] == 10000);
+    SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << "snapshot reads=" << reads
+        << " used=" << (sylar::GetCurrentMS() - ts) << "ms";
+}
+
+void test_watch() {
+    // 改一个配置文件，只有内容变了的配置项被更新
+    std::string dir = "/tmp/sylar_watch_conf";
+    sylar::FSUtil::Mkdir(dir);
+    auto write_conf = [dir](int port, int timeout) {
+        std::ofstream ofs(dir + "/watch.yml.tmp");
+        ofs << "watch:\n  port: " << port << "\n  timeout: " << timeout << "\n";
+        ofs.close();
+        rename((dir + "/watch.yml.tmp").c_str(), (dir + "/watch.yml").c_str());
+    };
+    write_conf(80, 1000);
+
+    auto port = sylar::Config::Lookup("watch.port", 0, "watch port");
+    auto timeout = sylar::Config::Lookup("watch.timeout", 0, "watch timeout");
+    int port_changes = 0;
+    int timeout_changes = 0;
+    port->addListener([&port_changes](const int& ov, const int& nv) {
+        ++port_changes;
+    });
+    timeout->addListener([&timeout_changes](const int& ov, const int& nv) {
+        ++timeout_changes;
+    });
+    sylar::Config::LoadFromConfDir(dir);
+    SYLAR_ASSERT(port->getValue() == 80 && timeout->getValue() == 1000);
+
+    {
+        sylar::IOManager iom(1, false, "watch");
+        iom.schedule([&iom, &write_conf, &port]() {
+            SYLAR_ASSERT(sylar::Config::WatchConfDir("/tmp/sylar_watch_conf", &iom));
+            write_conf(8080, 1000);
+            for(int i = 0; i < 100 && port->getValue() != 8080; ++i) {
+                usleep(10 * 1000);
+            }
+            sylar::Config::UnwatchConfDir();
+        });
+    }
+    SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << "watch port=" << port->getValue()
+        << " port_changes=" << port_changes << " timeout_changes=" << timeout_changes;
+    SYLAR_ASSERT(port->getValue() == 8080);
+    SYLAR_ASSERT(port_changes == 2 && timeout_changes == 1);
+}
+
+void test_applied() {
+    // 只和上次实际应用的内容比较
+    YAML::Node root = YAML::Load("late:\n  value: 10\n");
+    sylar::Config::AppliedMap applied;
+    SYLAR_ASSERT(sylar::Config::LoadFromYaml(root, applied) == 0);
+
+    // 第一次加载之后才注册的配置项，同样的内容再加载要应用上
+    auto value = sylar::Config::Lookup("late.value", 0, "late value");
+    SYLAR_ASSERT(sylar::Config::LoadFromYaml(root, applied) == 1);
+    SYLAR_ASSERT(value->getValue() == 10);
+    SYLAR_ASSERT(sylar::Config::LoadFromYaml(root, applied) == 0);
+
+    // 加载之后被setValue改过的，再加载要恢复成配置文件的值
+    value->setValue(20);
+    SYLAR_ASSERT(sylar::Config::LoadFromYaml(root, applied) == 1);
+    SYLAR_ASSERT(value->getValue() == 10);
+    SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << "applied ok";
+}
+
 void test_loadconf() {
     sylar::Config::LoadFromConfDir("conf");
 }
@@ -227,6 +330,9 @@ int main(int argc, char** argv) {
     //test_yaml();
     //test_config();
     //test_class();
+    test_snapshot();
+    test_watch();
+    test_applied();
     test_log();
 /*    sylar::EnvMgr::GetInstance()->init(argc, argv);
     test_loadconf();
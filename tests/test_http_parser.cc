@@ -1,5 +1,7 @@
 #include "sylar/http/http_parser.h"
 #include "sylar/log.h"
+#include "sylar/macro.h"
+#include <string.h>
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
@@ -22,6 +24,41 @@ void test_request() {
     SYLAR_LOG_INFO(g_logger) << tmp;
 }
 
+void test_request_resume() {
+    // 模拟慢客户端，每次只送达几个字节
+    sylar::http::HttpRequestParser parser;
+    sylar::http::HttpParseBuffer buffer(16, 4096);
+    std::string tmp = test_request_data;
+    size_t pos = 0;
+    while(!parser.isFinished() && !parser.hasError() && pos < tmp.size()) {
+        if(!buffer.reserve()) {
+            break;
+        }
+        size_t len = std::min((size_t)3, std::min(buffer.writable(), tmp.size() - pos));
+        memcpy(buffer.writeBegin(), &tmp[pos], len);
+        buffer.commit(len);
+        pos += len;
+        parser.resume(buffer.begin(), buffer.size());
+    }
+    // 每次只多3个字节，字段会被切断，要从上次的offset接着解析
+    SYLAR_ASSERT(parser.isFinished() && !parser.hasError());
+    auto req = parser.getData();
+    SYLAR_ASSERT(req->getMethod() == sylar::http::HttpMethod::POST);
+    SYLAR_ASSERT(req->getPath() == "/");
+    SYLAR_ASSERT(req->getHeader("host") == "www.sylar.top");
+    SYLAR_ASSERT(parser.getContentLength() == 10);
+
+    // offset停在头部结束的位置，后面的字节都是消息体
+    size_t header_len = strstr(test_request_data, "\r\n\r\n") + 4 - test_request_data;
+    SYLAR_ASSERT(parser.getOffset() == header_len);
+    SYLAR_ASSERT(pos >= header_len && buffer.size() == pos);
+    buffer.consume(parser.getOffset());
+    SYLAR_ASSERT(buffer.size() == pos - header_len);
+    SYLAR_ASSERT(std::string(buffer.begin(), buffer.size()) + tmp.substr(pos) == "1234567890");
+    SYLAR_LOG_INFO(g_logger) << "resume ok offset=" << parser.getOffset()
+        << " capacity=" << buffer.capacity();
+}
+
 const char test_response_data[] = "HTTP/1.1 200 OK\r\n"
         "Date: Tue, 04 Jun 2019 15:43:56 GMT\r\n"
         "Server: Apache\r\n"
@@ -57,6 +94,8 @@ void test_response() {
 int main(int argc, char** argv) {
     test_request();
     SYLAR_LOG_INFO(g_logger) << "--------------";
+    test_request_resume();
+    SYLAR_LOG_INFO(g_logger) << "--------------";
     test_response();
     return 0;
 }
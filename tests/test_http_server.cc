@@ -30,6 +30,13 @@ void run() {
             return 0;
     });
 
+    sd->addParamServlet("/user/:id/info", [](sylar::http::HttpRequest::ptr req
+                ,sylar::http::HttpResponse::ptr rsp
+                ,sylar::http::HttpSession::ptr session) {
+            rsp->setBody("Route: id=" + req->getRouteParam("id") + "\r\n" + req->toString());
+            return 0;
+    });
+
     sd->addGlobServlet("/sylarx/*", [](sylar::http::HttpRequest::ptr req
                 ,sylar::http::HttpResponse::ptr rsp
                 ,sylar::http::HttpSession::ptr session) {
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include "sylar/sylar.h"
 
@@ -42,10 +43,302 @@ void test2()
     SYLAR_LOG_INFO(l) << "xxx";
 }
 
+void test_async()
+{
+    sylar::Config::Lookup<bool>("log.async.enable")->setValue(true);
+    sylar::Config::Lookup<uint32_t>("log.async.buffer_size")->setValue(4096);
+
+    ::unlink("./log_async.txt");
+    sylar::Logger::ptr logger(new sylar::Logger("async"));
+    sylar::FileLogAppender::ptr file_appender(new sylar::FileLogAppender("./log_async.txt"));
+    file_appender->setFormatter(sylar::LogFormatter::ptr(new sylar::LogFormatter("%t %m%n")));
+    logger->addAppender(file_appender);
+
+    // 缓冲很小，生产者会被阻塞等后台线程
+    std::vector<sylar::Thread::ptr> thrs;
+    for(int i = 0; i < 4; ++i)
+    {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread([logger](){
+            for(int j = 0; j < 10000; ++j)
+            {
+                SYLAR_LOG_INFO(logger) << "async " << j;
+            }
+        }, "log_" + std::to_string(i))));
+    }
+    for(auto& i : thrs)
+    {
+        i->join();
+    }
+    sylar::AsyncLogBackend::GetInstance()->flush();
+
+    std::ifstream ifs("./log_async.txt");
+    std::map<std::string, int> next;
+    std::string tid, word;
+    int n = 0;
+    int lines = 0;
+    while(ifs >> tid >> word >> n)
+    {
+        // 同一个线程的日志是按顺序的
+        SYLAR_ASSERT(next[tid] == n);
+        next[tid] = n + 1;
+        ++lines;
+    }
+    SYLAR_ASSERT(lines == 40000);
+    std::cout << "async lines=" << lines << " dropped="
+              << sylar::AsyncLogBackend::GetInstance()->getDropped() << std::endl;
+    sylar::Config::Lookup<bool>("log.async.enable")->setValue(false);
+}
+
+static int s_eval_count = 0;
+
+static int eval()
+{
+    return ++s_eval_count;
+}
+
+static void log_debug(sylar::Logger::ptr logger)
+{
+    SYLAR_LOG_DEBUG(logger) << "callsite " << eval();
+}
+
+void test_callsite()
+{
+    sylar::Logger::ptr logger = SYLAR_LOG_NAME("callsite");
+    logger->setLevel(sylar::LogLevel::INFO);
+
+    // 不输出时参数不求值
+    log_debug(logger);
+    log_debug(logger);
+    SYLAR_ASSERT(s_eval_count == 0);
+
+    logger->setLevel(sylar::LogLevel::DEBUG);
+    log_debug(logger);
+    SYLAR_ASSERT(s_eval_count == 1);
+
+    logger->setLevel(sylar::LogLevel::INFO);
+    log_debug(logger);
+    SYLAR_ASSERT(s_eval_count == 1);
+
+    // 通过log.yml修改级别，调用点的缓存也要失效
+    YAML::Node root = YAML::Load("logs:\n"
+            "    - name: callsite\n"
+            "      level: debug\n"
+            "      appenders:\n"
+            "          - type: StdoutLogAppender\n");
+    sylar::Config::LoadFromYaml(root);
+    log_debug(logger);
+    SYLAR_ASSERT(s_eval_count == 2);
+    std::cout << sylar::LoggerMgr::GetInstance()->toYamlString() << std::endl;
+}
+
+void test_binary()
+{
+    sylar::FSUtil::Rm("./binlog");
+    sylar::Logger::ptr logger(new sylar::Logger("binary"));
+    // 段很小，会换好几个段
+    sylar::BinaryLogAppender::ptr appender(new sylar::BinaryLogAppender("./binlog/test", 4096));
+    appender->setFormatter(sylar::LogFormatter::ptr(new sylar::LogFormatter("%p %c %m%n")));
+    logger->addAppender(appender);
+
+    std::vector<std::string> expect;
+    char buf[512];
+    const char* text = "abcdefgh";
+    for(int i = 0; i < 200; ++i)
+    {
+        SYLAR_LOG_FMT_INFO(logger, "i=%d %5.2f %-6s|%.*s %llx %c %hhd %zu %%", i, i / 3.0
+                , "str", i % 8, text, (long long)i * 1000000007LL, 'a' + i % 26, i, (size_t)i);
+        snprintf(buf, sizeof(buf), "i=%d %5.2f %-6s|%.*s %llx %c %hhd %zu %%", i, i / 3.0
+                , "str", i % 8, text, (long long)i * 1000000007LL, 'a' + i % 26, (signed char)i, (size_t)i);
+        expect.push_back(std::string("INFO binary ") + buf);
+
+        SYLAR_LOG_ERROR(logger) << "stream " << i;
+        expect.push_back("ERROR binary stream " + std::to_string(i));
+    }
+    std::string first = appender->getSegmentName();
+    logger->clearAppenders();
+    appender.reset();
+
+    std::vector<std::string> files;
+    sylar::FSUtil::ListAllFile(files, "./binlog", ".slog");
+    std::sort(files.begin(), files.end());
+    SYLAR_ASSERT(files.size() > 1);
+
+    size_t n = 0;
+    std::string out;
+    for(auto& f : files)
+    {
+        sylar::BinaryLogReader reader(f);
+        SYLAR_ASSERT(reader.isValid());
+        sylar::LogFormatter::ptr fmt(new sylar::LogFormatter(reader.getPattern()));
+        while(sylar::LogEvent::ptr event = reader.next())
+        {
+            out.clear();
+            fmt->format(out, event->getLogger(), event->getLevel(), event);
+            SYLAR_ASSERT(n < expect.size());
+            SYLAR_ASSERT(out == expect[n] + "\n");
+            ++n;
+        }
+    }
+    SYLAR_ASSERT(n == expect.size());
+    std::cout << "binary segments=" << files.size() << " records=" << n << std::endl;
+}
+
+void test_rotate()
+{
+    sylar::FSUtil::Rm("./rotate");
+    sylar::Logger::ptr logger(new sylar::Logger("rotate"));
+    sylar::RotatingFileLogAppender::ptr appender(new sylar::RotatingFileLogAppender(
+                "./rotate/test.log", 4096, sylar::RotatingFileLogAppender::NONE, 3, true));
+    logger->addAppender(appender);
+    for(int i = 0; i < 1000; ++i)
+    {
+        SYLAR_LOG_INFO(logger) << "rotate test " << i;
+    }
+
+    // 压缩和清理在后台线程
+    std::vector<std::string> files;
+    for(int i = 0; i < 100; ++i)
+    {
+        files.clear();
+        sylar::FSUtil::ListAllFile(files, "./rotate", ".gz");
+        if(files.size() == 3)
+        {
+            break;
+        }
+        usleep(20 * 1000);
+    }
+    struct stat st;
+    SYLAR_ASSERT(stat("./rotate/test.log", &st) == 0 && st.st_size <= 4096);
+    std::cout << "rotated files=" << files.size() << std::endl;
+    SYLAR_ASSERT(files.size() == 3);
+
+    // 被外部移走后，下一秒写的时候重新打开
+    ::rename("./rotate/test.log", "./rotate/moved.log");
+    sleep(1);
+    SYLAR_LOG_INFO(logger) << "after move";
+    SYLAR_ASSERT(stat("./rotate/test.log", &st) == 0 && st.st_size > 0);
+}
+
+class CountLogAppender : public sylar::LogAppender
+{
+public:
+    typedef std::shared_ptr<CountLogAppender> ptr;
+
+    void log(sylar::Logger::ptr logger, sylar::LogLevel::Level level, sylar::LogEvent::ptr event) override
+    {
+        ++counts[level];
+        if(level == sylar::LogLevel::WARN)
+        {
+            std::cout << logger->getName() << " " << event->getFile() << ":" << event->getLine()
+                      << " " << event->getContent() << std::endl;
+        }
+    }
+
+    std::string toYamlString() override { return ""; }
+
+    int counts[6] = {0};
+};
+
+void test_limit()
+{
+    sylar::Config::Lookup<uint32_t>("log.limit.summary_interval")->setValue(100);
+    sylar::Logger::ptr logger(new sylar::Logger("limit"));
+    CountLogAppender::ptr appender(new CountLogAppender);
+    logger->addAppender(appender);
+
+    sylar::Logger::ptr budget(new sylar::Logger("budget"));
+    CountLogAppender::ptr budget_appender(new CountLogAppender);
+    budget->addAppender(budget_appender);
+    budget->setRateLimit(5);
+
+    {
+        // 汇总用的是当前线程IOManager上的定时器
+        sylar::IOManager iom(1, true, "limit");
+        iom.schedule([logger, budget](){
+            for(int i = 0; i < 1000; ++i)
+            {
+                SYLAR_LOG_ERROR_LIMIT(logger, 10) << "limit " << i;
+                SYLAR_LOG_INFO_EVERY_N(logger, 100) << "every_n " << i;
+                SYLAR_LOG_INFO(budget) << "budget " << i;
+            }
+        });
+    }
+    SYLAR_ASSERT(appender->counts[sylar::LogLevel::ERROR] == 10);
+    SYLAR_ASSERT(appender->counts[sylar::LogLevel::INFO] == 10);
+    // 两个调用点各一条汇总
+    SYLAR_ASSERT(appender->counts[sylar::LogLevel::WARN] == 2);
+    SYLAR_ASSERT(budget_appender->counts[sylar::LogLevel::INFO] == 5);
+    SYLAR_ASSERT(budget_appender->counts[sylar::LogLevel::WARN] == 1);
+}
+
+class TraceLogAppender : public sylar::LogAppender
+{
+public:
+    typedef std::shared_ptr<TraceLogAppender> ptr;
+
+    TraceLogAppender()
+    {
+        m_formatter.reset(new sylar::LogFormatter("[%R] %m"));
+    }
+
+    void log(sylar::Logger::ptr logger, sylar::LogLevel::Level level, sylar::LogEvent::ptr event) override
+    {
+        MutexType::Lock lock(m_mutex);
+        lines.push_back(m_formatter->format(logger, level, event));
+        std::cout << lines.back() << std::endl;
+    }
+
+    std::string toYamlString() override { return ""; }
+
+    std::vector<std::string> lines;
+};
+
+void test_trace()
+{
+    sylar::Logger::ptr logger(new sylar::Logger("trace"));
+    TraceLogAppender::ptr appender(new TraceLogAppender);
+    logger->addAppender(appender);
+
+    {
+        sylar::IOManager iom(2, false, "trace");
+        iom.schedule([logger](){
+            sylar::SetTraceId("req-1");
+            SYLAR_LOG_INFO(logger) << "parent";
+            // schedule时的局部变量被子协程继承，子协程修改不影响父协程
+            sylar::IOManager::GetThis()->schedule([logger](){
+                SYLAR_LOG_INFO(logger) << "child";
+                sylar::SetTraceId("req-2");
+                SYLAR_LOG_INFO(logger) << "child changed";
+            });
+            sleep(1);
+            SYLAR_LOG_INFO(logger) << "parent after";
+        });
+        iom.schedule([logger](){
+            SYLAR_LOG_INFO(logger) << "other";
+        });
+    }
+    std::sort(appender->lines.begin(), appender->lines.end());
+    std::vector<std::string> expect = {"[] other", "[req-1] child", "[req-1] parent"
+                                     , "[req-1] parent after", "[req-2] child changed"};
+    SYLAR_ASSERT(appender->lines == expect);
+}
+
 int main(int argc, char** argv)
 {
     test1();
     std::cout << "--------------------------------------\n";
     test2();
+    std::cout << "--------------------------------------\n";
+    test_async();
+    std::cout << "--------------------------------------\n";
+    test_callsite();
+    std::cout << "--------------------------------------\n";
+    test_binary();
+    std::cout << "--------------------------------------\n";
+    test_rotate();
+    std::cout << "--------------------------------------\n";
+    test_limit();
+    std::cout << "--------------------------------------\n";
+    test_trace();
     return 0;
 }
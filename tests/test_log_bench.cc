@@ -0,0 +1,111 @@
+#include "sylar/sylar.h"
+#include <fcntl.h>
+
+static const char* s_pattern = "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n";
+
+static void report(const char* name, uint64_t us, int count) {
+    std::cout << name << ": " << us / 1000 << "ms "
+              << (us ? count * 1000000.0 / us : 0) << " records/s" << std::endl;
+}
+
+// 只格式化不写出，看多线程写同一个logger时的开销
+class FormatOnlyAppender : public sylar::LogAppender {
+public:
+    void log(sylar::Logger::ptr logger, sylar::LogLevel::Level level, sylar::LogEvent::ptr event) override {
+        static thread_local std::string t_buf;
+        t_buf.clear();
+        m_formatter->format(t_buf, logger, level, event);
+    }
+    std::string toYamlString() override { return ""; }
+};
+
+static void bench_threads(int count, int threads) {
+    sylar::Logger::ptr logger(new sylar::Logger("bench_threads"));
+    logger->setFormatter(s_pattern);
+    logger->addAppender(sylar::LogAppender::ptr(new FormatOnlyAppender));
+    std::vector<sylar::Thread::ptr> thrs;
+    uint64_t t0 = sylar::GetCurrentUS();
+    for(int i = 0; i < threads; ++i) {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread([logger, count, threads](){
+            for(int j = 0; j < count / threads; ++j) {
+                SYLAR_LOG_INFO(logger) << "hello log bench j=" << j;
+                // 运行中查找logger也不加锁
+                SYLAR_LOG_NAME("bench_threads");
+            }
+        }, "bench_" + std::to_string(i))));
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+    std::string name = "threads_" + std::to_string(threads);
+    report(name.c_str(), sylar::GetCurrentUS() - t0, count / threads * threads);
+}
+
+int main(int argc, char** argv) {
+    int count = 1000000;
+    if(argc > 1) {
+        count = atoi(argv[1]);
+    }
+
+    sylar::Logger::ptr logger(new sylar::Logger("bench"));
+    logger->setFormatter(s_pattern);
+    logger->addAppender(sylar::LogAppender::ptr(new sylar::FileLogAppender("/dev/null")));
+    sylar::LogFormatter::ptr fmt = logger->getFormatter();
+    int fd = open("/dev/null", O_WRONLY);
+
+    // 原来的做法：每条new一个LogEvent(带stringstream)，FormatItem逐项写ostream
+    uint64_t t0 = sylar::GetCurrentUS();
+    for(int i = 0; i < count; ++i) {
+        sylar::LogEvent::ptr event(new sylar::LogEvent(logger, sylar::LogLevel::INFO
+                    , __FILE__, __LINE__, 0, sylar::GetThreadId(), sylar::GetFiberId()
+                    , time(0), sylar::Thread::GetName()));
+        event->getSS() << "hello log bench i=" << i << " value=" << 3.14;
+        std::stringstream ss;
+        fmt->format(ss, logger, sylar::LogLevel::INFO, event);
+        std::string str = ss.str();
+        if(write(fd, str.c_str(), str.size()) < 0) {
+            return 1;
+        }
+    }
+    report("stream_items", sylar::GetCurrentUS() - t0, count);
+
+    // 宏：复用线程内的LogEvent，编译好的格式化指令，时间按秒缓存
+    t0 = sylar::GetCurrentUS();
+    for(int i = 0; i < count; ++i) {
+        SYLAR_LOG_INFO(logger) << "hello log bench i=" << i << " value=" << 3.14;
+    }
+    report("fast_path", sylar::GetCurrentUS() - t0, count);
+
+    // 异步模式，调用线程只负责格式化和放进缓冲
+    sylar::Config::Lookup<bool>("log.async.enable")->setValue(true);
+    t0 = sylar::GetCurrentUS();
+    for(int i = 0; i < count; ++i) {
+        SYLAR_LOG_INFO(logger) << "hello log bench i=" << i << " value=" << 3.14;
+    }
+    report("fast_path_async", sylar::GetCurrentUS() - t0, count);
+    sylar::AsyncLogBackend::GetInstance()->flush();
+    report("fast_path_async(flushed)", sylar::GetCurrentUS() - t0, count);
+
+    sylar::Config::Lookup<bool>("log.async.enable")->setValue(false);
+    bench_threads(count, 1);
+    bench_threads(count, 32);
+
+    // 格式化结果和原来的一致
+    sylar::LogEvent::ptr event = sylar::LogEvent::Create(logger, sylar::LogLevel::INFO
+                , __FILE__, __LINE__, 0, sylar::GetThreadId(), sylar::GetFiberId()
+                , time(0), sylar::Thread::GetName());
+    event->getSS() << std::hex << 255;
+    std::stringstream ss;
+    fmt->format(ss, logger, sylar::LogLevel::INFO, event);
+    std::string fast;
+    fmt->format(fast, logger, sylar::LogLevel::INFO, event);
+    SYLAR_ASSERT(ss.str() == fast);
+    event.reset();
+    // 复用时上一条日志的std::hex不能带过来
+    event = sylar::LogEvent::Create(logger, sylar::LogLevel::INFO
+                , __FILE__, __LINE__, 0, 0, 0, time(0), "");
+    event->getSS() << 255;
+    SYLAR_ASSERT(event->getContent() == "255");
+    close(fd);
+    return 0;
+}
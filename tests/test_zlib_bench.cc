@@ -0,0 +1,117 @@
+#include "sylar/streams/zlib_stream.h"
+#include "sylar/sylar.h"
+#include "sylar/macro.h"
+#include <sstream>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * 造一段结构固定、内容有变化的json
+ */
+static std::string make_json(size_t size, int seed) {
+    std::stringstream ss;
+    srand(seed);
+    ss << "[";
+    for(int i = 0; (size_t)ss.tellp() < size; ++i) {
+        ss << (i ? "," : "") << "{\"id\":" << (seed * 100000 + i)
+           << ",\"name\":\"user_" << rand() % 100000
+           << "\",\"status\":\"" << (i % 3 ? "active" : "disabled")
+           << "\",\"score\":" << rand() % 1000
+           << ",\"tags\":[\"tag" << i % 17 << "\",\"tag" << i % 5 << "\"]}";
+    }
+    ss << "]";
+    return ss.str();
+}
+
+static std::string decompress(const std::string& data, sylar::ZlibStream::Type type
+                              , const std::string& dict = "") {
+    auto zs = sylar::ZlibStream::Create(false, 4096, type);
+    if(!dict.empty()) {
+        SYLAR_ASSERT(zs->setDictionary(dict) == Z_OK);
+    }
+    SYLAR_ASSERT(zs->write(data.c_str(), data.size()) == Z_OK);
+    zs->flush();
+    return zs->getResult();
+}
+
+/**
+ * total是处理的总字节数，in_bytes/out_bytes用来算压缩率
+ */
+static void report(const char* name, uint64_t us, size_t total, size_t in_bytes, size_t out_bytes) {
+    SYLAR_LOG_INFO(g_logger) << name << ": " << us / 1000 << "ms "
+        << (us ? total / (double)us : 0) << "MB/s ratio="
+        << (in_bytes ? out_bytes * 100.0 / in_bytes : 0) << "%";
+}
+
+int main(int argc, char** argv) {
+    int count = 200;
+    if(argc > 1) {
+        count = atoi(argv[1]);
+    }
+    std::string body = make_json(1024 * 1024, 1);
+    size_t total = body.size() * count;
+
+    // 每次新建z_stream，原来的用法
+    std::string result;
+    uint64_t t0 = sylar::GetCurrentUS();
+    for(int i = 0; i < count; ++i) {
+        auto zs = sylar::ZlibStream::CreateGzip(true);
+        zs->write(body.c_str(), body.size());
+        zs->flush();
+        result = zs->getResult();
+    }
+    report("create_per_use", sylar::GetCurrentUS() - t0, total, body.size(), result.size());
+    SYLAR_ASSERT(decompress(result, sylar::ZlibStream::GZIP) == body);
+
+    // 池化，deflateReset复用
+    auto pool = std::make_shared<sylar::ZlibStreamPool>(true, sylar::ZlibStream::GZIP);
+    t0 = sylar::GetCurrentUS();
+    size_t chunks = 0;
+    for(int i = 0; i < count; ++i) {
+        auto zs = pool->get();
+        zs->write(body.c_str(), body.size());
+        zs->flush();
+        chunks = zs->getBuffers().size();
+        result = zs->getResult();
+    }
+    report("pooled", sylar::GetCurrentUS() - t0, total, body.size(), result.size());
+    SYLAR_LOG_INFO(g_logger) << "pooled output chunks=" << chunks;
+    SYLAR_ASSERT(decompress(result, sylar::ZlibStream::GZIP) == body);
+
+    // 一次性压缩整块
+    t0 = sylar::GetCurrentUS();
+    for(int i = 0; i < count; ++i) {
+        SYLAR_ASSERT(sylar::ZlibStream::Compress(body.c_str(), body.size(), result) == Z_OK);
+    }
+    report("one_shot", sylar::GetCurrentUS() - t0, total, body.size(), result.size());
+    SYLAR_ASSERT(decompress(result, sylar::ZlibStream::GZIP) == body);
+
+    // 小消息加预置字典
+    std::string dict = make_json(4 * 1024, 0);
+    std::vector<std::string> msgs;
+    size_t msg_bytes = 0;
+    for(int i = 0; i < 10000; ++i) {
+        msgs.push_back(make_json(300, i + 2));
+        msg_bytes += msgs.back().size();
+    }
+    for(int d = 0; d < 2; ++d) {
+        for(auto type : {sylar::ZlibStream::ZLIB, sylar::ZlibStream::DEFLATE}) {
+            auto p = std::make_shared<sylar::ZlibStreamPool>(true, type
+                        , sylar::ZlibStream::DEFAULT_COMPRESSION, 64, 4096, d ? dict : "");
+            size_t out_bytes = 0;
+            t0 = sylar::GetCurrentUS();
+            for(auto& m : msgs) {
+                auto zs = p->get();
+                zs->write(m.c_str(), m.size());
+                zs->flush();
+                result = zs->getResult();
+                out_bytes += result.size();
+            }
+            report(d ? (type == sylar::ZlibStream::ZLIB ? "small_zlib_dict" : "small_deflate_dict")
+                     : (type == sylar::ZlibStream::ZLIB ? "small_zlib" : "small_deflate")
+                   , sylar::GetCurrentUS() - t0, msg_bytes, msg_bytes, out_bytes);
+            SYLAR_ASSERT(decompress(result, type, d ? dict : "") == msgs.back());
+        }
+    }
+    return 0;
+}